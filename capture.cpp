@@ -0,0 +1,169 @@
+#include "capture.h"
+
+// Wire time of one byte: start bit, 8 data bits, stop bit
+static const uint32_t byteMicros = (10UL * 1000000UL + GEA_BAUD_RATE - 1) / GEA_BAUD_RATE;
+
+/*
+ * Records are added to buffers[filling]. The other buffer is the one being written to the console;
+ * it is empty when its length is 0, and the two swap whenever it is.
+ */
+static uint8_t buffers[2][CAPTURE_BUFFER_SIZE];
+static size_t lengths[2];
+static uint8_t filling;
+static size_t sent;
+static uint32_t lastMicros;
+static uint32_t droppedPending; // Lost bytes not yet reported in the trace
+static CaptureStats_t counters;
+
+static_assert(sizeof(buffers) <= RAM_BUDGET_CAPTURE, "Capture buffers are over their RAM budget (config.h)");
+
+static size_t putVarint(uint8_t* buffer, uint64_t value) {
+  size_t length = 0;
+
+  while (value >= 0x80) {
+    buffer[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[length++] = value;
+
+  return length;
+}
+
+/*
+ * @brief Write the trace header. buffer must hold CAPTURE_HEADER_SIZE bytes.
+ */
+size_t captureEncodeHeader(uint8_t* buffer, uint32_t baud) {
+  buffer[0] = 'G';
+  buffer[1] = 'E';
+  buffer[2] = 'A';
+  buffer[3] = 'C';
+  buffer[4] = CAPTURE_VERSION;
+  for (int i = 0; i < 4; i++) {
+    buffer[5 + i] = (baud >> (8 * i)) & 0xFF;
+  }
+  return CAPTURE_HEADER_SIZE;
+}
+
+/*
+ * @brief Encode one record. buffer must hold CAPTURE_MAX_RECORD_SIZE bytes.
+ */
+size_t captureEncodeRecord(uint8_t* buffer, uint32_t deltaMicros, uint8_t kind, uint32_t value) {
+  size_t length = putVarint(buffer, ((uint64_t)deltaMicros << 1) | kind);
+
+  if (kind == CAPTURE_BYTE) {
+    buffer[length++] = value;
+  } else {
+    length += putVarint(buffer + length, value);
+  }
+  return length;
+}
+
+static void swap() {
+  filling ^= 1;
+  sent = 0;
+  counters.swaps++;
+}
+
+/*
+ * @brief Add a record to the filling buffer, swapping to the other one if it's full. Returns false if both are in use.
+ */
+static bool append(uint32_t timestamp, uint8_t kind, uint32_t value) {
+  if (lengths[filling] + CAPTURE_MAX_RECORD_SIZE > CAPTURE_BUFFER_SIZE) {
+    if (lengths[filling ^ 1] != 0) {
+      return false;
+    }
+    swap();
+  }
+
+  lengths[filling] += captureEncodeRecord(buffers[filling] + lengths[filling], timestamp - lastMicros, kind, value);
+  lastMicros = timestamp;
+  return true;
+}
+
+static void captureByte(uint32_t timestamp, uint8_t value) {
+  if (droppedPending > 0) {
+    if (!append(timestamp, CAPTURE_DROPPED, droppedPending)) {
+      droppedPending++;
+      counters.dropped++;
+      return;
+    }
+    droppedPending = 0;
+  }
+
+  if (!append(timestamp, CAPTURE_BYTE, value)) {
+    droppedPending++;
+    counters.dropped++;
+    return;
+  }
+  counters.bytes++;
+}
+
+/*
+ * @brief Start a new trace. The header goes out ahead of the first record.
+ */
+void captureBegin() {
+  memset(&counters, 0, sizeof(counters));
+  lengths[0] = lengths[1] = 0;
+  filling = 0;
+  sent = 0;
+  droppedPending = 0;
+  lastMicros = micros();
+  lengths[filling] = captureEncodeHeader(buffers[filling], GEA_BAUD_RATE);
+}
+
+/*
+ * @brief Timestamp and record every byte the bus transport has received. Call this as often as possible.
+ */
+void capturePoll(GeaTransport& transport) {
+  int waiting = transport.available();
+  if (waiting <= 0) {
+    return;
+  }
+
+  uint32_t now = micros();
+  // The bytes that piled up arrived a byte-time apart, the last one just now
+  uint32_t timestamp = now - (waiting - 1) * byteMicros;
+  if ((int32_t)(timestamp - lastMicros) < 0) {
+    timestamp = lastMicros;
+  }
+
+  for (int i = 0; i < waiting; i++) {
+    captureByte(timestamp, transport.read());
+    timestamp += byteMicros;
+    if ((int32_t)(timestamp - now) > 0) {
+      timestamp = now;
+    }
+  }
+}
+
+/*
+ * @brief Write as much of the trace to the console as fits in its TX buffer without blocking.
+ */
+void captureDrain() {
+  uint8_t sending = filling ^ 1;
+
+  if (lengths[sending] == 0) {
+    if (lengths[filling] == 0) {
+      return;
+    }
+    // The console is idle, so send what there is rather than waiting for the buffer to fill
+    swap();
+    sending = filling ^ 1;
+  }
+
+  size_t room = Serial.availableForWrite();
+  size_t chunk = min(room, lengths[sending] - sent);
+  if (chunk > 0) {
+    Serial.write(buffers[sending] + sent, chunk);
+    sent += chunk;
+  }
+
+  if (sent == lengths[sending]) {
+    lengths[sending] = 0;
+    sent = 0;
+  }
+}
+
+const CaptureStats_t& captureStats() {
+  return counters;
+}
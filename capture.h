@@ -0,0 +1,53 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <Arduino.h>
+#include "config.h"
+#include "gea_transport.h"
+
+/*
+ * Passive bus capture. With SNIFFER_MODE the firmware never transmits on the GEA bus; it timestamps
+ * every byte it receives and streams the trace out of the console instead of the log.
+ *
+ * Trace format: a header, then one record per event.
+ *   Header:  'G' 'E' 'A' 'C', CAPTURE_VERSION, bus baud rate as 4 bytes little-endian
+ *   Record:  varint (delta << 1 | kind), then
+ *              CAPTURE_BYTE:     the bus byte
+ *              CAPTURE_DROPPED:  varint count of bus bytes lost because the console fell behind
+ * delta is microseconds since the previous record, so a byte on a busy bus takes 3 bytes of trace
+ * and the console keeps up with a saturated bus with room to spare. Varints are unsigned LEB128, as
+ * in the log.
+ *
+ * The UART is polled in a tight loop, so a byte's timestamp is when it was read, within a few
+ * microseconds of its stop bit. When several bytes are found waiting, the earlier ones are dated a
+ * byte-time apart, back from the last one.
+ *
+ * Records go into one half of a double buffer while the other half is written to the console, so
+ * filling never waits on the console and the console is never left idle while there is trace to send.
+ */
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 9
+#define CAPTURE_MAX_RECORD_SIZE 10
+#define CAPTURE_BUFFER_SIZE 256
+
+typedef enum {
+  CAPTURE_BYTE = 0,
+  CAPTURE_DROPPED = 1
+} CaptureRecordKind;
+
+typedef struct {
+  uint32_t bytes; //   Bus bytes captured
+  uint32_t dropped; // Bus bytes lost because both buffers were full
+  uint32_t swaps;
+} CaptureStats_t;
+
+size_t captureEncodeHeader(uint8_t* buffer, uint32_t baud);
+size_t captureEncodeRecord(uint8_t* buffer, uint32_t deltaMicros, uint8_t kind, uint32_t value);
+
+void captureBegin();
+void capturePoll(GeaTransport& transport);
+void captureDrain();
+const CaptureStats_t& captureStats();
+
+#endif
@@ -5,6 +5,21 @@
 
 #define __DEBUG__
 
+// Uncomment to print log events as text on the console instead of the compact binary records
+//#define LOG_TEXT_OUTPUT
+
+// Uncomment to build a passive bus sniffer that never transmits and streams a timestamped trace of the bus on the console (capture.h)
+//#define SNIFFER_MODE
+
+// Accept binary commands from a supervising host on the console and stream snapshots back (host_control.h). Comment out to
+// leave the console to the log and single-character commands.
+#define HOST_CONTROL
+
+// Collect latency histograms (probe.h). Send 'h' on the console to dump them.
+#ifdef __DEBUG__
+#define LATENCY_PROBES
+#endif
+
 /*
  * GPIO pin configuration. Change these to match your board!
  */
@@ -22,12 +37,160 @@
 
 #define geaUartRxPin PA10 // Receive pin for GEA bus
 #define geaUartTxPin PA9 // Transmit pin for GEA bus
+#define GEA_BAUD_RATE 19200
+
+/*
+ * Number of UARTs with a GEA bus transceiver on them, 1 to 3. Each bus has its own decoder, TX
+ * batch and link timing, and the cooktop tables say which bus each board is on, so with more
+ * buses a power update takes as long as the busiest one instead of every board in turn. Tables
+ * that name more buses than there are fold back onto the ones that exist.
+ */
+#define GEA_BUS_COUNT 1
+#define geaUart2RxPin PA12 // USART6
+#define geaUart2TxPin PA11
+#define geaUart3RxPin PC11 // USART3, not on the STM32F401/F411
+#define geaUart3TxPin PC10
+
+static_assert(GEA_BUS_COUNT >= 1 && GEA_BUS_COUNT <= 3, "GEA_BUS_COUNT must be 1 to 3");
 
 // Analog potentiometer pins
 #define numPots 5
 const int potPins[numPots] = {pot1Pin, pot2Pin, pot3Pin, pot4Pin, pot5Pin};
 
+// Pots map to power levels 0 to MAX_POWER_LEVEL
+#define MAX_POWER_LEVEL 19
+
 // The number of samples that are read for smoothing potentiometer data
 const int numSamples = 10;
 
+// How far, in ADC counts, a pot must move past the edge of its current level before the level changes
+const int potHysteresis = (1 << ADC_RESOLUTION) / 200;
+
+// Uncomment to sample all pots with one continuous ADC scan into memory by DMA (STM32F4 only)
+//#define POT_SCAN_DMA
+
+/*
+ * Knob calibration (input.h). Each pot maps to its level through a lookup table of up to
+ * 2^KNOB_LUT_BITS entries, built from its calibration at boot and again whenever the host sends a
+ * new one. Until a calibration is stored, every pot uses the full ADC range with KNOB_OFF_ZONE of
+ * dead zone at the off end and a linear curve. With KNOB_CALIBRATION_EEPROM the calibrations are
+ * kept in the core's emulated EEPROM at KNOB_CALIBRATION_ADDRESS, so they survive a reflash.
+ */
+#define KNOB_LUT_BITS 8
+#define KNOB_OFF_ZONE ((1 << ADC_RESOLUTION) / 40)
+#define KNOB_CALIBRATION_EEPROM
+#define KNOB_CALIBRATION_ADDRESS 0
+
+/*
+ * Task rates for the main loop scheduler, in milliseconds.
+ */
+
+#define RX_POLL_PERIOD_MS 1 //            Drain the GEA receive FIFO
+#define KNOB_SAMPLE_PERIOD_MS 20 //       Sample and filter the pots
+#define POWER_UPDATE_PERIOD_MS 20 //      Check each generator board for changed power levels
+#define HEARTBEAT_PERIOD_MS 500 //        Increment the heartbeat and toggle the LED
+#define TELEMETRY_POLL_PERIOD_MS 50 //    Request status from the generator board most overdue for it
+#define THERMAL_PERIOD_MS 250 //          Update temperature trends, fan speed and status poll rates
+#define STATUS_PRINT_PERIOD_MS 5000 //    Print the cached status of the next generator board
+#define CONSOLE_PERIOD_MS 500 //          Print pot values to the console
+#define BUS_REPORT_PERIOD_MS 10000 //     Print power frame and bus time counters
+#define HOST_CONTROL_PERIOD_MS 2 //       Read host frames off the console and send replies and snapshots
+
+/*
+ * Host control (host_control.h). Knob overrides fall back to the pots if the host doesn't refresh
+ * them within HOST_OVERRIDE_TIMEOUT_MS, so a host that dies can't leave a coil on.
+ */
+#define HOST_OVERRIDE_TIMEOUT_MS 1000
+#define HOST_STREAM_MIN_PERIOD_MS 20
+
+/*
+ * Power levels are resent at least this often even if they haven't changed, so the generator
+ * boards don't time out. The original firmware sent them every 500 ms, which the boards accept.
+ */
+#define GENERATOR_KEEPALIVE_MS 500
+
+/*
+ * A status request counts as timed out if it isn't answered within TELEMETRY_RESPONSE_TIMEOUT_MS,
+ * and a board's cached status is flagged stale once nothing has arrived for TELEMETRY_STALE_MS.
+ * Each board is polled at its own interval, set by the thermal controller, and at most one request
+ * goes out per TELEMETRY_POLL_PERIOD_MS. Boards start at TELEMETRY_DEFAULT_INTERVAL_MS.
+ */
+#define TELEMETRY_RESPONSE_TIMEOUT_MS 100
+#define TELEMETRY_STALE_MS 10000 //       Must stay well above THERMAL_POLL_IDLE_MS
+#define TELEMETRY_DEFAULT_INTERVAL_MS 1500
+
+/*
+ * Thermal control (thermal.h). Temperatures are in degrees F, as the boards report them. The fan
+ * switches up at the ON threshold and back down only once every reading is below the OFF threshold.
+ * It runs at least at low speed while any coil is on, and at high speed if a powered board's
+ * status goes stale.
+ */
+#define FAN_LOW_ON_BRIDGE_F 110
+#define FAN_LOW_OFF_BRIDGE_F 100
+#define FAN_HIGH_ON_BRIDGE_F 150
+#define FAN_HIGH_OFF_BRIDGE_F 135
+#define FAN_LOW_ON_COIL_F 200
+#define FAN_LOW_OFF_COIL_F 180
+#define FAN_HIGH_ON_COIL_F 280
+#define FAN_HIGH_OFF_COIL_F 260
+
+/*
+ * Status poll interval per board: THERMAL_POLL_FAST_MS while it's hot (past a fan ON threshold) or
+ * heating faster than THERMAL_RISING_F_PER_MIN, scaled from THERMAL_POLL_SLOW_MS down towards
+ * THERMAL_POLL_FAST_MS with commanded power, THERMAL_POLL_SLOW_MS while cooling, and
+ * THERMAL_POLL_IDLE_MS when it's off and not changing. Slopes are measured over at least
+ * THERMAL_SLOPE_WINDOW_MS, since the readings only have 1 degree resolution.
+ */
+#define THERMAL_POLL_FAST_MS 500
+#define THERMAL_POLL_SLOW_MS 2000
+#define THERMAL_POLL_IDLE_MS 5000
+#define THERMAL_RISING_F_PER_MIN 30
+#define THERMAL_SLOPE_WINDOW_MS 2000
+
+/*
+ * Link-level delivery (gea_link.h). A board gets GEA_ACK_TIMEOUT_US to ACK once our last byte is
+ * out. A failed frame is retried after GEA_BACKOFF_SLOT_US plus a random delay of up to
+ * GEA_BACKOFF_SLOT_US << GEA_BACKOFF_MAX_EXPONENT. Comment out GEA_ECHO_CHECK when using a full-duplex adapter that doesn't
+ * echo our own bytes back.
+ */
+#define GEA_ECHO_CHECK
+#define GEA_ACK_TIMEOUT_US 3000
+#define GEA_ECHO_TIMEOUT_US 20000 //      Extra time for our echo, in case another node held the bus
+#define GEA_LINK_MAX_RETRIES 3
+#define GEA_BACKOFF_SLOT_US 1000
+#define GEA_BACKOFF_MAX_EXPONENT 4
+
+#define INIT_PROBE_PERIOD_MS 25 //        How often boards that haven't answered yet are asked again after power on
+#define INIT_PROBE_TIMEOUT_MS 50 //       Wait for one version answer, long enough for every board on a bus to answer in turn
+#define INIT_READY_TIMEOUT_MS 3000 //     Boards not ready by then are reported missing, and the main loop starts without them
+#define INIT_LATE_PROBE_PERIOD_MS 500 //   How often expected boards not ready by then are asked again, once the main loop runs
+#define INIT_EXTRA_GRACE_MS 500 //        Boards the cooktop doesn't have are looked for this much longer, in case they boot late
+
+/*
+ * Static RAM budget, in bytes. Every buffer is statically sized, and each subsystem checks its own
+ * with a static_assert against its share here, so going over fails the build instead of the heap
+ * or the stack at run time. The shares must leave RAM_STACK_RESERVE of RAM_BUDGET for the stack
+ * and the Arduino core. host/memory_report shows what each subsystem really uses, and its deepest
+ * call chain on the stack. The host build has 8 byte pointers and checks against the same numbers,
+ * so the tables that hold callbacks have some room to spare on the target.
+ */
+#define RAM_BUDGET 16384
+#define RAM_STACK_RESERVE 4096
+#define RAM_BUDGET_GEA_CORE (576 * GEA_BUS_COUNT + 192) // Receive queue, TX batch and TX queue per bus, the TX buffer and counters
+#define RAM_BUDGET_GEA_LINK (16 * GEA_BUS_COUNT + 1024) // Frames awaiting ACK
+#define RAM_BUDGET_GEA_TRANSACTION 1024 // Pending requests and command handlers
+#define RAM_BUDGET_LOG 1536
+#define RAM_BUDGET_PROBE 2560
+#define RAM_BUDGET_CAPTURE 640
+#define RAM_BUDGET_SCHEDULER 512
+#define RAM_BUDGET_TELEMETRY 384 //       Telemetry and thermal state for every board
+#define RAM_BUDGET_DISCOVERY 128 //       Bring-up state for every generator address
+#define RAM_BUDGET_HOST_CONTROL 512 //    Console frame decoder and reply buffer
+#define RAM_BUDGET_INPUT 1536 //          Pot filters, calibrations and lookup tables
+
+static_assert(RAM_BUDGET_GEA_CORE + RAM_BUDGET_GEA_LINK + RAM_BUDGET_GEA_TRANSACTION + RAM_BUDGET_LOG + RAM_BUDGET_PROBE +
+              RAM_BUDGET_CAPTURE + RAM_BUDGET_SCHEDULER + RAM_BUDGET_TELEMETRY + RAM_BUDGET_DISCOVERY +
+              RAM_BUDGET_HOST_CONTROL + RAM_BUDGET_INPUT <= RAM_BUDGET - RAM_STACK_RESERVE,
+              "Subsystem RAM budgets add up to more than RAM_BUDGET leaves after the stack reserve");
+
 #endif
@@ -1,20 +1,50 @@
 #include "crc16.h"
 
-uint16_t Crc16ProcessByte(const uint16_t seed, const uint8_t byte) {
-  return (uint16_t)(crc16Table[((seed >> 8) ^ byte) & 0x00FF] ^ (seed << 8));
+constexpr Crc16Table<16> crc16NibbleTable = Crc16MakeNibbleTable();
+constexpr Crc16Table<256> crc16ByteTable = Crc16MakeByteTable();
+constexpr Crc16Table<4 * 256> crc16Slice4Table = Crc16MakeSlice4Table();
+
+// Spot check against the GEA reference table
+static_assert(crc16ByteTable.entries[1] == 0x1021 && crc16ByteTable.entries[255] == 0x1EF0, "CRC16 byte table mismatch");
+static_assert(crc16NibbleTable.entries[1] == 0x1021 && crc16NibbleTable.entries[15] == 0xF1EF, "CRC16 nibble table mismatch");
+static_assert(Crc16ConstProcessByte(0x1234, 0xE3) == (uint16_t)(crc16ByteTable.entries[0x12 ^ 0xE3] ^ (0x1234 << 8)),
+              "Table-free CRC16 doesn't match the tables");
+
+uint16_t Crc16Engine<CRC16_TABLE_NIBBLE>::update(uint16_t crc, const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc = updateByte(crc, data[i]);
+  }
+  return crc;
 }
 
-/*
- * @brief Calculate a CRC16 given a data buffer and size
- */
-uint16_t CalculateCrc16(char *dataToCheck, int sizeOfData) {
-  uint16_t crc = 0xe300;
-  int index;
+uint16_t Crc16Engine<CRC16_TABLE_BYTE>::update(uint16_t crc, const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc = updateByte(crc, data[i]);
+  }
+  return crc;
+}
 
-  for (index = 0; index < sizeOfData; index++) {
-    const uint8_t current = dataToCheck[index];
-    crc = Crc16ProcessByte(crc, current);
+uint16_t Crc16Engine<CRC16_TABLE_SLICE4>::update(uint16_t crc, const uint8_t* data, size_t length) {
+  const uint16_t* t = crc16Slice4Table.entries;
+
+  while (length >= 4) {
+    crc = t[3 * 256 + (((crc >> 8) ^ data[0]) & 0xFF)] ^
+          t[2 * 256 + ((crc ^ data[1]) & 0xFF)] ^
+          t[1 * 256 + data[2]] ^
+          t[data[3]];
+    data += 4;
+    length -= 4;
+  }
+
+  while (length--) {
+    crc = updateByte(crc, *data++);
   }
+  return crc;
+}
 
-  return crc; 
+/*
+ * @brief Calculate a CRC16 given a data buffer and size. The buffer should start after the SOF.
+ */
+uint16_t CalculateCrc16(const char *dataToCheck, int sizeOfData) {
+  return Crc16Finalize(Crc16Update(Crc16Init(), (const uint8_t*)dataToCheck, sizeOfData));
 }
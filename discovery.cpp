@@ -0,0 +1,212 @@
+#include "discovery.h"
+#include "gea_transaction.h"
+#include "scheduler.h"
+#include "config.h"
+#include "log.h"
+
+static const uint8_t generatorAddresses[DISCOVERY_MAX_BOARDS] = {GEN1_ADDR, GEN2_ADDR, GEN3_ADDR};
+
+static DiscoveredBoard_t boards[DISCOVERY_MAX_BOARDS];
+static BootTiming_t timing;
+static uint8_t answered;
+static bool done;
+static const Cooktop_t* discoveryCooktop;
+static PowerShadow_t* discoveryShadows;
+static void (*readyCallback)();
+
+static_assert(DISCOVERY_MAX_BOARDS == MAX_GENERATORS, "Discovery has to probe every generator address a cooktop can use");
+static_assert(sizeof(boards) + sizeof(timing) <= RAM_BUDGET_DISCOVERY, "Discovery state is over its RAM budget (config.h)");
+
+static uint32_t sincePowerOn() {
+  return millis() - timing.powerOnMs;
+}
+
+/*
+ * @brief Bring-up is over: report expected boards that aren't ready yet, log the timing and hand over to the main loop.
+ * Those boards are still probed and configured, just less often, and get no power frames until they're ready.
+ */
+static void finish() {
+  done = true;
+  timing.readyMs = sincePowerOn();
+
+  for (int i = 0; i < DISCOVERY_MAX_BOARDS; i++) {
+    DiscoveredBoard_t* board = &boards[i];
+    if (board->index >= 0 && board->state != BOARD_READY) {
+      // A board that answered keeps getting its config
+      if (board->state == BOARD_PROBING) {
+        board->state = BOARD_MISSING;
+      }
+      timing.missing++;
+      LOG_E(EVT_BOARD_MISSING, board->address, discoveryCooktop->sizeInches, board->probes, board->configs);
+    }
+  }
+
+  LOG_I(EVT_BOOT_TIMING, timing.readyMs, timing.firstAnswerMs, timing.allAnsweredMs, timing.ready, timing.expected, timing.extra);
+  readyCallback();
+}
+
+static void configResponse(GeaResult result, const GeaMessageView& response, void* context) {
+  DiscoveredBoard_t* board = (DiscoveredBoard_t*)context;
+  board->awaiting = false;
+
+  // A lost config answer is sent again on the next probe round
+  if (result != GEA_RESULT_OK || board->state != BOARD_CONFIGURING) {
+    return;
+  }
+
+  PowerShadow_t* shadow = &discoveryShadows[board->index];
+  zeroPowerLevels(shadow, discoveryCooktop->frames[board->index].zeroPower);
+  shadow->ready = true;
+  board->state = BOARD_READY;
+  board->readyMs = sincePowerOn();
+  LOG_I(EVT_BOARD_READY, board->address, board->readyMs, board->configs);
+
+  timing.ready++;
+  if (done) {
+    // Late, so it was counted missing
+    timing.missing--;
+  } else if (timing.ready == timing.expected) {
+    finish();
+  }
+}
+
+static void sendConfig(DiscoveredBoard_t* board) {
+  if (initSingleGenerator(discoveryCooktop->frames[board->index].config, configResponse, board) == 0) {
+    board->awaiting = true;
+    board->configs++;
+  }
+}
+
+/*
+ * @brief The first valid version answer from a board means it's up. Configure it straight away if the cooktop has it.
+ */
+static void versionResponse(GeaResult result, const GeaMessageView& response, void* context) {
+  DiscoveredBoard_t* board = (DiscoveredBoard_t*)context;
+  board->awaiting = false;
+
+  if (result != GEA_RESULT_OK || (board->state != BOARD_PROBING && board->state != BOARD_MISSING)) {
+    return;
+  }
+  if (!SoftwareVersionLayout::decode(response, &board->version)) {
+    LOG_E(EVT_SW_VERSION_BAD_LENGTH, response.payloadLength(), RESP_LENGTH_SW_VERSION);
+    return;
+  }
+
+  board->answeredMs = sincePowerOn();
+  LOG_I(EVT_SW_VERSION, board - boards, board->version.crit_major, board->version.crit_minor,
+        board->version.noncrit_major, board->version.noncrit_minor);
+
+  if (board->index < 0) {
+    board->state = BOARD_EXTRA;
+    timing.extra++;
+    LOG_E(EVT_BOARD_EXTRA, board->address, discoveryCooktop->sizeInches);
+    return;
+  }
+
+  LOG_I(EVT_BOARD_ANSWERED, board->address, board->answeredMs, board->probes);
+  if (timing.firstAnswerMs == 0) {
+    timing.firstAnswerMs = board->answeredMs;
+  }
+  if (++answered == timing.expected) {
+    timing.allAnsweredMs = board->answeredMs;
+  }
+
+  board->state = BOARD_CONFIGURING;
+  sendConfig(board);
+}
+
+/*
+ * @brief Boards the cooktop doesn't have get a version request built at run time, since the table has no frames for them.
+ * Nothing waits on those, so they go out as diagnostics and never hold up a power frame. Probes get no link retries, since
+ * every probe round asks again anyway.
+ */
+static void sendProbe(DiscoveredBoard_t* board) {
+  int result;
+
+  if (board->index >= 0) {
+    result = geaRequest(discoveryCooktop->frames[board->index].versionRequest, GEA_PRIORITY_CONTROL, INIT_PROBE_TIMEOUT_MS,
+                        versionResponse, board, 0);
+  } else {
+    result = geaRequest(board->address, CMD_GET_SW_VERSION, NULL, 0, GEA_PRIORITY_DIAGNOSTIC, INIT_PROBE_TIMEOUT_MS,
+                        versionResponse, board, 0);
+  }
+
+  if (result == 0) {
+    board->awaiting = true;
+    board->probes++;
+  }
+}
+
+/*
+ * @brief One probe round: ask every board that hasn't answered yet, and resend configs that went unanswered. Boards
+ * with a request still in flight are left alone, so a slow board is never asked twice at once. Once the main loop is
+ * running, expected boards that aren't ready yet are still probed and configured every INIT_LATE_PROBE_PERIOD_MS until
+ * they are. Boards the cooktop doesn't have are only asked for INIT_EXTRA_GRACE_MS more, so one that boots a little
+ * later than the rest is reported too.
+ */
+static void discoveryTask(void* context) {
+  uint32_t elapsed = sincePowerOn();
+
+  if (!done && elapsed >= INIT_READY_TIMEOUT_MS) {
+    finish();
+  }
+  bool extras = !done || elapsed - timing.readyMs < INIT_EXTRA_GRACE_MS;
+  if (!extras && timing.ready == timing.expected) {
+    return;
+  }
+
+  for (int i = 0; i < DISCOVERY_MAX_BOARDS; i++) {
+    DiscoveredBoard_t* board = &boards[i];
+    if (board->awaiting || (board->index < 0 && !extras)) {
+      continue;
+    }
+    if (board->state == BOARD_PROBING || board->state == BOARD_MISSING) {
+      sendProbe(board);
+    } else if (board->state == BOARD_CONFIGURING) {
+      sendConfig(board);
+    }
+  }
+
+  schedulerAddOneShot(discoveryTask, NULL, extras ? INIT_PROBE_PERIOD_MS : INIT_LATE_PROBE_PERIOD_MS);
+}
+
+/*
+ * @brief Start bringing up the boards. Call right after the relay closes. onReady runs once, from the scheduler, when
+ * every board the cooktop expects is ready or INIT_READY_TIMEOUT_MS has passed.
+ */
+void discoveryBegin(const Cooktop_t* cooktop, PowerShadow_t* shadows, void (*onReady)()) {
+  memset(boards, 0, sizeof(boards));
+  memset(&timing, 0, sizeof(timing));
+  answered = 0;
+  done = false;
+  discoveryCooktop = cooktop;
+  discoveryShadows = shadows;
+  readyCallback = onReady;
+  timing.powerOnMs = millis();
+
+  for (int i = 0; i < DISCOVERY_MAX_BOARDS; i++) {
+    boards[i].address = generatorAddresses[i];
+    boards[i].index = -1;
+    boards[i].state = BOARD_PROBING;
+    for (int j = 0; j < cooktop->boardCount; j++) {
+      if (cooktop->boards[j].address == generatorAddresses[i]) {
+        boards[i].index = j;
+        timing.expected++;
+      }
+    }
+  }
+
+  schedulerAddOneShot(discoveryTask, NULL, 0);
+}
+
+bool discoveryDone() {
+  return done;
+}
+
+const DiscoveredBoard_t* discoveryBoard(int index) {
+  return &boards[index];
+}
+
+const BootTiming_t* discoveryTiming() {
+  return &timing;
+}
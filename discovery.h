@@ -0,0 +1,64 @@
+#ifndef __DISCOVERY_H__
+#define __DISCOVERY_H__
+
+#include <Arduino.h>
+#include "topology.h"
+
+/*
+ * Brings the generator boards up after the relay closes, without assuming how long they take to
+ * boot. Every generator address is asked for its software version every INIT_PROBE_PERIOD_MS,
+ * all of them at once, until it answers. A board's first valid answer means it's up: its config
+ * goes out right away, and once the board answers that too its coils are zeroed and it's ready.
+ * When every board the cooktop table expects is ready, or INIT_READY_TIMEOUT_MS has passed, the
+ * ready callback runs. Boards the table expects that aren't ready by then are reported missing,
+ * and are still probed and configured every INIT_LATE_PROBE_PERIOD_MS until they are. Power frames
+ * only go to ready boards (PowerShadow_t::ready), so a board never heats without its config. Boards
+ * that answer but aren't in the table, up to INIT_EXTRA_GRACE_MS after that, are reported as extra
+ * and left unconfigured, so they never heat.
+ */
+
+#define DISCOVERY_MAX_BOARDS 3 // Every generator address, GEN1_ADDR..GEN3_ADDR
+
+typedef enum {
+  BOARD_PROBING, //     Powered, hasn't answered yet
+  BOARD_CONFIGURING, // Answered; its config is on the way
+  BOARD_READY, //       Config answered and coils zeroed
+  BOARD_MISSING, //     Expected, but hadn't answered by INIT_READY_TIMEOUT_MS. Still probed.
+  BOARD_EXTRA //        Answered, but isn't in the cooktop table
+} BoardReadiness;
+
+/*
+ * One generator address. Times are milliseconds since the relay closed, or 0 if it hasn't happened.
+ */
+typedef struct {
+  uint8_t address;
+  int8_t index; //      Index in the cooktop table, or -1 if the cooktop doesn't have this board
+  uint8_t state; //     BoardReadiness
+  bool awaiting; //     A version or config request is in flight
+  SoftwareVersion_t version;
+  uint16_t probes; //   Version requests sent
+  uint16_t configs; //  Config requests sent
+  uint32_t answeredMs;
+  uint32_t readyMs;
+} DiscoveredBoard_t;
+
+/*
+ * How long each phase of bring-up took, in milliseconds since the relay closed.
+ */
+typedef struct {
+  uint32_t powerOnMs; //    millis() when the relay closed
+  uint32_t firstAnswerMs; // First answer from any expected board
+  uint32_t allAnsweredMs; // Every expected board has answered, or 0 if one never did
+  uint32_t readyMs; //      Every expected board is ready, or the timeout ran out
+  uint8_t expected;
+  uint8_t ready;
+  uint8_t missing; //  Expected boards not ready yet, counted from the timeout on
+  uint8_t extra;
+} BootTiming_t;
+
+void discoveryBegin(const Cooktop_t* cooktop, PowerShadow_t* shadows, void (*onReady)());
+bool discoveryDone();
+const DiscoveredBoard_t* discoveryBoard(int index);
+const BootTiming_t* discoveryTiming();
+
+#endif
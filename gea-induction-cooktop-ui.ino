@@ -16,72 +16,334 @@
 #include "utils.h"
 #include "crc16.h"
 #include "gea_core.h"
+#include "gea_transaction.h"
+#include "gea_link.h"
 #include "generator_board.h"
 #include "input.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "thermal.h"
+#include "topology.h"
+#include "discovery.h"
+#include "host_control.h"
+#include "log.h"
+#include "probe.h"
+#include "capture.h"
 
-int numberOfCoils;
 uint16_t potValuesRaw[numPots];
 uint8_t potValuesMapped[numPots];
-int heartbeat;
+uint8_t heartbeat;
+uint32_t knobSampleMicros;
+
+PowerBurstTiming_t powerTiming;
 
 HardwareSerial Serial1(geaUartRxPin, geaUartTxPin);
+#if GEA_BUS_COUNT > 1
+HardwareSerial geaUart2(geaUart2RxPin, geaUart2TxPin);
+#endif
+#if GEA_BUS_COUNT > 2
+HardwareSerial geaUart3(geaUart3RxPin, geaUart3TxPin);
+#endif
+
+/*
+ * One transport per GEA bus, indexed by the bus numbers in the cooktop tables.
+ */
+GeaSerialTransport geaTransports[GEA_BUS_COUNT] = {
+  GeaSerialTransport(Serial1),
+#if GEA_BUS_COUNT > 1
+  GeaSerialTransport(geaUart2),
+#endif
+#if GEA_BUS_COUNT > 2
+  GeaSerialTransport(geaUart3),
+#endif
+};
+
+/*
+ * Cooktop topologies. Each lists the generator boards, the bus each is wired to, their coil profiles,
+ * and the pot that drives each coil. To support another cooktop, add a table here and append it to cooktops[].
+ */
+struct FourCoilCooktop {
+  static constexpr uint8_t sizeInches = 30;
+  static constexpr BoardSpec_t boards[] = {
+    {GEN1_ADDR, GEA_BUS(0), {COIL_TYPE_2500_WATT, 0}, {COIL_TYPE_2500_WATT, 1}, GENERATOR_KEEPALIVE_MS},
+    {GEN2_ADDR, GEA_BUS(1), {COIL_TYPE_3700_WATT, 2}, {COIL_TYPE_1800_WATT, 3}, GENERATOR_KEEPALIVE_MS}
+  };
+};
+
+struct FiveCoilCooktop {
+  static constexpr uint8_t sizeInches = 36;
+  static constexpr BoardSpec_t boards[] = {
+    {GEN1_ADDR, GEA_BUS(0), {COIL_TYPE_2500_WATT, 0}, {COIL_TYPE_2500_WATT, 1}, GENERATOR_KEEPALIVE_MS},
+    {GEN2_ADDR, GEA_BUS(1), {COIL_TYPE_3700_WATT, 4}, {COIL_TYPE_NONE, POT_NONE}, GENERATOR_KEEPALIVE_MS},
+    {GEN3_ADDR, GEA_BUS(2), {COIL_TYPE_1800_WATT, 2}, {COIL_TYPE_3200_WATT, 3}, GENERATOR_KEEPALIVE_MS}
+  };
+};
 
 /*
- * Personality IDs
+ * Indexed by the personality pin.
  */
-typedef enum {
-  PERSONALITY_FOUR_COILS=0,
-  PERSONALITY_FIVE_COILS=1
-} PersonalityId;
+const Cooktop_t cooktops[] = {
+  makeCooktop<FourCoilCooktop>(),
+  makeCooktop<FiveCoilCooktop>()
+};
+
+const Cooktop_t* cooktop;
+PowerShadow_t powerShadows[MAX_GENERATORS];
+
+void startMainTasks();
+void powerEchoCheck(int bus, const GeaMessageView& message);
+void powerWireCheck();
+
+/*
+ * @brief Every board the cooktop expects is configured and zeroed, or bring-up gave up on the rest.
+ */
+void cooktopReady() {
+  LOG_I(EVT_MAIN_LOOP_START);
+  startMainTasks();
+}
 
 /*
  * @brief Configures and initializes all generator boards depending on the personality
  */
 int initCooktop(int personality) {
-  PersonalityId personalityName = (PersonalityId)personality;
+  if (personality < 0 || personality >= (int)(sizeof(cooktops) / sizeof(cooktops[0]))) {
+    return -1;
+  }
+
+  cooktop = &cooktops[personality];
+  LOG_I(EVT_BOOT_COOKTOP_SIZE, cooktop->sizeInches);
+
+  telemetryInit();
+  cooktop->begin(powerShadows);
 
   digitalWrite(dlbRelayCtrlPin, HIGH); // Turn on power to the generator boards
-  digitalWrite(fanLowPin, HIGH); // Turn on the cooling fan
-
-  delay(1000); // Allow generator firmware time to boot
-
-  printSoftwareVersions(personality);
-  
-  switch(personalityName) {
-    case PERSONALITY_FOUR_COILS:
-      initSingleGenerator(GEN1_ADDR, COIL_TYPE_2500_WATT, COIL_TYPE_2500_WATT);
-      delay(100);
-      initSingleGenerator(GEN2_ADDR, COIL_TYPE_3700_WATT, COIL_TYPE_1800_WATT);
-      delay(100);
-      setPowerLevels(GEN1_ADDR, 0, 0, 0);
-      printStatus(GEN1_ADDR);
-      delay(100);
-      setPowerLevels(GEN2_ADDR, 0, 0, 0);
-      printStatus(GEN2_ADDR);
-      delay(100);
-      break;
-    case PERSONALITY_FIVE_COILS:
-      initSingleGenerator(GEN1_ADDR, COIL_TYPE_2500_WATT, COIL_TYPE_2500_WATT);
-      delay(100);
-      initSingleGenerator(GEN2_ADDR, COIL_TYPE_3700_WATT, COIL_TYPE_NONE);
-      delay(100);
-      initSingleGenerator(GEN3_ADDR, COIL_TYPE_1800_WATT, COIL_TYPE_3200_WATT);
-      delay(100);
-      setPowerLevels(GEN1_ADDR, 0, 0, 0);
-      printStatus(GEN1_ADDR);
-      delay(100);
-      setPowerLevels(GEN2_ADDR, 0, 0, 0);
-      printStatus(GEN2_ADDR);
-      delay(100);
-      setPowerLevels(GEN3_ADDR, 0, 0, 0);
-      printStatus(GEN3_ADDR);
-      delay(100);
+  discoveryBegin(cooktop, powerShadows, cooktopReady);
+
+  return 0;
+}
+
+/*
+ * @brief Drain each bus's receive FIFO into its frame decoder, route each frame to its request or handler, resend frames
+ * that weren't ACKed, and time out requests that went unanswered.
+ */
+void rxPollTask(void* context) {
+  for (int bus=0; bus<GEA_BUS_COUNT; bus++) {
+    GeaFrameDecoder& decoder = geaBuses[bus].decoder;
+    GeaReceiveMessage(bus);
+
+    while (decoder.available()) {
+      GeaMessageView message(decoder.peek());
+#ifdef GEA_ECHO_CHECK
+      powerEchoCheck(bus, message);
+#endif
+      geaDispatch(message);
+      decoder.pop();
+    }
+  }
+#ifndef GEA_ECHO_CHECK
+  powerWireCheck();
+#endif
+
+  GeaServiceTransmit();
+  geaLinkService();
+  geaExpireRequests();
+}
+
+void knobSampleTask(void* context) {
+  uint8_t previous[numPots];
+  memcpy(previous, potValuesMapped, sizeof(previous));
+
+  readPotsMapped(potValuesMapped);
+  knobSampleMicros = micros();
+
+  if (memcmp(previous, potValuesMapped, sizeof(previous)) != 0) {
+    PROBE_KNOB_SAMPLE();
+  }
+}
+
+/*
+ * @brief Build one frame for every generator board whose levels changed or whose keepalive is due, and send them as one
+ * burst per bus. The buses go out side by side.
+ */
+void powerUpdateTask(void* context) {
+  GeaTxBatch* batches[GEA_BUS_COUNT];
+  bool any = false;
+
+  for (int bus=0; bus<GEA_BUS_COUNT; bus++) {
+    // A bus whose last burst is still going out is skipped. Nothing was marked as sent, so its levels go in the next one.
+    batches[bus] = geaBuses[bus].batch.busy() ? NULL : &geaBuses[bus].batch;
+    if (batches[bus] != NULL) {
+      batches[bus]->begin();
+      any = true;
+    }
+  }
+  if (!any) {
+    return;
+  }
+
+#ifdef HOST_CONTROL
+  cooktop->updatePower(powerShadows, hostControlLevels(), heartbeat, batches);
+#else
+  cooktop->updatePower(powerShadows, potValuesMapped, heartbeat, batches);
+#endif
+
+  uint8_t sentBuses = 0;
+  for (int bus=0; bus<GEA_BUS_COUNT; bus++) {
+    if (batches[bus] != NULL && batches[bus]->frames() > 0) {
+      batches[bus]->send(*geaBuses[bus].transport);
+      sentBuses |= 1 << bus;
+      powerTiming.lastDestination[bus] = batches[bus]->lastDestination();
+      powerTiming.wireEndMicros[bus] = geaLinkWireFreeMicros(bus);
+    }
+  }
+  if (sentBuses != 0) {
+    powerTiming.pendingBuses |= sentBuses;
+    powerTiming.knobMicros = knobSampleMicros;
+  }
+}
+
+/*
+ * @brief One bus's part of the burst left the wire at endMicros. Once every bus's part has, time the burst.
+ */
+static void powerBurstLeft(int bus, uint32_t endMicros) {
+  powerTiming.pendingBuses &= ~(1 << bus);
+  if (powerTiming.pendingBuses != 0) {
+    return;
+  }
+
+  uint32_t elapsed = endMicros - powerTiming.knobMicros;
+  powerTiming.bursts++;
+  powerTiming.lastMicros = elapsed;
+  powerTiming.totalMicros += elapsed;
+  if (elapsed > powerTiming.maxMicros) {
+    powerTiming.maxMicros = elapsed;
+  }
+}
+
+/*
+ * @brief When the echo of a burst's last frame comes back on a bus it went out on, that part has fully left the wire.
+ */
+void powerEchoCheck(int bus, const GeaMessageView& message) {
+  if (!(powerTiming.pendingBuses & (1 << bus)) || message.source() != LOCAL_ADDR || message.command() != CMD_SET_PWR_LEVELS ||
+      message.destination() != powerTiming.lastDestination[bus]) {
+    return;
+  }
+
+  powerBurstLeft(bus, micros());
+}
+
+/*
+ * @brief Without the echo, a bus's part of the burst is done once the UART has had time to send it all, going by the
+ * wire time the link layer counted for everything handed over up to the end of the burst.
+ */
+void powerWireCheck() {
+  uint32_t now = micros();
+
+  for (int bus=0; bus<GEA_BUS_COUNT; bus++) {
+    if (powerTiming.pendingBuses & (1 << bus) && !geaBuses[bus].batch.busy() &&
+        (int32_t)(now - powerTiming.wireEndMicros[bus]) >= 0) {
+      powerBurstLeft(bus, powerTiming.wireEndMicros[bus]);
+    }
+  }
+}
+
+/*
+ * @brief Report how many power frames were skipped because nothing changed and the bus time that saved, how well
+ * frames are getting through to each board, and how long each class of frame waited for the wire.
+ */
+void busReportTask(void* context) {
+  uint32_t sent = 0;
+  uint32_t skipped = 0;
+
+  for (int i=0; i<cooktop->boardCount; i++) {
+    sent += powerShadows[i].framesSent;
+    skipped += powerShadows[i].framesSkipped;
+  }
+
+  LOG_I(EVT_BUS_REPORT, sent, skipped, skipped * powerFrameWireMicros() / 1000);
+
+  if (powerTiming.bursts > 0) {
+    LOG_I(EVT_POWER_CYCLE_TIMING, powerTiming.lastMicros, powerTiming.totalMicros / powerTiming.bursts, powerTiming.maxMicros, powerTiming.bursts);
+  }
+
+  for (int i=0; i<geaLinkBoardCount(); i++) {
+    const GeaLinkStats_t* link = geaLinkBoard(i);
+    LOG_I(EVT_GEA_LINK_REPORT, link->address, link->acked, link->frames, link->collisions, link->ackTimeouts, link->failed);
+  }
+
+  // How long frames waited for the wire, rounded up to whole byte-times
+  const GeaTxClassStats_t* burst = geaTxBurstStats();
+  LOG_I(EVT_GEA_TX_BURST_REPORT, burst->sent, (burst->maxWaitMicros + GEA_BYTE_MICROS - 1) / GEA_BYTE_MICROS, GEA_TX_POWER_MAX_WAIT_BYTES);
+  for (int i=0; i<GEA_PRIORITY_COUNT; i++) {
+    const GeaTxClassStats_t* tx = geaTxStats((GeaPriority)i);
+    LOG_I(EVT_GEA_TX_REPORT, i, tx->sent, tx->coalesced, tx->dropped, (tx->maxWaitMicros + GEA_BYTE_MICROS - 1) / GEA_BYTE_MICROS);
+  }
+}
+
+void heartbeatTask(void* context) {
+  heartbeat++;
+  digitalWrite(heartbeatLed, !digitalRead(heartbeatLed));
+}
+
+/*
+ * @brief Print the cached status of one generator board per run, round-robin. Never touches the bus.
+ */
+void statusPrintTask(void* context) {
+  static int index = 0;
+  const BoardTelemetry_t* board = telemetryBoard(index);
+
+  if (telemetryIsFresh(index)) {
+    LOG_I(EVT_STATUS, board->address, telemetryCoilTemp(index, 0), telemetryCoilTemp(index, 1),
+          telemetryHalfBridgeTemp(index, 0), telemetryHalfBridgeTemp(index, 1), telemetryAcLineVoltage(index));
+  }
+  LOG_I(EVT_TELEMETRY_REPORT, board->address, board->requests, board->responses, board->timeouts);
+
+  const ThermalBoard_t* thermal = thermalBoard(index);
+  LOG_I(EVT_THERMAL_REPORT, board->address, thermal->coilTemp, thermal->coilSlope, thermal->bridgeTemp, thermal->bridgeSlope, thermal->intervalMs);
+
+  index = (index + 1) % telemetryBoardCount();
+}
+
+/*
+ * @brief Handle a single-character console command:
+ *   h  Dump the latency histograms
+ */
+void consoleCommand(uint8_t value) {
+  switch (value) {
+    case 'h':
+      PROBE_DUMP();
       break;
     default:
       break;
   }
+}
 
-  return 0;
+/*
+ * @brief Print the pot values. With HOST_CONTROL, the host control task reads the console instead and passes on the
+ * bytes that aren't part of a frame.
+ */
+void consoleTask(void* context) {
+  LOG_I(EVT_POT_VALUES, potValuesMapped[0], potValuesMapped[1], potValuesMapped[2], potValuesMapped[3], potValuesMapped[4]);
+
+#ifndef HOST_CONTROL
+  while (Serial.available() > 0) {
+    consoleCommand(Serial.read());
+  }
+#endif
+}
+
+/*
+ * @brief Register the periodic tasks that make up the main control loop.
+ */
+void startMainTasks() {
+  schedulerAddPeriodic(knobSampleTask, NULL, KNOB_SAMPLE_PERIOD_MS, 0);
+  schedulerAddPeriodic(heartbeatTask, NULL, HEARTBEAT_PERIOD_MS, 0);
+  schedulerAddPeriodic(consoleTask, NULL, CONSOLE_PERIOD_MS, 0);
+  schedulerAddPeriodic(telemetryPollTask, NULL, TELEMETRY_POLL_PERIOD_MS, 0);
+  schedulerAddPeriodic(thermalTask, powerShadows, THERMAL_PERIOD_MS, 0);
+  schedulerAddPeriodic(statusPrintTask, NULL, STATUS_PRINT_PERIOD_MS, STATUS_PRINT_PERIOD_MS);
+  schedulerAddPeriodic(busReportTask, NULL, BUS_REPORT_PERIOD_MS, BUS_REPORT_PERIOD_MS);
+  schedulerAddPeriodic(powerUpdateTask, NULL, POWER_UPDATE_PERIOD_MS, 0);
 }
 
 /*
@@ -89,72 +351,50 @@ int initCooktop(int personality) {
  */
 void setup() {
   Serial.begin(115200); // Console logging
-  Serial1.begin(19200);
-  Serial.println("I: Initializing potentiometers...");
-  Serial.print("I: Using an ADC resolution of ");
-  Serial.print(ADC_RESOLUTION);
-  Serial.println(" bits");
+  for (int bus=0; bus<GEA_BUS_COUNT; bus++) {
+    geaTransports[bus].uart().begin(GEA_BAUD_RATE);
+    geaBusBegin(bus, &geaTransports[bus]);
+  }
+#ifdef SNIFFER_MODE
+  // Listen only: the generator boards stay unpowered and nothing is ever sent on the bus
+  captureBegin();
+  return;
+#endif
+  PROBE_BEGIN();
+  LOG_I(EVT_BOOT);
+  LOG_I(EVT_BOOT_ADC_RESOLUTION, ADC_RESOLUTION);
 
-  for (int i=0; i<5; i++) {
+  for (int i=0; i<numPots; i++) {
     pinMode(potPins[i], INPUT);
   }
+  potsBegin();
   pinMode(personalitySelPin, INPUT);
   pinMode(heartbeatLed, OUTPUT);
   pinMode(dlbRelayCtrlPin, OUTPUT);
   pinMode(fanLowPin, OUTPUT);
   pinMode(fanHighPin, OUTPUT);
+  thermalInit();
 
-  int personality;
-
-  if (digitalRead(personalitySelPin) == 1) {
-    personality = 1;
-    numberOfCoils = 5;
-  } else {
-    personality = 0;
-    numberOfCoils = 4;
-  }
-
-  
-  Serial.print("I: Initializing generator boards for a ");
-  if (personality == 1) {
-    //Serial.println("36 inch cooktop...");
-  } else {
-    Serial.println("30 inch cooktop...");
-  }
-  
-
-  initCooktop(personality);
-  Serial.println("I: Starting main loop...");
+  geaTransactionInit();
+  geaLinkInit();
+  schedulerAddPeriodic(rxPollTask, NULL, RX_POLL_PERIOD_MS, 0);
+  initCooktop(digitalRead(personalitySelPin));
+#ifdef HOST_CONTROL
+  hostControlBegin(cooktop, powerShadows, potValuesMapped, consoleCommand);
+  schedulerAddPeriodic(hostControlTask, NULL, HOST_CONTROL_PERIOD_MS, 0);
+#endif
 }
 
 /*
- * Cyclically process pot values and set power levels, incrementing the heartbeat every time the levels are updated.
+ * Run whichever tasks are due, and use the idle time to write out the log. Nothing in here may block.
  */
 void loop() {
-  for(heartbeat = 0; heartbeat < 256; heartbeat++) {
-    digitalWrite(heartbeatLed, !digitalRead(heartbeatLed));
-
-    readPotsMapped(potValuesMapped, 0, 19);
-    
-    Serial.print("I: Pot values: ");
-    for (int i=0; i<numPots; i++) {
-      Serial.print(potValuesMapped[i]);
-      Serial.print(" ");
-    }
-    Serial.println();
-    
-    switch(numberOfCoils) {
-      case 4:
-        setPowerLevels(GEN1_ADDR, potValuesMapped[0], potValuesMapped[1], heartbeat);
-        setPowerLevels(GEN2_ADDR, potValuesMapped[2], potValuesMapped[3], heartbeat);
-        break;
-      case 5:
-        setPowerLevels(GEN1_ADDR, potValuesMapped[0], potValuesMapped[1], heartbeat);
-        setPowerLevels(GEN2_ADDR, potValuesMapped[4], 0, heartbeat);
-        setPowerLevels(GEN3_ADDR, potValuesMapped[2], potValuesMapped[3], heartbeat);
-        break;
-    }
-
-    delay(500);
+#ifdef SNIFFER_MODE
+  capturePoll(geaTransports[0]);
+  captureDrain();
+#else
+  if (!schedulerRun()) {
+    logDrain();
   }
+#endif
 }
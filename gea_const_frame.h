@@ -0,0 +1,123 @@
+#ifndef __GEA_CONST_FRAME_H__
+#define __GEA_CONST_FRAME_H__
+
+#include <Arduino.h>
+#include "crc16.h"
+#include "gea_core.h"
+
+/*
+ * Frames encoded at compile time. Plenty of what we send never changes: each board's configuration,
+ * the all-zero power frames, and the version and status requests. geaEncodeFrame() escapes and
+ * CRC-stamps those into constant byte arrays, so they sit in flash and go out with a plain copy.
+ *
+ *   static constexpr auto bytes = geaEncodeFrame(GEN1_ADDR, CMD_GET_SW_VERSION, GeaConstPayload<0>{});
+ *   static constexpr GeaEncodedFrame_t frame = geaEncoded(bytes);
+ *   GeaTransmitFrame(&frame);
+ *
+ * Power frames only vary in their payload, so geaFrameTemplate() works out their header ahead of
+ * time instead, and GeaFrameWriter picks up from there (GeaTxBatch::add()).
+ */
+
+template <uint8_t PayloadLength>
+struct GeaConstPayload {
+  uint8_t data[PayloadLength > 0 ? PayloadLength : 1]; // Zeroed unless given
+};
+
+/*
+ * An encoded frame and its trailing ACK, in a buffer sized for the worst case of every byte being escaped.
+ */
+template <uint8_t PayloadLength>
+struct GeaConstFrame {
+  uint8_t destination;
+  uint8_t command;
+  uint8_t length;
+  uint16_t checksum;
+  uint8_t bytes[GEA_ESCAPED_SIZE(PayloadLength) + 1];
+};
+
+/*
+ * Writes escaped bytes and keeps the CRC like GeaFrameWriter, but in a constant expression. Running
+ * past the end of the buffer is a compile error.
+ */
+template <size_t Capacity>
+struct GeaConstWriter {
+  uint8_t bytes[Capacity];
+  uint8_t length;
+  uint16_t crc;
+
+  constexpr void put(uint8_t value) { bytes[length++] = value; }
+
+  constexpr void putEscaped(uint8_t value) {
+    if (isEscaped(value)) {
+      put(GEA_ESC);
+    }
+    put(value);
+  }
+
+  constexpr void write(uint8_t value) {
+    crc = Crc16ConstProcessByte(crc, value);
+    putEscaped(value);
+  }
+
+  constexpr void begin(uint8_t destination, uint8_t command, uint8_t payloadLength) {
+    length = 0;
+    crc = crc16Seed;
+    put(GEA_SOF);
+    write(destination);
+    write(payloadLength + GEA_OVERHEAD);
+    write(LOCAL_ADDR);
+    write(command);
+  }
+};
+
+template <uint8_t PayloadLength>
+constexpr GeaConstFrame<PayloadLength> geaEncodeFrame(uint8_t destination, uint8_t command, const GeaConstPayload<PayloadLength>& payload) {
+  static_assert(PayloadLength <= GEA_MAX_TX_PAYLOAD_SIZE, "Payload is longer than GEA_MAX_TX_PAYLOAD_SIZE");
+
+  GeaConstWriter<GEA_ESCAPED_SIZE(PayloadLength) + 1> writer = {};
+  writer.begin(destination, command, PayloadLength);
+  for (uint8_t i = 0; i < PayloadLength; i++) {
+    writer.write(payload.data[i]);
+  }
+  uint16_t checksum = writer.crc;
+  writer.putEscaped(checksum >> 8);
+  writer.putEscaped(checksum & 0xFF);
+  writer.put(GEA_EOF);
+  writer.put(GEA_ACK);
+
+  GeaConstFrame<PayloadLength> frame = {};
+  frame.destination = destination;
+  frame.command = command;
+  frame.length = writer.length;
+  frame.checksum = checksum;
+  for (uint8_t i = 0; i < writer.length; i++) {
+    frame.bytes[i] = writer.bytes[i];
+  }
+  return frame;
+}
+
+/*
+ * @brief The view of an encoded frame that GeaTransmitFrame() and geaRequest() take. The frame must have static storage.
+ */
+template <uint8_t PayloadLength>
+constexpr GeaEncodedFrame_t geaEncoded(const GeaConstFrame<PayloadLength>& frame) {
+  return GeaEncodedFrame_t{frame.destination, frame.command, frame.length, frame.checksum, frame.bytes};
+}
+
+constexpr GeaFrameTemplate_t geaFrameTemplate(uint8_t destination, uint8_t command, uint8_t payloadLength) {
+  GeaConstWriter<GEA_ESCAPED_HEADER_SIZE> writer = {};
+  writer.begin(destination, command, payloadLength);
+
+  GeaFrameTemplate_t frame = {};
+  frame.destination = destination;
+  frame.command = command;
+  frame.payloadLength = payloadLength;
+  frame.prefixLength = writer.length;
+  frame.crc = writer.crc;
+  for (uint8_t i = 0; i < writer.length; i++) {
+    frame.prefix[i] = writer.bytes[i];
+  }
+  return frame;
+}
+
+#endif
@@ -3,43 +3,92 @@
 #include "crc16.h"
 #include "utils.h"
 #include "config.h"
+#include "log.h"
+#include "probe.h"
+#include "gea_link.h"
 
-int escapedBytes = 0;
+GeaFrameWriter::GeaFrameWriter(uint8_t* buffer, size_t capacity)
+  : buffer(buffer), capacity(capacity), position(0), crc(Crc16Init()), overflow(false) {
+}
 
 /*
- * @brief Check if a byte needs to be escaped.
+ * @brief Start a new frame: writes the SOF and the header, and seeds the CRC.
  */
-bool isEscaped(uint8_t value) {
-  switch(value) {
-    case GEA_ESC:
-    case GEA_ACK:
-    case GEA_SOF:
-    case GEA_EOF:
-      return true;
-    default:
-      return false;
+void GeaFrameWriter::begin(uint8_t destination, uint8_t command, uint8_t payloadLength, uint8_t source) {
+  position = 0;
+  overflow = false;
+
+  // The CRC covers everything after the SOF. Seeding with crc16Seed here is equivalent to
+  // seeding with 0xe300 and running the SOF through it.
+  crc = Crc16Init();
+
+  put(GEA_SOF);
+  write(destination);
+  write(payloadLength + GEA_OVERHEAD);
+  write(source);
+  write(command);
+}
+
+/*
+ * @brief Start a new frame from a template: copies the escaped SOF and header, and carries on with the CRC from where the
+ * template left it. Only the payload is left to write.
+ */
+void GeaFrameWriter::begin(const GeaFrameTemplate_t& frame) {
+  position = 0;
+  overflow = frame.prefixLength > capacity;
+  if (!overflow) {
+    memcpy(buffer, frame.prefix, frame.prefixLength);
+    position = frame.prefixLength;
   }
+  crc = frame.crc;
 }
 
 /*
- * @brief Returns an escaped version of an unescaped GEA message buffer
+ * @brief Append one unescaped byte to the frame, escaping it if needed.
  */
-char* escapeMessage(char* unescapedMsg, size_t length) {
-  // Set the global variable to zero
-  escapedBytes = 0;
-    
-  // Calculate the maximum possible size of the escaped message
-  size_t escapedLength = length;
-  for (size_t i = 1; i < length - 1; i++) {
-      if (isEscaped(unescapedMsg[i])) {
-          escapedLength++;
-          // Set the global variable, so other functions know how many escaped bytes were found.
-          escapedBytes = escapedLength - length;
-      }
+void GeaFrameWriter::write(uint8_t value) {
+  crc = Crc16ProcessByte(crc, value);
+  putEscaped(value);
+}
+
+void GeaFrameWriter::write(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    write(data[i]);
   }
+}
+
+/*
+ * @brief Append the CRC16 and EOF, then return the escaped length of the frame, or 0 if it did not fit.
+ */
+size_t GeaFrameWriter::end() {
+  uint16_t frameCrc = crc;
+  putEscaped(frameCrc >> 8);
+  putEscaped(frameCrc & 0xFF);
+  put(GEA_EOF);
+
+  return overflow ? 0 : position;
+}
 
-  // Create a new escaped message buffer
-  char* escapedMsg = (char*)malloc(escapedLength * sizeof(char));
+void GeaFrameWriter::put(uint8_t value) {
+  if (position < capacity) {
+    buffer[position++] = value;
+  } else {
+    overflow = true;
+  }
+}
+
+void GeaFrameWriter::putEscaped(uint8_t value) {
+  if (isEscaped(value)) {
+    put(GEA_ESC);
+  }
+  put(value);
+}
+
+/*
+ * @brief Escapes an unescaped GEA message buffer into escapedMsg and returns the escaped length.
+ * escapedMsg must hold at least 2 * length - 2 bytes.
+ */
+size_t escapeMessage(const char* unescapedMsg, size_t length, char* escapedMsg) {
   size_t j = 0;
   // Copy the first byte unchanged
   escapedMsg[j++] = unescapedMsg[0];
@@ -53,224 +102,514 @@ char* escapeMessage(char* unescapedMsg, size_t length) {
   }
 
   // Copy the last byte unchanged
-  escapedMsg[j] = unescapedMsg[length - 1];
+  escapedMsg[j++] = unescapedMsg[length - 1];
 
-  return escapedMsg;
+  return j;
+}
+
+GeaFrameDecoder::GeaFrameDecoder() {
+  reset();
 }
 
 /*
- * Returns an unescaped version of an escaped GEA message buffer.
+ * @brief Drop any partially received frame, all queued frames and the counters.
  */
-char* unescapeMessage(char* escapedMsg) {
-  size_t escapedLength = sizeof(escapedMsg);
-  char* unescapedMsg = (char*)malloc(escapedLength + 1);
+void GeaFrameDecoder::reset() {
+  head = 0;
+  tail = 0;
+  count = 0;
+  state = STATE_IDLE;
+  oversized = false;
+  crc = Crc16Init();
+  memset(&counters, 0, sizeof(counters));
+}
 
-  if (unescapedMsg == NULL) {
-    Serial.println("E: Failed to allocate memory for unescaped RX buffer");
-    return NULL;
+/*
+ * @brief Process one escaped byte from the bus. Returns true if it completed a valid frame.
+ */
+bool GeaFrameDecoder::feed(uint8_t rxByte) {
+  if (state == STATE_ESCAPE) {
+    state = STATE_FRAME;
+    return append(rxByte);
   }
 
-  int unescapedIdx = 0;
-  int escapedIdx = 0;
-
-  while (escapedIdx < escapedLength) {
-    if (escapedMsg[escapedIdx] == GEA_ESC) {
-      escapedIdx++;
-
-      if (escapedIdx >= escapedLength) {
-        Serial.println("E: escapedIdx is out of range. Invalid escape sequence.");
-        free(unescapedMsg);
-        return NULL;
+  switch (rxByte) {
+    case GEA_SOF:
+      if (state == STATE_FRAME) {
+        counters.framingErrors++;
       }
-
-      char escapedByte = escapedMsg[escapedIdx];
-
-      switch (escapedByte) {
-        case GEA_ESC:
-          unescapedMsg[unescapedIdx] = GEA_ESC;
-          break;
-        case GEA_ACK:
-          unescapedMsg[unescapedIdx] = GEA_ACK;
-          break;
-        case GEA_SOF:
-          unescapedMsg[unescapedIdx] = GEA_SOF;
-          break;
-        case GEA_EOF:
-          unescapedMsg[unescapedIdx] = GEA_EOF;
-          break;
-        default:
-          Serial.println("switch(escapedByte) defaulted. Invalid escape sequence.");
-          free(unescapedMsg);
-          return NULL;
+      state = STATE_FRAME;
+      oversized = false;
+      frames[tail].length = 0;
+      frames[tail].data[frames[tail].length++] = GEA_SOF;
+      crc = Crc16Init();
+      return false;
+    case GEA_EOF:
+      if (state != STATE_FRAME) {
+        return false;
       }
-    } else {
-      unescapedMsg[unescapedIdx] = escapedMsg[escapedIdx];
-    }
-    unescapedIdx++;
-    escapedIdx++;
+      state = STATE_IDLE;
+      return complete();
+    case GEA_ESC:
+      if (state == STATE_FRAME) {
+        state = STATE_ESCAPE;
+      }
+      return false;
+    case GEA_ACK:
+      if (state == STATE_FRAME) {
+        // An unescaped ACK can't be part of a frame
+        counters.framingErrors++;
+        state = STATE_IDLE;
+      } else {
+        counters.acks++;
+      }
+      return false;
+    default:
+      if (state == STATE_FRAME) {
+        return append(rxByte);
+      }
+      return false;
   }
-  unescapedMsg[unescapedIdx] = '\0';
-  return unescapedMsg;
 }
 
 /*
- * @brief Reads a GEA message from the serial bus if it is available, then stores it into a buffer for further processing.
+ * @brief Drain every byte the transport has buffered. Returns the number of frames completed.
  */
-void GeaReceiveMessage(char* rxBufferEscaped, int rxBufferSize) {
-  int idx = 0;
-  int escapeFlag = 0;
-
-  if (Serial1.available()) {
-    char rxByte = Serial1.read();
-
-    switch (rxByte) {
-      case GEA_SOF:
-        idx = 0;
-        escapeFlag = 0;
-        break;
-      case GEA_EOF:
-        rxBufferEscaped[idx] = '\0';
-        idx = 0;
-        break;
-      case GEA_ESC:
-        escapeFlag = 1;
-        break;
-      default:
-        if (idx < rxBufferSize - 1) {
-          if (escapeFlag) {
-            rxByte ^= 0x20;
-            escapeFlag = 0;
-          }
-          rxBufferEscaped[idx++] = rxByte;
-        }
+int GeaFrameDecoder::poll(GeaTransport& transport) {
+  int completed = 0;
+
+  while (transport.available() > 0) {
+    if (feed(transport.read())) {
+      completed++;
     }
   }
+
+  return completed;
 }
 
 /*
- * Builds a GEA message frame given the destination, command, payload buffer, and payload length, then transmits it over the serial bus.
+ * @brief Release the oldest queued frame.
  */
-int GeaTransmitMessage(byte dst, byte cmd, char* payload, int payloadLength) {
-  int msgBufLength = payloadLength + GEA_OVERHEAD;
-  char* message = (char*)malloc(msgBufLength);
+void GeaFrameDecoder::pop() {
+  if (count > 0) {
+    head = (head + 1) % (GEA_RX_QUEUE_DEPTH + 1);
+    count--;
+  }
+}
 
-  if (message == NULL) {
-    Serial.println("E: Failed to allocate memory for TX buffer");
-    return NULL;
+bool GeaFrameDecoder::append(uint8_t value) {
+  GeaFrame_t* frame = &frames[tail];
+
+  // Leave room for the EOF. An oversized frame is still followed to its end, so its bytes aren't taken for anything else.
+  if (frame->length >= GEA_MAX_RX_FRAME_SIZE - 1) {
+    oversized = true;
+    return false;
   }
 
-  message[0] = GEA_SOF;
-  message[1] = dst;
-  message[2] = msgBufLength;
-  message[3] = LOCAL_ADDR;
-  message[4] = cmd;
+  frame->data[frame->length++] = value;
+  crc = Crc16ProcessByte(crc, value);
+  return false;
+}
+
+/*
+ * @brief Validate the frame being assembled and queue it.
+ */
+bool GeaFrameDecoder::complete() {
+  GeaFrame_t* frame = &frames[tail];
 
-  // Copy payload data
-  int i;
-  for (i=0; i<payloadLength; i++) {
-    message[5+i] = payload[i];
+  if (oversized) {
+    counters.oversized++;
+    return false;
   }
 
-  // Calculate CRC16
-  uint16_t crc16 = CalculateCrc16(message, payloadLength + 5);
-  message[5+payloadLength] = crc16 >> 8;
-  message[5+payloadLength+1] = crc16 & 0xFF;
+  frame->data[frame->length++] = GEA_EOF;
 
-  // Append EOF byte
-  message[5+payloadLength+2] = GEA_EOF;
+  if (frame->length < GEA_OVERHEAD || frame->data[2] != frame->length) {
+    counters.framingErrors++;
+    return false;
+  }
 
-  // Escape the message and transmit it
-  char* escapedMessage = escapeMessage(message, msgBufLength);
-#ifdef __DEBUG__
-  Serial.print("D: GEA TX: ");
-  printHexByteArray(escapedMessage, msgBufLength + escapedBytes);
-#endif
-  Serial1.write(escapedMessage, msgBufLength + escapedBytes);
-  Serial1.write(GEA_ACK);
+  // Running the transmitted CRC through the CRC leaves a zero remainder
+  if (crc != 0) {
+    counters.crcErrors++;
+    return false;
+  }
 
-  free(message);
+  if (count == GEA_RX_QUEUE_DEPTH) {
+    counters.overruns++;
+    return false;
+  }
 
-  return 0;
+  tail = (tail + 1) % (GEA_RX_QUEUE_DEPTH + 1);
+  count++;
+  counters.frames++;
+  return true;
+}
+
+GeaBus_t geaBuses[GEA_BUS_COUNT];
+
+// Which bus each routed address is on. Unused entries have address 0.
+static uint8_t routeAddress[GEA_MAX_ROUTES];
+static uint8_t routeBus[GEA_MAX_ROUTES];
+
+/*
+ * @brief Attach a bus to the transport it's reached through. Call for every bus before anything is sent.
+ */
+void geaBusBegin(uint8_t bus, GeaTransport* transport) {
+  if (bus >= GEA_BUS_COUNT) {
+    return;
+  }
+  geaBuses[bus].transport = transport;
+  geaBuses[bus].decoder.reset();
+  geaBuses[bus].queue.reset();
+  geaBuses[bus].batch.bus = bus;
 }
 
-GeaMessage_t GeaValidateAndParseReceivedMessage(char* rxBuffer, size_t rxBufferSize) {
-  GeaMessage_t msg;
-  msg.payload = NULL;
+/*
+ * @brief Send everything for a board address on the given bus from now on. Returns false if the bus doesn't exist or
+ * the route table is full.
+ */
+bool geaRoute(uint8_t address, uint8_t bus) {
+  if (bus >= GEA_BUS_COUNT) {
+    return false;
+  }
+  for (int i = 0; i < GEA_MAX_ROUTES; i++) {
+    if (routeAddress[i] == address || routeAddress[i] == 0) {
+      routeAddress[i] = address;
+      routeBus[i] = bus;
+      return true;
+    }
+  }
+  return false;
+}
 
-  char* rxBufferUnescaped = unescapeMessage(rxBuffer);
+uint8_t geaBusFor(uint8_t address) {
+  for (int i = 0; i < GEA_MAX_ROUTES && routeAddress[i] != 0; i++) {
+    if (routeAddress[i] == address) {
+      return routeBus[i];
+    }
+  }
+  return 0;
+}
 
-  // Check the SOF
-  if (rxBufferUnescaped[0] != GEA_SOF) {
-    Serial.println("E: Invalid GEA message: Invalid STX received");
-    return msg;
+/*
+ * @brief Reads all available bytes from one GEA bus into its decoder. Returns the number of frames completed.
+ * Each byte is checked against the echo of what we sent first, and bare ACKs that aren't our own echo are passed to the link.
+ */
+int GeaReceiveMessage(uint8_t bus) {
+  GeaTransport* transport = geaBuses[bus].transport;
+  GeaFrameDecoder& decoder = geaBuses[bus].decoder;
+  int completed = 0;
+
+  while (transport->available() > 0) {
+    uint8_t rxByte = transport->read();
+    bool echo = geaLinkEcho(bus, rxByte);
+    uint32_t acks = decoder.stats().acks;
+
+    if (decoder.feed(rxByte)) {
+      completed++;
+    }
+    if (!echo && decoder.stats().acks != acks) {
+      geaLinkAck(bus);
+    }
   }
 
-  msg.destination = rxBufferUnescaped[1];
-  msg.length = rxBufferUnescaped[2];
-  msg.source = rxBufferUnescaped[3];
-  msg.command = rxBufferUnescaped[4];
+  return completed;
+}
+
+// Queued frames are built here, with room for the trailing ACK. It's copied into the UART straight away, so the buses can share it.
+static uint8_t txBuffer[GEA_MAX_TX_WIRE_SIZE];
 
-  // Validate the length
-  size_t expectedLength = msg.length;
-  if (rxBufferSize != expectedLength) {
-    Serial.println("E: Invalid GEA message: Length mismatch.");
-    return msg;
+static GeaTxClassStats_t txStats[GEA_PRIORITY_COUNT];
+static GeaTxClassStats_t burstStats;
+
+static_assert(sizeof(geaBuses) + sizeof(routeAddress) + sizeof(routeBus) + sizeof(txBuffer) + sizeof(txStats) + sizeof(burstStats)
+              <= RAM_BUDGET_GEA_CORE, "GEA codec buffers are over their RAM budget (config.h)");
+
+static void noteSent(GeaTxClassStats_t* stats, uint32_t waitMicros) {
+  stats->sent++;
+  if ((int32_t)waitMicros > (int32_t)stats->maxWaitMicros) {
+    stats->maxWaitMicros = waitMicros;
   }
+}
+
+GeaTxBatch::GeaTxBatch() : bus(0), length(0), sent(0), frameCount(0), lastDst(0) {
+}
+
+/*
+ * @brief Start a new batch. Don't call this while the last one is still busy().
+ */
+void GeaTxBatch::begin() {
+  length = 0;
+  sent = 0;
+  frameCount = 0;
+}
 
-  // Validate the CRC16
-  uint16_t expectedCrc16 = (rxBufferUnescaped[rxBufferSize - 3] << 8) | rxBufferUnescaped[rxBufferSize - 2];
-  uint16_t calculatedCrc16 = CalculateCrc16(rxBufferUnescaped, rxBufferSize - 3);
-  if (expectedCrc16 != calculatedCrc16) {
-    Serial.println("E: Invalid GEA message: Checksum mismatch.");
-    return msg;
+/*
+ * @brief Append a frame and its trailing ACK. Returns false, leaving the batch as it was, if it doesn't fit.
+ */
+bool GeaTxBatch::add(uint8_t destination, uint8_t command, const uint8_t* payload, uint8_t payloadLength) {
+  GeaFrameWriter writer(buffer + length, sizeof(buffer) - length);
+  writer.begin(destination, command, payloadLength);
+  writer.write(payload, payloadLength);
+  return commit(writer, destination, command);
+}
+
+/*
+ * @brief Append a frame built from a template, which saves escaping the header and running it through the CRC.
+ * payload must hold the template's payloadLength bytes.
+ */
+bool GeaTxBatch::add(const GeaFrameTemplate_t& frame, const uint8_t* payload) {
+  GeaFrameWriter writer(buffer + length, sizeof(buffer) - length);
+  writer.begin(frame);
+  writer.write(payload, frame.payloadLength);
+  return commit(writer, frame.destination, frame.command);
+}
+
+/*
+ * @brief Finish the frame being written at the end of the batch, and its trailing ACK.
+ */
+bool GeaTxBatch::commit(GeaFrameWriter& writer, uint8_t destination, uint8_t command) {
+  size_t frameLength = writer.end();
+
+  if (frameLength == 0 || length + frameLength + 1 > sizeof(buffer)) {
+    LOG_E(EVT_GEA_TX_TOO_LARGE);
+    return false;
   }
 
-  // Check the ETX
-  if (rxBufferUnescaped[rxBufferSize - 1] != GEA_EOF) {
-    Serial.println("E: Invalid GEA message: ETX not found or unexpected EOF.");
-    return msg;
+  LOG_D(EVT_GEA_TX, destination, command, frameLength, writer.checksum());
+  buffer[length + frameLength] = GEA_ACK;
+  // Frames go out in the order they're added, which is the order the link expects their echoes and ACKs
+  uint32_t addedMicros = micros();
+  uint32_t waitMicros = geaLinkTrack(bus, destination, command, buffer + length, frameLength + 1, GEA_LINK_MAX_RETRIES) - addedMicros;
+  noteSent(&burstStats, waitMicros);
+  if (waitMicros > GEA_TX_POWER_MAX_WAIT_BYTES * GEA_BYTE_MICROS) {
+    LOG_E(EVT_GEA_TX_LATE, destination, command, waitMicros, GEA_TX_POWER_MAX_WAIT_BYTES * GEA_BYTE_MICROS);
   }
+  length += frameLength + 1;
+  frameCount++;
+  lastDst = destination;
+  return true;
+}
 
-  // Calculate the length of the payload.
-  size_t payloadLength = msg.length - GEA_OVERHEAD;
+/*
+ * @brief Hand the batch to the transport. Only blocks if the UART's TX buffer is too small for the batch
+ * and service() is never called.
+ */
+void GeaTxBatch::send(GeaTransport& transport) {
+  sent = 0;
+  service(transport);
+}
 
-  // Allocate memory for the payload struct member.
-  msg.payload = (uint8_t*)realloc(msg.payload, payloadLength * sizeof(uint8_t));
-  if (msg.payload == NULL) {
-    Serial.println("E: Failed to allocate memory for GEA message payload.");
-    return msg;
+/*
+ * @brief Write as much of the batch as the UART's TX buffer has room for. Returns true once it has all been handed over.
+ */
+bool GeaTxBatch::service(GeaTransport& transport) {
+  if (!busy()) {
+    return true;
   }
 
-  // Copy payload data from unescaped message buffer;
-  memcpy(msg.payload, rxBufferUnescaped + 5, payloadLength);
+  size_t room = transport.availableForWrite();
+  size_t chunk = min(room, length - sent);
+  if (chunk > 0) {
+    transport.write(buffer + sent, chunk);
+    if (sent == 0) {
+      PROBE_TX_FIRST_BYTE(bus);
+    }
+    sent += chunk;
+    if (!busy()) {
+      PROBE_TX_LAST_BYTE(bus);
+    }
+  }
 
-  return msg;
+  return !busy();
 }
 
-void GeaUnallocatePayloadMemory(GeaMessage_t* msg) {
-  free(msg->payload);
-  msg->payload = NULL;
+GeaTxQueue::GeaTxQueue() {
+  reset();
+}
+
+/*
+ * @brief Drop everything queued.
+ */
+void GeaTxQueue::reset() {
+  count = 0;
+  // order always holds every slot index: the queued ones in send order, then the free ones
+  for (uint8_t i = 0; i < GEA_TX_QUEUE_DEPTH; i++) {
+    order[i] = i;
+  }
 }
 
-char* GeaReceivePayload(uint8_t sourceAddress, uint8_t command) {
-  char rxBufferEscaped[GEA_RXBUF_SIZE];
-  
-  GeaReceiveMessage(rxBufferEscaped, GEA_RXBUF_SIZE);
-  
-  char* rxBufferUnescaped = unescapeMessage(rxBufferEscaped);
+/*
+ * @brief Queue a frame, or fold it into one to the same board with the same command that hasn't gone out yet. Returns
+ * false if the queue is full of frames at least as urgent.
+ */
+bool GeaTxQueue::push(uint8_t destination, uint8_t command, const uint8_t* payload, uint8_t payloadLength, GeaPriority priority,
+                      uint8_t retries) {
+  GeaQueuedFrame_t* queued = claim(destination, command, priority, retries);
+  if (queued == NULL) {
+    return false;
+  }
 
-  uint8_t messageLength = rxBufferUnescaped[2];
+  queued->encoded = NULL;
+  queued->payloadLength = payloadLength;
+  memcpy(queued->payload, payload, payloadLength);
+  return true;
+}
 
-  GeaMessage_t msg = GeaValidateAndParseReceivedMessage(rxBufferUnescaped, rxBufferUnescaped[2]);
-  int payloadLength = msg.length - GEA_OVERHEAD;
-  char payload[payloadLength];
+/*
+ * @brief Queue a frame encoded at compile time. Only the pointer is kept, so the frame must stay put, as it does in flash.
+ */
+bool GeaTxQueue::push(const GeaEncodedFrame_t* frame, GeaPriority priority, uint8_t retries) {
+  GeaQueuedFrame_t* queued = claim(frame->destination, frame->command, priority, retries);
+  if (queued == NULL) {
+    return false;
+  }
+
+  queued->encoded = frame;
+  return true;
+}
 
-  if (msg.source == sourceAddress && msg.command == command) {
-    for (int i = 0; i < payloadLength; i++) {
-      payload[i] = msg.payload[i];
+/*
+ * @brief Find the queued frame a new one to the same board with the same command replaces, or give the new one a slot in
+ * line. Returns NULL if the queue is full of frames at least as urgent.
+ */
+GeaQueuedFrame_t* GeaTxQueue::claim(uint8_t destination, uint8_t command, GeaPriority priority, uint8_t retries) {
+  for (uint8_t i = 0; i < count; i++) {
+    GeaQueuedFrame_t* queued = &slots[order[i]];
+    if (queued->destination == destination && queued->command == command && queued->priority == priority) {
+      // Keeps its place in line, so a frame that keeps being replaced still goes out
+      txStats[priority].coalesced++;
+      queued->retries = retries;
+      return queued;
     }
+  }
+
+  // Behind everything at least as urgent
+  uint8_t position = count;
+  while (position > 0 && slots[order[position - 1]].priority > priority) {
+    position--;
+  }
+
+  if (count == GEA_TX_QUEUE_DEPTH) {
+    // The last in line is the newest of the least urgent class
+    GeaQueuedFrame_t* last = &slots[order[count - 1]];
+    if (position == count) {
+      txStats[priority].dropped++;
+      LOG_E(EVT_GEA_TX_QUEUE_FULL, destination, command);
+      return NULL;
+    }
+    txStats[last->priority].dropped++;
+    LOG_E(EVT_GEA_TX_QUEUE_FULL, last->destination, last->command);
+    count--;
+  }
+
+  uint8_t slot = order[count];
+  memmove(&order[position + 1], &order[position], count - position);
+  order[position] = slot;
+  count++;
+
+  GeaQueuedFrame_t* queued = &slots[slot];
+  queued->destination = destination;
+  queued->command = command;
+  queued->priority = priority;
+  queued->retries = retries;
+  queued->queuedMicros = micros();
+  return queued;
+}
+
+/*
+ * @brief Release the frame at the front of the line.
+ */
+void GeaTxQueue::pop() {
+  if (count > 0) {
+    uint8_t slot = order[0];
+    memmove(&order[0], &order[1], count - 1);
+    order[--count] = slot;
+  }
+}
+
+/*
+ * @brief Move one bus's traffic along: keep feeding its burst to the UART, then once the wire is quiet, send the most
+ * urgent queued frame. Queued frames go out one at a time, so a power burst never waits behind more than one of them.
+ */
+static void serviceBus(uint8_t index) {
+  GeaBus_t* bus = &geaBuses[index];
+  if (!bus->batch.service(*bus->transport) || !geaLinkWireIdle(index)) {
+    return;
+  }
+
+  const GeaQueuedFrame_t* queued = bus->queue.peek();
+  if (queued == NULL) {
+    return;
+  }
+
+  const uint8_t* bytes = txBuffer;
+  size_t length;
+  if (queued->encoded != NULL) {
+    bytes = queued->encoded->bytes;
+    length = queued->encoded->length;
+    LOG_D(EVT_GEA_TX, queued->destination, queued->command, length - 1, queued->encoded->checksum);
+  } else {
+    GeaFrameWriter writer(txBuffer, sizeof(txBuffer) - 1);
+    writer.begin(queued->destination, queued->command, queued->payloadLength);
+    writer.write(queued->payload, queued->payloadLength);
+    length = writer.end();
+    LOG_D(EVT_GEA_TX, queued->destination, queued->command, length, writer.checksum());
+    txBuffer[length++] = GEA_ACK;
+  }
+
+  uint32_t startMicros = geaLinkTrack(index, queued->destination, queued->command, bytes, length, queued->retries);
+  bus->transport->write(bytes, length);
 
-    GeaUnallocatePayloadMemory(&msg);
-    return payload;
+  noteSent(&txStats[queued->priority], startMicros - queued->queuedMicros);
+  bus->queue.pop();
+}
+
+/*
+ * @brief Keep feeding the batches in progress to their UARTs, and send queued frames as the wire frees up. Call this often,
+ * e.g. whenever the RX FIFOs are polled.
+ */
+void GeaServiceTransmit() {
+  for (int i = 0; i < GEA_BUS_COUNT; i++) {
+    serviceBus(i);
+  }
+}
+
+/*
+ * Queues a GEA message frame given the destination, command, payload buffer, and payload length on the destination's bus.
+ * It goes out right away if the wire is quiet and nothing more urgent is waiting, or later from GeaServiceTransmit().
+ */
+int GeaTransmitMessage(byte dst, byte cmd, char* payload, int payloadLength, GeaPriority priority, uint8_t retries) {
+  if (payloadLength < 0 || payloadLength > GEA_MAX_TX_PAYLOAD_SIZE) {
+    LOG_E(EVT_GEA_TX_TOO_LARGE);
+    return -1;
+  }
+
+  uint8_t bus = geaBusFor(dst);
+  if (!geaBuses[bus].queue.push(dst, cmd, (const uint8_t*)payload, payloadLength, priority, retries)) {
+    return -1;
   }
+
+  serviceBus(bus);
+  return 0;
+}
+
+int GeaTransmitFrame(const GeaEncodedFrame_t* frame, GeaPriority priority, uint8_t retries) {
+  uint8_t bus = geaBusFor(frame->destination);
+  if (!geaBuses[bus].queue.push(frame, priority, retries)) {
+    return -1;
+  }
+
+  serviceBus(bus);
+  return 0;
+}
+
+const GeaTxClassStats_t* geaTxStats(GeaPriority priority) {
+  return &txStats[priority];
+}
+
+// Power frames and anything else sent in a burst (GeaTxBatch)
+const GeaTxClassStats_t* geaTxBurstStats() {
+  return &burstStats;
 }
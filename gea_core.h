@@ -2,13 +2,57 @@
 #define __GEA_CORE_H__
 
 #include <Arduino.h>
-
-extern int escapedBytes;
+#include "config.h"
+#include "gea_transport.h"
 
 #define GEA_OVERHEAD 0x08
 #define LOCAL_ADDR 0x87
-#define GEA_RXBUF_SIZE 300
 #define GEA_MAX_PAYLOAD_SIZE (0xFF - GEA_OVERHEAD)
+#define GEA_MAX_FRAME_SIZE (GEA_MAX_PAYLOAD_SIZE + GEA_OVERHEAD)
+#define GEA_RX_QUEUE_DEPTH 4
+#define GEA_RX_TIMEOUT_MS 100
+
+/*
+ * Our own frames are far shorter than the protocol allows, so the buffers are sized for what we
+ * actually send and receive. A received frame with more than GEA_MAX_RX_PAYLOAD_SIZE bytes of
+ * payload is skipped and counted as oversized. generator_board.h checks every board response
+ * against this.
+ */
+#define GEA_MAX_RX_PAYLOAD_SIZE 32
+#define GEA_MAX_TX_PAYLOAD_SIZE 32
+#define GEA_MAX_RX_FRAME_SIZE (GEA_MAX_RX_PAYLOAD_SIZE + GEA_OVERHEAD)
+
+// Room for one short frame (plus its trailing ACK) per board, even with every byte escaped
+#define GEA_TX_BATCH_SIZE 96
+
+// Frames waiting for the wire, per bus, across all priorities
+#define GEA_TX_QUEUE_DEPTH 4
+
+/*
+ * Worst case size of an escaped frame: everything between SOF and EOF needs an escape byte.
+ */
+#define GEA_ESCAPED_SIZE(payloadLength) (2 * ((payloadLength) + GEA_OVERHEAD) - 2)
+#define GEA_MAX_ESCAPED_FRAME_SIZE GEA_ESCAPED_SIZE(GEA_MAX_PAYLOAD_SIZE)
+// The longest thing we ever put on the wire in one go outside a burst: a full frame and its trailing ACK
+#define GEA_MAX_TX_WIRE_SIZE (GEA_ESCAPED_SIZE(GEA_MAX_TX_PAYLOAD_SIZE) + 1)
+
+// Wire time of one byte: start bit, 8 data bits, stop bit
+#define GEA_BYTE_MICROS ((10UL * 1000000UL + GEA_BAUD_RATE - 1) / GEA_BAUD_RATE)
+
+/*
+ * Worst case wait, in byte-times, from a power frame being added to a burst until its first byte goes
+ * out. Queued frames and retries are only let out once the wire is quiet, and a new burst only starts
+ * once the last one is all in the UART, so at most one of those or the tail of the last burst is still
+ * going out ahead of it. After that come the frames ahead of it in its own burst.
+ */
+#define GEA_TX_POWER_MAX_WAIT_BYTES (GEA_MAX_TX_WIRE_SIZE + GEA_TX_BATCH_SIZE)
+
+#ifdef SERIAL_TX_BUFFER_SIZE
+static_assert(SERIAL_TX_BUFFER_SIZE + 1 <= GEA_MAX_TX_WIRE_SIZE, "The tail of a burst in the UART can outlast a queued frame");
+#endif
+
+static_assert(GEA_MAX_RX_PAYLOAD_SIZE <= GEA_MAX_PAYLOAD_SIZE && GEA_MAX_TX_PAYLOAD_SIZE <= GEA_MAX_PAYLOAD_SIZE,
+              "Buffer payload sizes can't exceed what a GEA frame can carry");
 
 typedef enum {
   GEA_ESC = 0xe0, // Escape
@@ -17,24 +61,300 @@ typedef enum {
   GEA_EOF = 0xe3 // End of frame
 } GeaHeaderBytes;
 
-/* 
- * Data structure of a basic GEA packet header
+/*
+ * @brief Check if a byte needs to be escaped.
+ */
+constexpr bool isEscaped(uint8_t value) {
+  switch(value) {
+    case GEA_ESC:
+    case GEA_ACK:
+    case GEA_SOF:
+    case GEA_EOF:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// The SOF and the four header bytes, escaped
+#define GEA_ESCAPED_HEADER_SIZE 9
+
+/*
+ * A frame whose destination, command and payload length are fixed, with everything up to the payload
+ * worked out ahead of time: the escaped SOF and header, and the CRC over them. GeaFrameWriter picks up
+ * from there, so only the payload still has to go through the CRC. Built at compile time by
+ * geaFrameTemplate() (gea_const_frame.h).
+ */
+typedef struct {
+  uint8_t destination;
+  uint8_t command;
+  uint8_t payloadLength;
+  uint8_t prefixLength;
+  uint16_t crc;
+  uint8_t prefix[GEA_ESCAPED_HEADER_SIZE];
+} GeaFrameTemplate_t;
+
+/*
+ * A whole frame encoded at compile time (gea_const_frame.h): escaped and CRC-stamped, with its trailing
+ * ACK, exactly as it goes on the wire. bytes points into flash.
  */
 typedef struct {
   uint8_t destination;
+  uint8_t command;
+  uint8_t length;
+  uint16_t checksum;
+  const uint8_t* bytes;
+} GeaEncodedFrame_t;
+
+/*
+ * Builds an escaped GEA frame in a single pass into a caller-provided buffer.
+ * The CRC16 is updated as each byte is written, so no intermediate unescaped copy is needed.
+ */
+class GeaFrameWriter {
+  public:
+    GeaFrameWriter(uint8_t* buffer, size_t capacity);
+
+    void begin(uint8_t destination, uint8_t command, uint8_t payloadLength, uint8_t source = LOCAL_ADDR);
+    void begin(const GeaFrameTemplate_t& frame);
+    void write(uint8_t value);
+    void write(const uint8_t* data, size_t length);
+    size_t end();
+
+    const uint8_t* data() const { return buffer; }
+    size_t length() const { return position; }
+    bool overflowed() const { return overflow; }
+    uint16_t checksum() const { return crc; }
+
+  private:
+    void put(uint8_t value);
+    void putEscaped(uint8_t value);
+
+    uint8_t* buffer;
+    size_t capacity;
+    size_t position;
+    uint16_t crc;
+    bool overflow;
+};
+
+/*
+ * A received, CRC-checked and unescaped GEA frame, SOF through EOF.
+ */
+typedef struct {
+  uint8_t length;
+  uint8_t data[GEA_MAX_RX_FRAME_SIZE];
+} GeaFrame_t;
+
+inline uint8_t GeaFrameDestination(const GeaFrame_t* frame) { return frame->data[1]; }
+inline uint8_t GeaFrameSource(const GeaFrame_t* frame) { return frame->data[3]; }
+inline uint8_t GeaFrameCommand(const GeaFrame_t* frame) { return frame->data[4]; }
+inline const uint8_t* GeaFramePayload(const GeaFrame_t* frame) { return frame->data + 5; }
+inline uint8_t GeaFramePayloadLength(const GeaFrame_t* frame) { return frame->length - GEA_OVERHEAD; }
+
+/*
+ * A read-only run of bytes inside someone else's buffer.
+ */
+typedef struct {
+  const uint8_t* data;
   uint8_t length;
-  uint8_t source;
+} GeaSpan_t;
+
+/*
+ * Non-owning view of a received frame. It points straight into the decoder's frame storage, so
+ * it's free to make and copy, and only valid until that frame is popped from the queue.
+ */
+class GeaMessageView {
+  public:
+    GeaMessageView() : frame(NULL) {}
+    explicit GeaMessageView(const GeaFrame_t* frame) : frame(frame) {}
+
+    bool valid() const { return frame != NULL; }
+    uint8_t destination() const { return GeaFrameDestination(frame); }
+    uint8_t source() const { return GeaFrameSource(frame); }
+    uint8_t command() const { return GeaFrameCommand(frame); }
+    const uint8_t* payloadData() const { return GeaFramePayload(frame); }
+    uint8_t payloadLength() const { return GeaFramePayloadLength(frame); }
+    GeaSpan_t payload() const { return GeaSpan_t{GeaFramePayload(frame), GeaFramePayloadLength(frame)}; }
+
+  private:
+    const GeaFrame_t* frame;
+};
+
+/*
+ * Receive error and traffic counters kept by the frame decoder.
+ */
+typedef struct {
+  uint32_t frames;
+  uint32_t acks;
+  uint32_t crcErrors;
+  uint32_t framingErrors;
+  uint32_t overruns;
+  uint32_t oversized; //  Longer than GEA_MAX_RX_PAYLOAD_SIZE, skipped
+} GeaDecoderStats_t;
+
+/*
+ * Incremental GEA frame decoder. Bytes can be fed in as they arrive from the UART; the decoder
+ * keeps its state between calls, unescapes and checks the CRC on the fly, and queues each frame
+ * as soon as its EOF is seen.
+ */
+class GeaFrameDecoder {
+  public:
+    GeaFrameDecoder();
+
+    void reset();
+    bool feed(uint8_t rxByte);
+    int poll(GeaTransport& transport);
+
+    bool available() const { return count > 0; }
+    // Partway through a frame, so the next byte belongs to it
+    bool receiving() const { return state != STATE_IDLE; }
+    const GeaFrame_t* peek() const { return count > 0 ? &frames[head] : NULL; }
+    void pop();
+
+    const GeaDecoderStats_t& stats() const { return counters; }
+
+  private:
+    typedef enum {
+      STATE_IDLE,
+      STATE_FRAME,
+      STATE_ESCAPE
+    } DecoderState;
+
+    bool append(uint8_t value);
+    bool complete();
+
+    GeaFrame_t frames[GEA_RX_QUEUE_DEPTH + 1];
+    uint8_t head;
+    uint8_t tail;
+    uint8_t count;
+    DecoderState state;
+    bool oversized; // The frame being received didn't fit, so the rest of it is only being skipped
+    uint16_t crc;
+    GeaDecoderStats_t counters;
+};
+
+/*
+ * Several frames assembled back to back in one buffer, so they go out as a single burst. send()
+ * hands the UART as much as fits in its TX buffer without blocking, and service() feeds it the
+ * rest as room frees up. The UART driver moves the bytes out from its TX-empty interrupt, so the
+ * CPU is free while the bus is busy.
+ */
+class GeaTxBatch {
+  public:
+    GeaTxBatch();
+
+    void begin();
+    bool add(uint8_t destination, uint8_t command, const uint8_t* payload, uint8_t payloadLength);
+    bool add(const GeaFrameTemplate_t& frame, const uint8_t* payload);
+    void send(GeaTransport& transport);
+    bool service(GeaTransport& transport);
+
+    bool busy() const { return sent < length; }
+    uint8_t frames() const { return frameCount; }
+    size_t size() const { return length; }
+    uint8_t lastDestination() const { return lastDst; }
+
+    // Which bus the batch goes out on, so the link layer knows where to expect each frame's echo and ACK
+    uint8_t bus;
+
+  private:
+    bool commit(GeaFrameWriter& writer, uint8_t destination, uint8_t command);
+
+    uint8_t buffer[GEA_TX_BATCH_SIZE];
+    size_t length;
+    size_t sent;
+    uint8_t frameCount;
+    uint8_t lastDst;
+};
+
+/*
+ * Frames sent one at a time are queued by priority. When the wire is quiet, the most urgent class goes
+ * first, and frames in the same class go in the order they were queued.
+ */
+typedef enum {
+  GEA_PRIORITY_CONTROL, //    Power levels and board configuration
+  GEA_PRIORITY_TELEMETRY, //  Status polling
+  GEA_PRIORITY_DIAGNOSTIC, // Version queries and anything else that can wait
+  GEA_PRIORITY_COUNT
+} GeaPriority;
+
+typedef struct {
+  uint8_t destination;
   uint8_t command;
-  uint8_t* payload;
-} GeaMessage_t;
-
-bool isEscaped(uint8_t value);
-char* escapeMessage(char* unescapedMsg, size_t length);
-char* unescapeMessage(char* escapedMsg);
-void GeaReceiveMessage(char* rxBufferEscaped, int rxBufferSize);
-int GeaTransmitMessage(byte dst, byte cmd, char* payload, int payloadLength);
-GeaMessage_t GeaValidateAndParseReceivedMessage(char* rxBuffer, size_t rxBufSize);
-void GeaUnallocatePayloadMemory(GeaMessage_t* msg);
-char* GeaReceivePayload(uint8_t sourceAddress, uint8_t command);
+  uint8_t priority;
+  uint8_t payloadLength;
+  uint8_t retries; //                Link retries it gets (gea_link.h)
+  uint32_t queuedMicros;
+  const GeaEncodedFrame_t* encoded; // Sent as is if set, otherwise the frame is built from payload when it goes out
+  uint8_t payload[GEA_MAX_TX_PAYLOAD_SIZE];
+} GeaQueuedFrame_t;
+
+/*
+ * Traffic counters for one priority class, summed over every bus.
+ */
+typedef struct {
+  uint32_t sent;
+  uint32_t coalesced; //      Folded into a frame to the same board with the same command that hadn't gone out yet
+  uint32_t dropped; //        Queue full, or pushed out to make room for a more urgent frame
+  uint32_t maxWaitMicros; //  Longest wait from being queued until the first byte went out
+} GeaTxClassStats_t;
+
+/*
+ * A bounded queue of unescaped frames, kept in send order. A frame to the same board with the same
+ * command as one still waiting takes that one's place with its own payload, so a burst of requests
+ * costs one frame on the wire. When the queue is full, a frame pushes out the newest frame of a less
+ * urgent class, or is dropped if there isn't one.
+ */
+class GeaTxQueue {
+  public:
+    GeaTxQueue();
+
+    void reset();
+    bool push(uint8_t destination, uint8_t command, const uint8_t* payload, uint8_t payloadLength, GeaPriority priority,
+              uint8_t retries = GEA_LINK_MAX_RETRIES);
+    bool push(const GeaEncodedFrame_t* frame, GeaPriority priority, uint8_t retries = GEA_LINK_MAX_RETRIES);
+    const GeaQueuedFrame_t* peek() const { return count > 0 ? &slots[order[0]] : NULL; }
+    void pop();
+
+    uint8_t size() const { return count; }
+
+  private:
+    GeaQueuedFrame_t* claim(uint8_t destination, uint8_t command, GeaPriority priority, uint8_t retries);
+
+    GeaQueuedFrame_t slots[GEA_TX_QUEUE_DEPTH];
+    uint8_t order[GEA_TX_QUEUE_DEPTH]; // Slot indexes, next to go out first
+    uint8_t count;
+};
+
+/*
+ * One GEA bus: the transport it's reached through, and its own decoder, TX batch and TX queue. Boards can be
+ * spread over up to GEA_BUS_COUNT buses (config.h), which run side by side, so a power update takes
+ * as long as the busiest bus rather than all boards back to back. Frames to a board go out on the bus
+ * geaRoute() put it on, or bus 0 if it was never routed.
+ */
+typedef struct {
+  GeaTransport* transport;
+  GeaFrameDecoder decoder;
+  GeaTxBatch batch;
+  GeaTxQueue queue;
+} GeaBus_t;
+
+#define GEA_MAX_ROUTES 4
+
+extern GeaBus_t geaBuses[GEA_BUS_COUNT];
+
+void geaBusBegin(uint8_t bus, GeaTransport* transport);
+bool geaRoute(uint8_t address, uint8_t bus);
+uint8_t geaBusFor(uint8_t address);
+
+size_t escapeMessage(const char* unescapedMsg, size_t length, char* escapedMsg);
+int GeaReceiveMessage(uint8_t bus);
+// Queues a frame for the destination's bus without waiting. Delivery is tracked, and retried up to retries times, by the link layer (gea_link.h).
+int GeaTransmitMessage(byte dst, byte cmd, char* payload, int payloadLength, GeaPriority priority = GEA_PRIORITY_CONTROL,
+                       uint8_t retries = GEA_LINK_MAX_RETRIES);
+// Queues a frame encoded at compile time (gea_const_frame.h), which is copied straight from flash when it goes out
+int GeaTransmitFrame(const GeaEncodedFrame_t* frame, GeaPriority priority = GEA_PRIORITY_CONTROL, uint8_t retries = GEA_LINK_MAX_RETRIES);
+void GeaServiceTransmit();
+const GeaTxClassStats_t* geaTxStats(GeaPriority priority);
+const GeaTxClassStats_t* geaTxBurstStats();
 
 #endif
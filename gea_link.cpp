@@ -0,0 +1,370 @@
+#include "gea_link.h"
+#include "config.h"
+#include "log.h"
+
+typedef enum {
+  LINK_FREE,
+  LINK_ECHO,
+  LINK_AWAIT_ACK,
+  LINK_BACKOFF
+} GeaLinkState;
+
+/*
+ * A frame we sent, kept until it is ACKed or given up on. bytes is exactly what went to the UART,
+ * so a retry resends it as is.
+ */
+typedef struct {
+  uint8_t state;
+  uint8_t bus;
+  uint8_t destination;
+  uint8_t command;
+  uint8_t attempts;
+  uint8_t retries; //       Resends allowed, 0 if the sender retries it itself
+  uint8_t length;
+  uint8_t echoed;
+  uint32_t sequence; //     Order on the wire, for matching echoes and ACKs
+  uint32_t wireEndMicros; // When the last byte should have left, then when its echo actually finished
+  uint32_t retryAtMicros;
+  uint8_t bytes[GEA_LINK_FRAME_SIZE];
+} GeaLinkFrame_t;
+
+static const uint32_t byteMicros = GEA_BYTE_MICROS;
+
+/*
+ * Wire state of one bus.
+ */
+typedef struct {
+  uint32_t wireFreeMicros; // When the UART will be done with everything handed to it so far
+  uint32_t lastRxMicros;
+  uint8_t discardEcho; //    Echo bytes still to come from a frame that collided
+  bool afterEscape;
+} GeaLinkBus_t;
+
+static GeaLinkFrame_t frames[GEA_LINK_SLOTS];
+static GeaLinkStats_t boards[GEA_LINK_MAX_BOARDS];
+static GeaLinkBus_t buses[GEA_BUS_COUNT];
+static uint32_t nextSequence;
+static uint32_t untracked;
+
+static_assert(sizeof(frames) + sizeof(boards) + sizeof(buses) <= RAM_BUDGET_GEA_LINK, "Link frame slots are over their RAM budget (config.h)");
+
+void geaLinkInit() {
+  memset(frames, 0, sizeof(frames));
+  memset(boards, 0, sizeof(boards));
+  nextSequence = 0;
+  uint32_t now = micros();
+  for (int i = 0; i < GEA_BUS_COUNT; i++) {
+    buses[i].wireFreeMicros = now;
+    buses[i].lastRxMicros = now;
+    buses[i].discardEcho = 0;
+    buses[i].afterEscape = false;
+  }
+  untracked = 0;
+}
+
+static bool after(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) > 0;
+}
+
+/*
+ * @brief Find a destination's counters, claiming a free entry the first time it's seen. Returns NULL if the table is full.
+ */
+static GeaLinkStats_t* board(uint8_t address) {
+  for (int i = 0; i < GEA_LINK_MAX_BOARDS; i++) {
+    if (boards[i].address == address) {
+      return &boards[i];
+    }
+    if (boards[i].address == 0) {
+      boards[i].address = address;
+      return &boards[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * @brief The frame in the given state that went out first on a bus, or NULL.
+ */
+static GeaLinkFrame_t* oldest(uint8_t bus, uint8_t state) {
+  GeaLinkFrame_t* found = NULL;
+
+  for (int i = 0; i < GEA_LINK_SLOTS; i++) {
+    if (frames[i].state == state && frames[i].bus == bus && (found == NULL || after(found->sequence, frames[i].sequence))) {
+      found = &frames[i];
+    }
+  }
+  return found;
+}
+
+/*
+ * @brief Note that a frame was just handed to the UART and work out when its last byte will leave.
+ */
+static void handedOver(GeaLinkFrame_t* frame) {
+  GeaLinkBus_t* wire = &buses[frame->bus];
+  uint32_t now = micros();
+  uint32_t start = after(wire->wireFreeMicros, now) ? wire->wireFreeMicros : now;
+
+  wire->wireFreeMicros = start + frame->length * byteMicros;
+  frame->wireEndMicros = wire->wireFreeMicros;
+  frame->sequence = nextSequence++;
+  frame->echoed = 0;
+#ifdef GEA_ECHO_CHECK
+  frame->state = LINK_ECHO;
+#else
+  frame->state = LINK_AWAIT_ACK;
+#endif
+}
+
+/*
+ * @brief A delivery attempt failed. Schedule a retry with a random backoff, or give up. A frame sent without retries is
+ * dropped quietly, since its sender will notice and ask again on its own schedule.
+ */
+static void attemptFailed(GeaLinkFrame_t* frame, GeaLinkStats_t* stats) {
+  if (frame->retries == 0) {
+    frame->state = LINK_FREE;
+    return;
+  }
+
+  if (frame->attempts >= frame->retries) {
+    stats->failed++;
+    frame->state = LINK_FREE;
+    LOG_E(EVT_GEA_LINK_FAILED, frame->destination, frame->command, frame->attempts + 1);
+    return;
+  }
+
+  if (stats->contention < GEA_BACKOFF_MAX_EXPONENT) {
+    stats->contention++;
+  }
+
+  frame->attempts++;
+  frame->state = LINK_BACKOFF;
+  frame->retryAtMicros = micros() + GEA_BACKOFF_SLOT_US + random(GEA_BACKOFF_SLOT_US << stats->contention);
+  stats->retries++;
+  LOG_D(EVT_GEA_LINK_RETRY, frame->destination, frame->command, frame->attempts);
+}
+
+/*
+ * @brief Start tracking a frame that is being handed to the UART now, or is next in line to be. bytes is the escaped frame
+ * with its trailing ACK, exactly as written. It's resent up to retries times if it goes unACKed. Returns when its first byte
+ * should go out, after everything handed over before it.
+ */
+uint32_t geaLinkTrack(uint8_t bus, uint8_t destination, uint8_t command, const uint8_t* bytes, size_t length, uint8_t retries) {
+  GeaLinkStats_t* stats = board(destination);
+  GeaLinkFrame_t* frame = NULL;
+
+  for (int i = 0; i < GEA_LINK_SLOTS; i++) {
+    if (frames[i].state == LINK_BACKOFF && frames[i].destination == destination && frames[i].command == command) {
+      // This frame replaces the one waiting to be retried
+      frames[i].state = LINK_FREE;
+      if (stats != NULL) {
+        stats->superseded++;
+      }
+    }
+    if (frames[i].state == LINK_FREE && frame == NULL) {
+      frame = &frames[i];
+    }
+  }
+
+  if (stats == NULL || frame == NULL || length > GEA_LINK_FRAME_SIZE) {
+    untracked++;
+    // Still counts towards the wire time of the frames behind it
+    GeaLinkBus_t* wire = &buses[bus];
+    uint32_t now = micros();
+    wire->wireFreeMicros = (after(wire->wireFreeMicros, now) ? wire->wireFreeMicros : now) + length * byteMicros;
+    return wire->wireFreeMicros - length * byteMicros;
+  }
+
+  frame->bus = bus;
+  frame->destination = destination;
+  frame->command = command;
+  frame->attempts = 0;
+  frame->retries = retries;
+  frame->length = length;
+  memcpy(frame->bytes, bytes, length);
+  handedOver(frame);
+  stats->frames++;
+  return frame->wireEndMicros - length * byteMicros;
+}
+
+/*
+ * @brief True once everything handed to a bus's UART should have left the wire.
+ */
+bool geaLinkWireIdle(uint8_t bus) {
+  return !after(buses[bus].wireFreeMicros, micros());
+}
+
+/*
+ * @brief When everything handed to a bus's UART so far should have left the wire, in micros().
+ */
+uint32_t geaLinkWireFreeMicros(uint8_t bus) {
+  return buses[bus].wireFreeMicros;
+}
+
+/*
+ * @brief Check a received byte against the echo we expect. Returns true if the byte was our own, so the caller doesn't
+ * mistake the echo of our trailing ACK for a board's.
+ */
+bool geaLinkEcho(uint8_t bus, uint8_t rxByte) {
+  GeaLinkBus_t* wire = &buses[bus];
+  wire->lastRxMicros = micros();
+
+#ifdef GEA_ECHO_CHECK
+  bool escaped = wire->afterEscape;
+  wire->afterEscape = rxByte == GEA_ESC && !escaped;
+
+  if (wire->discardEcho > 0) {
+    wire->discardEcho--;
+    return true;
+  }
+
+  GeaLinkFrame_t* frame = oldest(bus, LINK_ECHO);
+  if (frame == NULL) {
+    return false;
+  }
+
+  if (frame->echoed == 0) {
+    if (rxByte == GEA_SOF && !escaped) {
+      frame->echoed = 1;
+      return true;
+    }
+    // Other nodes' frames and ACKs can hold the bus ahead of our echo. Anything else has to be our SOF, garbled.
+    if (geaBuses[bus].decoder.receiving() || rxByte == GEA_ACK) {
+      return false;
+    }
+  } else if (rxByte == frame->bytes[frame->echoed]) {
+    if (++frame->echoed == frame->length) {
+      frame->state = LINK_AWAIT_ACK;
+      frame->wireEndMicros = wire->lastRxMicros;
+    }
+    return true;
+  } else if (frame->echoed == 1 && rxByte == LOCAL_ADDR) {
+    // That SOF started a frame addressed to us, so it wasn't our echo. Ours is still to come.
+    frame->echoed = 0;
+    return false;
+  }
+
+  // A collision corrupts bytes but the UART still sends all of them, so the rest of this echo is ours to drop
+  GeaLinkStats_t* stats = board(frame->destination);
+  stats->collisions++;
+  wire->discardEcho = frame->length - frame->echoed - 1;
+  frame->echoed = 0;
+  attemptFailed(frame, stats);
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*
+ * @brief A bare ACK byte arrived that wasn't our own echo. It belongs to the oldest frame still waiting for one.
+ */
+void geaLinkAck(uint8_t bus) {
+  GeaLinkFrame_t* frame = oldest(bus, LINK_AWAIT_ACK);
+  if (frame == NULL) {
+    return;
+  }
+
+  GeaLinkStats_t* stats = board(frame->destination);
+  stats->acked++;
+  if (stats->contention > 0) {
+    stats->contention--;
+  }
+  frame->state = LINK_FREE;
+}
+
+/*
+ * @brief Time out one bus's missing echoes and ACKs, and resend its frames whose backoff has run out.
+ */
+static void serviceBus(uint8_t bus, uint32_t now) {
+  GeaLinkBus_t* wire = &buses[bus];
+  bool echoing = false;
+
+  for (int i = 0; i < GEA_LINK_SLOTS; i++) {
+    GeaLinkFrame_t* frame = &frames[i];
+    if (frame->state != LINK_ECHO || frame->bus != bus) {
+      continue;
+    }
+    // Other nodes' traffic holds our bytes back, so only a quiet bus with no echo counts
+    uint32_t quiet = after(wire->lastRxMicros, frame->wireEndMicros) ? wire->lastRxMicros : frame->wireEndMicros;
+    if (after(now, quiet + GEA_ECHO_TIMEOUT_US)) {
+      board(frame->destination)->collisions++;
+      attemptFailed(frame, board(frame->destination));
+    } else {
+      echoing = true;
+    }
+  }
+
+  // Boards can't ACK while we or anyone else still holds the bus, so the ACK clock starts once it goes quiet
+  if (!echoing) {
+    uint32_t quiet = wire->lastRxMicros;
+#ifndef GEA_ECHO_CHECK
+    // Without an echo there's no telling whether our frames had to wait for that traffic, so assume they did
+    for (int i = 0; i < GEA_LINK_SLOTS; i++) {
+      if (frames[i].state == LINK_AWAIT_ACK && frames[i].bus == bus) {
+        quiet += frames[i].length * byteMicros;
+      }
+    }
+#endif
+    if (after(wire->wireFreeMicros, quiet)) {
+      quiet = wire->wireFreeMicros;
+    }
+    uint32_t position = 0;
+    GeaLinkFrame_t* frame;
+
+    while ((frame = oldest(bus, LINK_AWAIT_ACK)) != NULL) {
+      // Each ACK owed ahead of this one takes a byte-time
+      if (!after(now, quiet + ++position * byteMicros + GEA_ACK_TIMEOUT_US)) {
+        break;
+      }
+      GeaLinkStats_t* stats = board(frame->destination);
+      stats->ackTimeouts++;
+      attemptFailed(frame, stats);
+    }
+  }
+
+  // Retries wait for any burst in progress, so they never land in the middle of it. Like queued frames they go out one at
+  // a time once the wire is quiet, so a power burst never waits behind more than one.
+  if (geaBuses[bus].batch.busy() || after(wire->wireFreeMicros, now)) {
+    return;
+  }
+
+  GeaTransport* transport = geaBuses[bus].transport;
+  for (int i = 0; i < GEA_LINK_SLOTS; i++) {
+    GeaLinkFrame_t* frame = &frames[i];
+    if (frame->state != LINK_BACKOFF || frame->bus != bus || after(frame->retryAtMicros, now)) {
+      continue;
+    }
+    if (transport->availableForWrite() >= frame->length) {
+      transport->write(frame->bytes, frame->length);
+      handedOver(frame);
+    }
+    return;
+  }
+}
+
+/*
+ * @brief Time out missing echoes and ACKs, and resend frames whose backoff has run out, on every bus. Call this after every receive poll.
+ */
+void geaLinkService() {
+  uint32_t now = micros();
+
+  for (int i = 0; i < GEA_BUS_COUNT; i++) {
+    serviceBus(i, now);
+  }
+}
+
+int geaLinkBoardCount() {
+  int count = 0;
+  while (count < GEA_LINK_MAX_BOARDS && boards[count].address != 0) {
+    count++;
+  }
+  return count;
+}
+
+const GeaLinkStats_t* geaLinkBoard(int index) {
+  return index < GEA_LINK_MAX_BOARDS ? &boards[index] : NULL;
+}
+
+uint32_t geaLinkUntracked() {
+  return untracked;
+}
@@ -0,0 +1,57 @@
+#ifndef __GEA_LINK_H__
+#define __GEA_LINK_H__
+
+#include <Arduino.h>
+#include "gea_core.h"
+
+/*
+ * Link-level delivery for the frames we send. Every frame handed to the UART is tracked until its
+ * destination ACKs it:
+ *
+ *   ECHO       The half-duplex transceiver plays our own bytes back. Each one is compared with what
+ *              was sent, so a collision with another node shows up within a byte or two.
+ *   AWAIT_ACK  The echo came back intact. The board's ACK has to arrive within GEA_ACK_TIMEOUT_US
+ *              plus one byte-time per ACK owed ahead of it, counted from when our last byte left.
+ *   BACKOFF    The echo was corrupted or the ACK never came. The frame goes out again after a random
+ *              delay, up to GEA_LINK_MAX_RETRIES times. The delay range doubles with each failure to
+ *              the same board and shrinks again as frames get through, so a busy bus gets backed off.
+ *              Frames whose sender keeps its own retry schedule, like discovery's probes, are sent with
+ *              no retries and just dropped.
+ *
+ * A bare ACK byte carries no address, so ACKs are matched to frames in the order the frames went out
+ * on the same bus. Each bus has its own wire timing and echo, so buses never hold each other up.
+ */
+
+#define GEA_LINK_SLOTS 8
+// Room for the longest frame we send, escaped and with its trailing ACK, so every frame can be tracked
+#define GEA_LINK_FRAME_SIZE GEA_MAX_TX_WIRE_SIZE
+#define GEA_LINK_MAX_BOARDS 4
+
+/*
+ * Delivery counters for one destination.
+ */
+typedef struct {
+  uint8_t address;
+  uint8_t contention; //   Backoff exponent: up one on every failure, down one on every ACK
+  uint32_t frames; //      Frames sent, not counting retries
+  uint32_t acked;
+  uint32_t retries;
+  uint32_t collisions; //  The echo didn't match what was sent, or never came back
+  uint32_t ackTimeouts;
+  uint32_t failed; //      Given up on after all their retries, not counting frames sent without any
+  uint32_t superseded; //  Dropped while backing off, because a newer frame with the same command went out
+} GeaLinkStats_t;
+
+void geaLinkInit();
+uint32_t geaLinkTrack(uint8_t bus, uint8_t destination, uint8_t command, const uint8_t* bytes, size_t length, uint8_t retries);
+bool geaLinkWireIdle(uint8_t bus);
+uint32_t geaLinkWireFreeMicros(uint8_t bus);
+bool geaLinkEcho(uint8_t bus, uint8_t rxByte);
+void geaLinkAck(uint8_t bus);
+void geaLinkService();
+
+int geaLinkBoardCount();
+const GeaLinkStats_t* geaLinkBoard(int index);
+uint32_t geaLinkUntracked();
+
+#endif
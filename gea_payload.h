@@ -0,0 +1,123 @@
+#ifndef __GEA_PAYLOAD_H__
+#define __GEA_PAYLOAD_H__
+
+#include <Arduino.h>
+#include "gea_core.h"
+
+/*
+ * Compile-time payload layouts. A layout lists a struct's fields in wire order, and its decode()
+ * reads them straight out of a GeaMessageView into the struct. Field offsets and the expected
+ * payload length are worked out by the compiler, so decoding is a length check and a run of
+ * loads and shifts: no allocation, no intermediate copy. encode() does the same the other way,
+ * for payloads we send.
+ *
+ *   typedef GeaPayloadLayout<Foo_t,
+ *     GeaU16BE<Foo_t, &Foo_t::bar>,
+ *     GeaU8<Foo_t, &Foo_t::baz>
+ *   > FooLayout;
+ */
+
+/*
+ * @brief A 16 bit big-endian field.
+ */
+template <typename Struct, uint16_t Struct::*Member>
+struct GeaU16BE {
+  static constexpr size_t size = 2;
+
+  static void decode(const uint8_t* data, Struct* out) {
+    out->*Member = (uint16_t)(data[0] << 8 | data[1]);
+  }
+
+  static void encode(const Struct* in, uint8_t* data) {
+    data[0] = in->*Member >> 8;
+    data[1] = in->*Member & 0xFF;
+  }
+};
+
+/*
+ * @brief A 32 bit big-endian field.
+ */
+template <typename Struct, uint32_t Struct::*Member>
+struct GeaU32BE {
+  static constexpr size_t size = 4;
+
+  static void decode(const uint8_t* data, Struct* out) {
+    out->*Member = (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+  }
+
+  static void encode(const Struct* in, uint8_t* data) {
+    uint32_t value = in->*Member;
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+  }
+};
+
+/*
+ * @brief A single byte field.
+ */
+template <typename Struct, uint8_t Struct::*Member>
+struct GeaU8 {
+  static constexpr size_t size = 1;
+
+  static void decode(const uint8_t* data, Struct* out) {
+    out->*Member = data[0];
+  }
+
+  static void encode(const Struct* in, uint8_t* data) {
+    data[0] = in->*Member;
+  }
+};
+
+/*
+ * @brief A fixed-length byte array, copied as it is.
+ */
+template <typename Struct, size_t N, uint8_t (Struct::*Member)[N]>
+struct GeaBytes {
+  static constexpr size_t size = N;
+
+  static void decode(const uint8_t* data, Struct* out) {
+    memcpy(out->*Member, data, N);
+  }
+
+  static void encode(const Struct* in, uint8_t* data) {
+    memcpy(data, in->*Member, N);
+  }
+};
+
+template <typename Struct, typename... Fields>
+struct GeaPayloadLayout {
+  typedef Struct Type;
+
+  static constexpr size_t size = (Fields::size + ... + 0);
+  static_assert(size <= GEA_MAX_PAYLOAD_SIZE, "Payload layout is larger than a GEA frame can carry");
+
+  /*
+   * @brief Decode a payload into out. Returns false, leaving out untouched, if the payload length doesn't match the layout.
+   */
+  static bool decode(const uint8_t* data, size_t length, Struct* out) {
+    if (data == NULL || length != size) {
+      return false;
+    }
+
+    size_t offset = 0;
+    ((Fields::decode(data + offset, out), offset += Fields::size), ...);
+    return true;
+  }
+
+  static bool decode(const GeaMessageView& message, Struct* out) {
+    return message.valid() && decode(message.payloadData(), message.payloadLength(), out);
+  }
+
+  /*
+   * @brief Encode in into data, which must hold size bytes. Returns size.
+   */
+  static size_t encode(const Struct* in, uint8_t* data) {
+    size_t offset = 0;
+    ((Fields::encode(in, data + offset), offset += Fields::size), ...);
+    return size;
+  }
+};
+
+#endif
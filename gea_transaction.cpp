@@ -0,0 +1,197 @@
+#include "gea_transaction.h"
+#include "log.h"
+#include "probe.h"
+#include "config.h"
+
+/*
+ * Frames are routed with two lookups. pendingBySource maps a board address straight to its slot,
+ * so a response finds its request in one step. Anything else goes to the handler slot that
+ * handlerByCommand points at.
+ */
+typedef struct {
+  GeaMessageHandler handler;
+  void* context;
+} GeaHandlerEntry_t;
+
+static GeaHandlerEntry_t handlers[GEA_MAX_HANDLERS];
+static uint8_t handlerByCommand[256];
+static uint8_t handlerCount;
+static GeaPendingRequest_t pending[GEA_MAX_PENDING];
+static uint8_t pendingBySource[256];
+static uint8_t freeSlots[GEA_MAX_PENDING];
+static uint8_t freeCount;
+static GeaTransactionStats_t counters;
+
+static_assert(sizeof(handlers) + sizeof(handlerByCommand) + sizeof(pending) + sizeof(pendingBySource) + sizeof(freeSlots)
+              <= RAM_BUDGET_GEA_TRANSACTION, "GEA transaction tables are over their RAM budget (config.h)");
+
+void geaTransactionInit() {
+  memset(handlers, 0, sizeof(handlers));
+  memset(handlerByCommand, GEA_NO_SLOT, sizeof(handlerByCommand));
+  handlerCount = 0;
+  memset(pendingBySource, GEA_NO_SLOT, sizeof(pendingBySource));
+  memset(&counters, 0, sizeof(counters));
+
+  for (uint8_t i = 0; i < GEA_MAX_PENDING; i++) {
+    freeSlots[i] = i;
+  }
+  freeCount = GEA_MAX_PENDING;
+}
+
+/*
+ * @brief Register a handler for unsolicited frames with the given command. Pass NULL to remove it; the command keeps its slot.
+ * Returns -1 if all GEA_MAX_HANDLERS slots are taken.
+ */
+int geaRegisterHandler(uint8_t command, GeaMessageHandler handler, void* context) {
+  uint8_t slot = handlerByCommand[command];
+
+  if (slot == GEA_NO_SLOT) {
+    if (handlerCount == GEA_MAX_HANDLERS) {
+      return -1;
+    }
+    slot = handlerCount++;
+    handlerByCommand[command] = slot;
+  }
+
+  handlers[slot].handler = handler;
+  handlers[slot].context = context;
+  return 0;
+}
+
+/*
+ * @brief A board can only have one request in flight, and there has to be a free slot to track it.
+ */
+static bool admit(uint8_t address) {
+  if (pendingBySource[address] != GEA_NO_SLOT || freeCount == 0) {
+    counters.busy++;
+    return false;
+  }
+  return true;
+}
+
+/*
+ * @brief Start waiting for the answer to a request that was just queued.
+ */
+static int awaitResponse(uint8_t address, uint8_t command, uint32_t timeoutMs, GeaResponseCallback callback, void* context) {
+  uint8_t slot = freeSlots[--freeCount];
+  GeaPendingRequest_t* request = &pending[slot];
+  request->address = address;
+  request->command = command;
+  request->callback = callback;
+  request->context = context;
+  request->sentMs = millis();
+  request->timeoutMs = timeoutMs;
+  pendingBySource[address] = slot;
+
+  PROBE_REQUEST(address, command);
+  counters.requests++;
+  return 0;
+}
+
+/*
+ * @brief Queue a request at the given priority and return right away. callback runs from geaDispatch() when the board answers
+ * with the same command, or from geaExpireRequests() once timeoutMs has passed since it was queued. The link resends the frame
+ * up to retries times if the board doesn't ACK it; callers that ask again on their own schedule pass 0. Returns -1 if the
+ * board already has a request in flight, no slot is free, or the frame couldn't be queued.
+ */
+int geaRequest(uint8_t address, uint8_t command, const uint8_t* payload, uint8_t payloadLength, GeaPriority priority,
+               uint32_t timeoutMs, GeaResponseCallback callback, void* context, uint8_t retries) {
+  if (!admit(address)) {
+    return -1;
+  }
+
+  if (GeaTransmitMessage(address, command, (char*)payload, payloadLength, priority, retries) != 0) {
+    return -1;
+  }
+
+  return awaitResponse(address, command, timeoutMs, callback, context);
+}
+
+/*
+ * @brief The same for a request encoded at compile time (gea_const_frame.h).
+ */
+int geaRequest(const GeaEncodedFrame_t* frame, GeaPriority priority, uint32_t timeoutMs, GeaResponseCallback callback, void* context,
+               uint8_t retries) {
+  if (!admit(frame->destination)) {
+    return -1;
+  }
+
+  if (GeaTransmitFrame(frame, priority, retries) != 0) {
+    return -1;
+  }
+
+  return awaitResponse(frame->destination, frame->command, timeoutMs, callback, context);
+}
+
+bool geaRequestPending(uint8_t address) {
+  return pendingBySource[address] != GEA_NO_SLOT;
+}
+
+/*
+ * @brief Free a slot before its callback runs, so the callback can send the next request to the same board.
+ */
+static GeaPendingRequest_t release(uint8_t slot) {
+  GeaPendingRequest_t request = pending[slot];
+  pendingBySource[request.address] = GEA_NO_SLOT;
+  freeSlots[freeCount++] = slot;
+  return request;
+}
+
+/*
+ * @brief Route a received frame to the request it answers, or to the handler for its command.
+ */
+void geaDispatch(const GeaMessageView& message) {
+  if (message.destination() != LOCAL_ADDR && message.destination() != GEA_BROADCAST_ADDR) {
+    counters.foreign++;
+    return;
+  }
+
+  uint8_t slot = pendingBySource[message.source()];
+  if (slot != GEA_NO_SLOT && pending[slot].command == message.command()) {
+    GeaPendingRequest_t request = release(slot);
+    PROBE_RESPONSE(message.source(), message.command());
+    counters.completed++;
+    if (request.callback != NULL) {
+      request.callback(GEA_RESULT_OK, message, request.context);
+    }
+    return;
+  }
+
+  slot = handlerByCommand[message.command()];
+  if (slot != GEA_NO_SLOT && handlers[slot].handler != NULL) {
+    counters.unsolicited++;
+    handlers[slot].handler(message, handlers[slot].context);
+  } else {
+    counters.unhandled++;
+  }
+}
+
+/*
+ * @brief Time out requests that have waited too long. Cheap enough to call every time the receive queue is drained.
+ */
+void geaExpireRequests() {
+  if (freeCount == GEA_MAX_PENDING) {
+    return;
+  }
+
+  uint32_t now = millis();
+
+  for (uint8_t slot = 0; slot < GEA_MAX_PENDING; slot++) {
+    // A slot is in use exactly when its board's entry points back at it
+    bool inUse = pendingBySource[pending[slot].address] == slot;
+    if (!inUse || now - pending[slot].sentMs < pending[slot].timeoutMs) {
+      continue;
+    }
+
+    GeaPendingRequest_t request = release(slot);
+    counters.timeouts++;
+    LOG_E(EVT_GEA_RX_TIMEOUT, request.address, request.command);
+    if (request.callback != NULL) {
+      request.callback(GEA_RESULT_TIMEOUT, GeaMessageView(), request.context);
+    }
+  }
+}
+
+const GeaTransactionStats_t& geaTransactionStats() {
+  return counters;
+}
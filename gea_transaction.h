@@ -0,0 +1,59 @@
+#ifndef __GEA_TRANSACTION_H__
+#define __GEA_TRANSACTION_H__
+
+#include <Arduino.h>
+#include "gea_core.h"
+
+// Requests that can be outstanding at once. Each board can have one in flight.
+#define GEA_MAX_PENDING 8
+// Commands that can have a handler for unsolicited frames
+#define GEA_MAX_HANDLERS 8
+#define GEA_NO_SLOT 0xFF
+#define GEA_BROADCAST_ADDR 0xFF
+
+typedef enum {
+  GEA_RESULT_OK,
+  GEA_RESULT_TIMEOUT
+} GeaResult;
+
+/*
+ * Completion callback for a request. On GEA_RESULT_TIMEOUT the message is not valid.
+ */
+typedef void (*GeaResponseCallback)(GeaResult result, const GeaMessageView& message, void* context);
+
+/*
+ * Handler for frames that don't answer an outstanding request.
+ */
+typedef void (*GeaMessageHandler)(const GeaMessageView& message, void* context);
+
+typedef struct {
+  uint8_t address;
+  uint8_t command;
+  GeaResponseCallback callback;
+  void* context;
+  uint32_t sentMs;
+  uint32_t timeoutMs;
+} GeaPendingRequest_t;
+
+typedef struct {
+  uint32_t requests;
+  uint32_t completed;
+  uint32_t timeouts;
+  uint32_t busy; //        Rejected because the board already had a request in flight, or no slot was free
+  uint32_t unsolicited; // Routed to a command handler
+  uint32_t unhandled; //   Addressed to us but nobody wanted it
+  uint32_t foreign; //     Addressed to someone else, including the echo of our own frames
+} GeaTransactionStats_t;
+
+void geaTransactionInit();
+int geaRegisterHandler(uint8_t command, GeaMessageHandler handler, void* context);
+int geaRequest(uint8_t address, uint8_t command, const uint8_t* payload, uint8_t payloadLength, GeaPriority priority,
+               uint32_t timeoutMs, GeaResponseCallback callback, void* context, uint8_t retries = GEA_LINK_MAX_RETRIES);
+int geaRequest(const GeaEncodedFrame_t* frame, GeaPriority priority, uint32_t timeoutMs, GeaResponseCallback callback, void* context,
+               uint8_t retries = GEA_LINK_MAX_RETRIES);
+bool geaRequestPending(uint8_t address);
+void geaDispatch(const GeaMessageView& message);
+void geaExpireRequests();
+const GeaTransactionStats_t& geaTransactionStats();
+
+#endif
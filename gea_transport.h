@@ -0,0 +1,41 @@
+#ifndef __GEA_TRANSPORT_H__
+#define __GEA_TRANSPORT_H__
+
+#include <Arduino.h>
+
+/*
+ * The byte stream a GEA bus is reached through. The codec only ever reads what is already
+ * buffered and writes what there is room for, so an implementation must never block in
+ * available(), read() or availableForWrite(). write() may block if asked for more than
+ * availableForWrite() said there was room for.
+ */
+class GeaTransport {
+  public:
+    virtual ~GeaTransport() {}
+
+    virtual int available() = 0;
+    // The next received byte, or -1 if there is none
+    virtual int read() = 0;
+    virtual int availableForWrite() = 0;
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+};
+
+/*
+ * A GEA bus on one of the MCU's UARTs, behind a half-duplex transceiver.
+ */
+class GeaSerialTransport : public GeaTransport {
+  public:
+    explicit GeaSerialTransport(HardwareSerial& serial) : serial(serial) {}
+
+    int available() override { return serial.available(); }
+    int read() override { return serial.read(); }
+    int availableForWrite() override { return serial.availableForWrite(); }
+    size_t write(const uint8_t* data, size_t length) override { return serial.write(data, length); }
+
+    HardwareSerial& uart() { return serial; }
+
+  private:
+    HardwareSerial& serial;
+};
+
+#endif
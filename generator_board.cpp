@@ -1,53 +1,44 @@
 #include "generator_board.h"
 #include "gea_core.h"
+#include "gea_transaction.h"
 #include "crc16.h"
 #include "utils.h"
+#include "config.h"
+#include "log.h"
+#include "probe.h"
 
 /* 
  * The GE induction generator boards support 20 power levels. 
  * They will be mapped to raw ADC values from the pots. 
  */
 int minPowerSteps = 0;
-int maxPowerSteps = 19;
-char consoleBuffer[256];
+int maxPowerSteps = MAX_POWER_LEVEL;
 
 /*
- * @brief Initialize a generator board at an address and tell it what type of coils are connected
+ * @brief Initialize a generator board and tell it what type of coils are connected, with its config frame from the cooktop
+ * table. Returns right away; callback runs when the board answers or the request times out.
  */
-int initSingleGenerator(uint8_t address, uint8_t profile1, uint8_t profile2) {
-  GeaCommandList cmd;
-  BoardConfigPayload_t payload;
-
-  payload.coil1_profile = profile1;
-  payload.coil2_profile = profile2;
-
-  int payloadSize = sizeof(BoardConfigPayload_t);
-
-  char payloadBuf[payloadSize];
-  memcpy(payloadBuf, &payload, payloadSize);
-
-  if (GeaTransmitMessage(address, CMD_SET_BOARD_CONFIG, payloadBuf, payloadSize) == 0) {
+int initSingleGenerator(const GeaEncodedFrame_t* configFrame, GeaResponseCallback callback, void* context) {
+  if (geaRequest(configFrame, GEA_PRIORITY_CONTROL, GEA_RX_TIMEOUT_MS, callback, context) == 0) {
     return 0;
   } else {
-    sprintf(consoleBuffer, "E: Failed to transmit config message to address 0x%02X\n", address);
-    Serial.print(consoleBuffer);
+    LOG_E(EVT_CONFIG_TX_FAILED, configFrame->destination);
     return -1;
   }
 }
 
 /*
- * @brief Update the generator boards with the given power levels and heartbeat
+ * @brief Update the generator boards with the given power levels and heartbeat, using the board's power frame template.
+ * With a batch, the frame is only appended to it and goes out when the batch is sent.
  */
-int setPowerLevels(uint8_t address, uint8_t coil1Level, uint8_t coil2Level, uint8_t heartbeat) {
-  GeaCommandList cmd;
+int setPowerLevels(const GeaFrameTemplate_t* frame, uint8_t coil1Level, uint8_t coil2Level, uint8_t heartbeat, GeaTxBatch* batch) {
   SetPowerLevelsPayload_t payload;
+  uint8_t address = frame->destination;
   
-  sprintf(consoleBuffer, "I: Addr: 0x%02X Coil1: %d Coil2: %d\n", address, coil1Level, coil2Level);
-  Serial.print(consoleBuffer);
+  LOG_I(EVT_POWER_LEVELS, address, coil1Level, coil2Level);
 
   if (!withinRange(coil1Level, minPowerSteps, maxPowerSteps) || !withinRange(coil2Level, minPowerSteps, maxPowerSteps)) {
-    sprintf(consoleBuffer, "E: Zone values out of range for address 0x%02X\n", address);
-    Serial.print(consoleBuffer);
+    LOG_E(EVT_POWER_OUT_OF_RANGE, address);
     return -1;
   }
   
@@ -55,105 +46,84 @@ int setPowerLevels(uint8_t address, uint8_t coil1Level, uint8_t coil2Level, uint
   payload.coil2Power = coil2Level;
   payload.heartbeat = heartbeat;
 
-  int payloadSize = sizeof(SetPowerLevelsPayload_t);
-  
-  char payloadBuf[payloadSize];
-  memcpy(payloadBuf, &payload, payloadSize);
-  
-  if (GeaTransmitMessage(address, CMD_SET_PWR_LEVELS, payloadBuf, payloadSize) == 0) {
+  bool queued;
+  if (batch != NULL) {
+    queued = batch->add(*frame, (const uint8_t*)&payload);
+  } else {
+    queued = GeaTransmitMessage(address, CMD_SET_PWR_LEVELS, (char*)&payload, sizeof(payload)) == 0;
+  }
+
+  if (queued) {
     return 0;
   } else {
-    sprintf(consoleBuffer, "E: Failed to transmit zone control message to address 0x%02X\n", address);
-    Serial.print(consoleBuffer);
+    LOG_E(EVT_POWER_TX_FAILED, address);
     return -1;
   }
 }
 
-char* getSoftwareVersion(uint8_t address) {
-  GeaTransmitMessage(address, CMD_GET_SW_VERSION, 0, 0);
-  char* softwareVersionPayload = GeaReceivePayload(address, CMD_GET_SW_VERSION);
-  if (sizeof(softwareVersionPayload) == 4) {
-    return softwareVersionPayload;
-  } else {
-    sprintf(consoleBuffer, "E: Bad payload length: %d in software version message. Should be $d.", sizeof(softwareVersionPayload), 4);
-    Serial.println(consoleBuffer);
-    return NULL;
-  }
+void powerShadowInit(PowerShadow_t* shadow, const GeaFrameTemplate_t* powerFrame, uint32_t keepaliveMs) {
+  memset(shadow, 0, sizeof(PowerShadow_t));
+  shadow->address = powerFrame->destination;
+  shadow->powerFrame = powerFrame;
+  shadow->keepaliveMs = keepaliveMs;
+}
+
+static void powerShadowSent(PowerShadow_t* shadow, uint8_t coil1Level, uint8_t coil2Level, uint32_t now) {
+  shadow->valid = true;
+  shadow->coil1Level = coil1Level;
+  shadow->coil2Level = coil2Level;
+  shadow->lastSentMs = now;
+  shadow->framesSent++;
 }
 
-Status_t getStatus(uint8_t address) {
-  Status_t status;
-  int responsePayloadLength = RESP_LENGTH_STATUS;
-  char statusPayloadRequest[responsePayloadLength];
+/*
+ * @brief Send power levels to a board only if they changed, or if its keepalive deadline has been reached.
+ * Returns 1 if a frame was sent, 0 if it was skipped, or -1 on error.
+ */
+int updatePowerLevels(PowerShadow_t* shadow, uint8_t coil1Level, uint8_t coil2Level, uint8_t heartbeat, GeaTxBatch* batch) {
+  uint32_t now = millis();
+  bool changed = !shadow->valid || coil1Level != shadow->coil1Level || coil2Level != shadow->coil2Level;
 
-  for (int i=0; i<responsePayloadLength; i++) {
-    statusPayloadRequest[i] = 0x00;
+  if (!changed && now - shadow->lastSentMs < shadow->keepaliveMs) {
+    shadow->framesSkipped++;
+    return 0;
   }
-  
-  GeaTransmitMessage(address, CMD_GET_STATUS, statusPayloadRequest, responsePayloadLength);
-  char* statusPayloadResponse = GeaReceivePayload(address, CMD_GET_STATUS);
-  
-  if (sizeof(statusPayloadResponse) == 20) {
-    status.unk1 = statusPayloadResponse[0] << 8 | statusPayloadResponse[1];
-    status.unk2 = statusPayloadResponse[2] << 8 | statusPayloadResponse[3];
-    status.unk3 = statusPayloadResponse[4] << 8 | statusPayloadResponse[5];
-    status.unk4 = statusPayloadResponse[6] << 8 | statusPayloadResponse[7];
-    status.unk5 = statusPayloadResponse[8] << 8 | statusPayloadResponse[9];
-    status.halfBridge0_temp = statusPayloadResponse[10] << 8 | statusPayloadResponse[11];
-    status.coil0_temp = statusPayloadResponse[12] << 8 | statusPayloadResponse[13];
-    status.halfBridge1_temp = statusPayloadResponse[14] << 8 | statusPayloadResponse[15];
-    status.coil1_temp = statusPayloadResponse[16] << 8 | statusPayloadResponse[17];
-    status.acLineVoltage = statusPayloadResponse[18] << 8 | statusPayloadResponse[19];
-
-    return status;
-  } else {
-    sprintf(consoleBuffer, "E: Bad payload length: %d in status message. Should be %d.", sizeof(statusPayloadResponse), responsePayloadLength);
-    Serial.println(consoleBuffer);
-    return status;
+
+  if (changed && shadow->valid) {
+    PROBE_LEVEL_CHANGE(shadow->address);
+  }
+  // Only bursts are timed; a frame sent without a batch goes through the TX queue
+  if (batch != NULL) {
+    PROBE_ENQUEUE(shadow->address, batch->bus);
   }
-}
 
-void printSoftwareVersions(int personality) {
-  char swVersionLength = RESP_LENGTH_SW_VERSION;
-  
-  char* board0SwVer = getSoftwareVersion(GEN1_ADDR);
-  char* board1SwVer = getSoftwareVersion(GEN2_ADDR);
-
-  if (sizeof(board0SwVer) == swVersionLength && sizeof(board1SwVer) == swVersionLength) {
-    sprintf(consoleBuffer, "I: Gen0 Software Version: %d.%d.%d.%d", board0SwVer[0], board0SwVer[1], board0SwVer[2], board0SwVer[3]);
-    Serial.println(consoleBuffer);
-    sprintf(consoleBuffer, "I: Gen1 Software Version: %d.%d.%d.%d", board1SwVer[0], board1SwVer[1], board1SwVer[2], board1SwVer[3]);
-    Serial.println(consoleBuffer); 
+  if (setPowerLevels(shadow->powerFrame, coil1Level, coil2Level, heartbeat, batch) != 0) {
+    return -1;
   }
-      
-  if (personality > 0) {
-    char* board2SwVer = getSoftwareVersion(GEN3_ADDR);
-      
-    if (sizeof(board2SwVer) == swVersionLength) {
-      sprintf(consoleBuffer, "I: Gen2 Software Version: %d.%d.%d.%d", board2SwVer[0], board2SwVer[1], board2SwVer[2], board2SwVer[3]);
-      Serial.println(consoleBuffer);
-    }
+
+  powerShadowSent(shadow, coil1Level, coil2Level, now);
+  return 1;
+}
+
+/*
+ * @brief Turn both of a board's coils off with its zero power frame (heartbeat 0) from the cooktop table. It's encoded at
+ * compile time, so it goes out as a plain copy from flash. Returns 1 if the frame was queued, or -1 on error.
+ */
+int zeroPowerLevels(PowerShadow_t* shadow, const GeaEncodedFrame_t* zeroFrame) {
+  LOG_I(EVT_POWER_LEVELS, shadow->address, 0, 0);
+
+  if (GeaTransmitFrame(zeroFrame) != 0) {
+    LOG_E(EVT_POWER_TX_FAILED, shadow->address);
+    return -1;
   }
+
+  powerShadowSent(shadow, 0, 0, millis());
+  return 1;
 }
 
-void printStatus(uint8_t address) {
-  Status_t status = getStatus(address);
-
-  uint16_t coil0Temp = status.coil0_temp;
-  uint16_t halfBridge0Temp = status.halfBridge0_temp;
-  uint16_t coil1Temp = status.coil1_temp;
-  uint16_t halfBridge1Temp = status.halfBridge1_temp;
-  uint16_t acLineVoltage = status.acLineVoltage;
-
-  sprintf(
-          consoleBuffer, 
-          "I: Status for 0x%02X: Coil 0 Temp: %d*F, Coil 1 Temp: %d*F, H-Bridge 0 Temp: %d*F, H-Bridge 1 Temp: %d*F, AC Line Voltage: %dV",
-          address, 
-          coil0Temp,
-          coil1Temp,
-          halfBridge0Temp,
-          halfBridge1Temp,
-          acLineVoltage
-          );
-  Serial.println(consoleBuffer);
+/*
+ * @brief Wire time of one power levels frame plus its trailing ACK, without escapes.
+ */
+uint32_t powerFrameWireMicros() {
+  return (uint32_t)(sizeof(SetPowerLevelsPayload_t) + GEA_OVERHEAD + 1) * 10 * 1000000UL / GEA_BAUD_RATE;
 }
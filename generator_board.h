@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include "gea_core.h"
+#include "gea_payload.h"
+#include "gea_transaction.h"
 
 /*
  * GEA addresses for the Arduino and the power boards
@@ -43,6 +45,14 @@ typedef struct {
   uint8_t noncrit_minor;
 } SoftwareVersion_t;
 
+/*
+ * Power levels response payload structure: the levels the board actually applied.
+ */
+typedef struct {
+  uint8_t coil1Level;
+  uint8_t coil2Level;
+} PowerLevelsAck_t;
+
 /*
  * Status response payload structure.
  */
@@ -79,6 +89,44 @@ typedef enum {
   RESP_LENGTH_STATUS=0x14
 } GeaQueryRespPayloadLengthList;
 
+/*
+ * Wire layouts of the response payloads. All multi-byte fields are big-endian.
+ */
+typedef GeaPayloadLayout<SoftwareVersion_t,
+  GeaU8<SoftwareVersion_t, &SoftwareVersion_t::crit_major>,
+  GeaU8<SoftwareVersion_t, &SoftwareVersion_t::crit_minor>,
+  GeaU8<SoftwareVersion_t, &SoftwareVersion_t::noncrit_major>,
+  GeaU8<SoftwareVersion_t, &SoftwareVersion_t::noncrit_minor>
+> SoftwareVersionLayout;
+
+typedef GeaPayloadLayout<PowerLevelsAck_t,
+  GeaU8<PowerLevelsAck_t, &PowerLevelsAck_t::coil1Level>,
+  GeaU8<PowerLevelsAck_t, &PowerLevelsAck_t::coil2Level>
+> PowerLevelsAckLayout;
+
+typedef GeaPayloadLayout<Status_t,
+  GeaU16BE<Status_t, &Status_t::unk1>,
+  GeaU16BE<Status_t, &Status_t::unk2>,
+  GeaU16BE<Status_t, &Status_t::unk3>,
+  GeaU16BE<Status_t, &Status_t::unk4>,
+  GeaU16BE<Status_t, &Status_t::unk5>,
+  GeaU16BE<Status_t, &Status_t::halfBridge0_temp>,
+  GeaU16BE<Status_t, &Status_t::coil0_temp>,
+  GeaU16BE<Status_t, &Status_t::halfBridge1_temp>,
+  GeaU16BE<Status_t, &Status_t::coil1_temp>,
+  GeaU16BE<Status_t, &Status_t::acLineVoltage>
+> StatusLayout;
+
+static_assert(SoftwareVersionLayout::size == RESP_LENGTH_SW_VERSION, "Software version layout doesn't match the response length");
+static_assert(PowerLevelsAckLayout::size == RESP_LENGTH_PWR_LEVELS, "Power levels layout doesn't match the response length");
+static_assert(StatusLayout::size == RESP_LENGTH_STATUS, "Status layout doesn't match the response length");
+
+// Every response has to fit a receive queue slot, and every request the TX buffer. Status requests carry a zeroed payload the size of the response.
+static_assert(RESP_LENGTH_SW_VERSION <= GEA_MAX_RX_PAYLOAD_SIZE && RESP_LENGTH_PWR_LEVELS <= GEA_MAX_RX_PAYLOAD_SIZE &&
+              RESP_LENGTH_STATUS <= GEA_MAX_RX_PAYLOAD_SIZE, "A board response is longer than GEA_MAX_RX_PAYLOAD_SIZE");
+static_assert(sizeof(BoardConfigPayload_t) <= GEA_MAX_TX_PAYLOAD_SIZE && sizeof(SetPowerLevelsPayload_t) <= GEA_MAX_TX_PAYLOAD_SIZE &&
+              RESP_LENGTH_STATUS <= GEA_MAX_TX_PAYLOAD_SIZE, "A board request is longer than GEA_MAX_TX_PAYLOAD_SIZE");
+
 /*
  * Coil power profiles.
  */
@@ -90,11 +138,46 @@ typedef enum {
   COIL_TYPE_3700_WATT=0x04
 } CoilProfileId;
 
-int initSingleGenerator(uint8_t address, uint8_t profile1, uint8_t profile2);
-int setPowerLevels(uint8_t address, uint8_t coil1Level, uint8_t coil2Level, uint8_t heartbeat);
-char* getSoftwareVersion(uint8_t address);
-Status_t getStatus(uint8_t address);
-void printSoftwareVersions(int personality);
-void printStatus(uint8_t address);
+/*
+ * Last power levels sent to a board, used to only send frames when something changed or the
+ * board's keepalive deadline is coming up.
+ */
+typedef struct {
+  uint8_t address;
+  const GeaFrameTemplate_t* powerFrame; // The board's power frame, header encoded at compile time
+  bool ready; //        Configured by bring-up (discovery.h). Until then it gets no power frames.
+  bool valid;
+  uint8_t coil1Level;
+  uint8_t coil2Level;
+  uint32_t keepaliveMs;
+  uint32_t lastSentMs;
+  uint32_t framesSent;
+  uint32_t framesSkipped;
+} PowerShadow_t;
+
+/*
+ * Time from the knob sample a power burst was built from until its last frame is back from the
+ * bus, for every burst. Measured from the transceiver echo, so it includes waiting for the bus.
+ * Without GEA_ECHO_CHECK there is no echo, and the burst is done when the link layer expects its
+ * last byte to have left the wire. With several buses, the burst is done once the last frame on
+ * each of them is.
+ */
+typedef struct {
+  uint8_t pendingBuses; //  Bit per bus still sending its part of the burst
+  uint8_t lastDestination[GEA_BUS_COUNT];
+  uint32_t wireEndMicros[GEA_BUS_COUNT]; // Without the echo: when each bus's part should be off the wire
+  uint32_t knobMicros;
+  uint32_t bursts;
+  uint32_t lastMicros;
+  uint32_t maxMicros;
+  uint64_t totalMicros;
+} PowerBurstTiming_t;
+
+int initSingleGenerator(const GeaEncodedFrame_t* configFrame, GeaResponseCallback callback, void* context);
+int setPowerLevels(const GeaFrameTemplate_t* frame, uint8_t coil1Level, uint8_t coil2Level, uint8_t heartbeat, GeaTxBatch* batch = NULL);
+void powerShadowInit(PowerShadow_t* shadow, const GeaFrameTemplate_t* powerFrame, uint32_t keepaliveMs);
+int updatePowerLevels(PowerShadow_t* shadow, uint8_t coil1Level, uint8_t coil2Level, uint8_t heartbeat, GeaTxBatch* batch = NULL);
+int zeroPowerLevels(PowerShadow_t* shadow, const GeaEncodedFrame_t* zeroFrame);
+uint32_t powerFrameWireMicros();
 
 #endif
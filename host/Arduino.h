@@ -0,0 +1,129 @@
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+
+/*
+ * Minimal Arduino API for building the firmware on a Linux host. Time is virtual: it only moves
+ * when the firmware waits (delay, blocking serial writes, polling millis/micros/available) or when
+ * the host runtime advances it between calls to loop(). See host/arduino_host.cpp.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Lets firmware code tell it is running on the host simulator
+#define ARDUINO_HOST 1
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define LED_BUILTIN 13
+#define ADC_RESOLUTION 12
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+
+/*
+ * STM32 pin names used by config.h
+ */
+enum {
+  PA0 = 0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+  PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+  PC0, PC1, PC2, PC3, PC4, PC5, PC6, PC7, PC8, PC9, PC10, PC11, PC12, PC13, PC14, PC15,
+  NUM_HOST_PINS
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <typename T>
+    size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+/*
+ * A UART with Arduino-sized TX and RX buffers. Writes block (in virtual time) while the TX buffer
+ * is full, and bytes drain at the configured baud rate.
+ */
+class HardwareSerial : public Print {
+  public:
+    HardwareSerial();
+    HardwareSerial(int rxPin, int txPin);
+
+    void begin(unsigned long baud);
+    void end() {}
+    int available();
+    int peek();
+    int read();
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t value) override;
+    using Print::write;
+    operator bool() { return true; }
+
+    // Host side of the UART, used by the runtime and emulators. bus is -1 for the console.
+    int bus;
+    unsigned long baud;
+    uint8_t txBuffer[SERIAL_TX_BUFFER_SIZE];
+    size_t txHead, txCount;
+    uint8_t rxBuffer[SERIAL_RX_BUFFER_SIZE];
+    size_t rxHead, rxCount;
+    uint32_t rxOverruns;
+
+    bool txPending() const { return txCount > 0; }
+    uint8_t txPop();
+    void rxPush(uint8_t value);
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+int analogRead(int pin);
+void analogReadResolution(int bits);
+
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+template <typename T> static inline T min(T a, T b) { return a < b ? a : b; }
+template <typename T> static inline T max(T a, T b) { return a > b ? a : b; }
+template <typename T> static inline T constrain(T x, T a, T b) { return x < a ? a : (x > b ? b : x); }
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __HOST_EEPROM_H__
+#define __HOST_EEPROM_H__
+
+#include "Arduino.h"
+
+/*
+ * The Arduino EEPROM API over a RAM array, standing in for the STM32 core's flash emulation. It
+ * starts out erased (every byte 0xFF), as a freshly flashed part does. Writes take no virtual time.
+ */
+#define HOST_EEPROM_SIZE 1024
+
+class EEPROMClass {
+  public:
+    EEPROMClass() { memset(data, 0xFF, sizeof(data)); }
+
+    uint8_t read(int index) { return index >= 0 && index < HOST_EEPROM_SIZE ? data[index] : 0xFF; }
+    void write(int index, uint8_t value) {
+      if (index >= 0 && index < HOST_EEPROM_SIZE) {
+        data[index] = value;
+        writes++;
+      }
+    }
+    void update(int index, uint8_t value) {
+      if (read(index) != value) {
+        write(index, value);
+      }
+    }
+    uint16_t length() { return HOST_EEPROM_SIZE; }
+
+    template <typename T> T& get(int index, T& value) {
+      for (size_t i = 0; i < sizeof(T); i++) {
+        ((uint8_t*)&value)[i] = read(index + i);
+      }
+      return value;
+    }
+    template <typename T> const T& put(int index, const T& value) {
+      for (size_t i = 0; i < sizeof(T); i++) {
+        update(index + i, ((const uint8_t*)&value)[i]);
+      }
+      return value;
+    }
+
+    // Host side, for the simulator
+    uint8_t data[HOST_EEPROM_SIZE];
+    uint32_t writes;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
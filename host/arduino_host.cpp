@@ -0,0 +1,452 @@
+#include "host_runtime.h"
+#include "EEPROM.h"
+
+/*
+ * Host implementation of the Arduino API in virtual time.
+ *
+ * The console (Serial) and each GEA bus are modeled as wires. A bus is any UART made with pins
+ * (Serial1, then any others the sketch declares), numbered in the order they are constructed. Each
+ * wire moves one byte per byte-time (10 bits per byte, 8N1) out of the port's 64 byte TX buffer. A
+ * bus carries either the MCU's bytes or its attached device's. Whoever is sending keeps the wire
+ * until it runs out of bytes, and the MCU goes first when both start at once. The bus delivers the
+ * device's bytes (plus the MCU's own echo) into the 64 byte RX buffer, dropping bytes when it is full.
+ */
+
+HostStats_t hostStats;
+HostBusStats_t hostBusStats[HOST_MAX_BUSES];
+bool hostBusEcho = true;
+double hostBusCollisionRate = 0;
+uint32_t hostLoopCostMicros = 5;
+int hostAnalogNoise = 0;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+static uint64_t now;
+static FILE* consoleOutput = stdout;
+static void (*consoleObserver)(uint8_t);
+
+static int pinValues[NUM_HOST_PINS];
+static int analogValues[NUM_HOST_PINS];
+
+typedef struct {
+  bool active;
+  bool fromMcu;
+  uint8_t value;
+  uint64_t doneAt;
+} WireByte_t;
+
+/*
+ * A bus UART's wire and what's attached to it. Plain data, so it's zeroed before any of the
+ * sketch's UARTs are constructed and register themselves.
+ */
+typedef struct {
+  HardwareSerial* port;
+  HostBusDevice* device;
+  WireByte_t wire;
+  void (*txObserver)(uint8_t, uint64_t);
+  void (*observer)(uint8_t, uint64_t);
+} HostBus_t;
+
+static WireByte_t consoleWire;
+static HostBus_t buses[HOST_MAX_BUSES];
+static int busCount;
+static uint32_t collisionRandom = 12345;
+
+/*
+ * @brief Collisions use their own generator, so turning them on doesn't change the knob script.
+ */
+static bool collides() {
+  collisionRandom = collisionRandom * 1103515245 + 12345;
+  return hostBusCollisionRate > 0 && (collisionRandom >> 8) < hostBusCollisionRate * (1 << 24);
+}
+
+uint64_t hostByteMicros(unsigned long baud) {
+  return baud > 0 ? (10ULL * 1000000ULL + baud - 1) / baud : 1;
+}
+
+static uint64_t nextEventTime() {
+  uint64_t next = UINT64_MAX;
+
+  if (consoleWire.active && consoleWire.doneAt < next) {
+    next = consoleWire.doneAt;
+  }
+  for (int i = 0; i < busCount; i++) {
+    if (buses[i].wire.active && buses[i].wire.doneAt < next) {
+      next = buses[i].wire.doneAt;
+    }
+    if (buses[i].device != NULL && buses[i].device->nextEventMicros() < next) {
+      next = buses[i].device->nextEventMicros();
+    }
+  }
+
+  return next;
+}
+
+static void startBus(int index) {
+  HostBus_t* bus = &buses[index];
+  if (bus->wire.active) {
+    return;
+  }
+
+  uint64_t byteMicros = hostByteMicros(bus->port->baud);
+  bool deviceHasWire = !bus->wire.fromMcu && bus->device != NULL && bus->device->txPending();
+
+  if (bus->port->txPending() && !deviceHasWire) {
+    bus->wire.active = true;
+    bus->wire.fromMcu = true;
+    bus->wire.value = bus->port->txPop();
+    bus->wire.doneAt = now + byteMicros;
+    hostStats.mcuBusyMicros += byteMicros;
+    hostStats.mcuBytes++;
+    hostBusStats[index].mcuBusyMicros += byteMicros;
+    hostBusStats[index].mcuBytes++;
+  } else if (bus->device != NULL && bus->device->txPending()) {
+    bus->wire.active = true;
+    bus->wire.fromMcu = false;
+    bus->wire.value = bus->device->txPop();
+    bus->wire.doneAt = now + byteMicros;
+    hostStats.deviceBusyMicros += byteMicros;
+    hostStats.deviceBytes++;
+    hostBusStats[index].deviceBusyMicros += byteMicros;
+    hostBusStats[index].deviceBytes++;
+  }
+}
+
+/*
+ * @brief Start sending the next byte on any idle wire.
+ */
+static void startWires() {
+  if (!consoleWire.active && Serial.txPending()) {
+    consoleWire.active = true;
+    consoleWire.value = Serial.txPop();
+    consoleWire.doneAt = now + hostByteMicros(Serial.baud);
+  }
+
+  for (int i = 0; i < busCount; i++) {
+    startBus(i);
+  }
+}
+
+static void finishBus(HostBus_t* bus) {
+  WireByte_t* wire = &bus->wire;
+
+  if (wire->active && wire->doneAt <= now) {
+    wire->active = false;
+    if (wire->fromMcu) {
+      if (collides()) {
+        // Both the boards and our own echo see the garbled byte
+        wire->value ^= 0x5A;
+        hostStats.collisions++;
+      }
+      if (bus->device != NULL) {
+        bus->device->onByte(wire->value, now);
+      }
+      if (bus->txObserver != NULL) {
+        bus->txObserver(wire->value, now);
+      }
+      if (hostBusEcho) {
+        bus->port->rxPush(wire->value);
+      }
+    } else {
+      bus->port->rxPush(wire->value);
+    }
+    if (bus->observer != NULL) {
+      bus->observer(wire->value, now);
+    }
+  }
+
+  if (bus->device != NULL && bus->device->nextEventMicros() <= now) {
+    bus->device->service(now);
+  }
+}
+
+static void processEvents() {
+  if (consoleWire.active && consoleWire.doneAt <= now) {
+    consoleWire.active = false;
+    hostStats.consoleBytes++;
+    if (consoleOutput != NULL) {
+      fputc(consoleWire.value, consoleOutput);
+    }
+    if (consoleObserver != NULL) {
+      consoleObserver(consoleWire.value);
+    }
+  }
+
+  for (int i = 0; i < busCount; i++) {
+    finishBus(&buses[i]);
+  }
+
+  startWires();
+}
+
+uint64_t hostNowMicros() {
+  return now;
+}
+
+void hostAdvanceTo(uint64_t target) {
+  startWires();
+
+  for (;;) {
+    uint64_t next = nextEventTime();
+    if (next > target) {
+      break;
+    }
+    if (next > now) {
+      now = next;
+    }
+    processEvents();
+  }
+
+  if (target > now) {
+    now = target;
+  }
+}
+
+void hostAdvance(uint64_t micros) {
+  hostAdvanceTo(now + micros);
+}
+
+void hostAttachBusDevice(HostBusDevice* device, int bus) {
+  if (bus >= 0 && bus < HOST_MAX_BUSES) {
+    buses[bus].device = device;
+  }
+}
+
+int hostBusCount() {
+  return busCount;
+}
+
+void hostSetConsoleOutput(FILE* output) {
+  consoleOutput = output;
+}
+
+void hostSetConsoleObserver(void (*observer)(uint8_t value)) {
+  consoleObserver = observer;
+}
+
+void hostSetBusTxObserver(void (*observer)(uint8_t value, uint64_t nowMicros), int bus) {
+  if (bus >= 0 && bus < HOST_MAX_BUSES) {
+    buses[bus].txObserver = observer;
+  }
+}
+
+void hostSetBusObserver(void (*observer)(uint8_t value, uint64_t nowMicros), int bus) {
+  if (bus >= 0 && bus < HOST_MAX_BUSES) {
+    buses[bus].observer = observer;
+  }
+}
+
+void hostSetAnalog(int pin, int value) {
+  if (pin >= 0 && pin < NUM_HOST_PINS) {
+    analogValues[pin] = value;
+  }
+}
+
+void hostSetDigitalInput(int pin, int value) {
+  if (pin >= 0 && pin < NUM_HOST_PINS) {
+    pinValues[pin] = value;
+  }
+}
+
+int hostDigitalOutput(int pin) {
+  return (pin >= 0 && pin < NUM_HOST_PINS) ? pinValues[pin] : 0;
+}
+
+/*
+ * Arduino API
+ */
+
+unsigned long millis() {
+  // Polling the clock costs a little CPU time, which also keeps busy-wait loops moving
+  hostAdvance(1);
+  return (unsigned long)(now / 1000);
+}
+
+unsigned long micros() {
+  hostAdvance(1);
+  return (unsigned long)now;
+}
+
+void delay(unsigned long ms) {
+  hostAdvance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hostAdvance(us);
+}
+
+void pinMode(int pin, int mode) {
+}
+
+void digitalWrite(int pin, int value) {
+  if (pin >= 0 && pin < NUM_HOST_PINS) {
+    pinValues[pin] = value;
+  }
+}
+
+int digitalRead(int pin) {
+  return (pin >= 0 && pin < NUM_HOST_PINS) ? pinValues[pin] : 0;
+}
+
+int analogRead(int pin) {
+  // A conversion takes a few microseconds on the STM32
+  hostAdvance(5);
+  if (pin < 0 || pin >= NUM_HOST_PINS) {
+    return 0;
+  }
+
+  int value = analogValues[pin];
+  if (hostAnalogNoise > 0) {
+    value += rand() % (hostAnalogNoise + 1) - hostAnalogNoise / 2;
+  }
+  return constrain(value, 0, (1 << ADC_RESOLUTION) - 1);
+}
+
+void analogReadResolution(int bits) {
+}
+
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh) {
+  return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+  return max > min ? min + rand() % (max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+  srand(seed);
+}
+
+/*
+ * Print
+ */
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char digits[8 * sizeof(long) + 1];
+  int i = sizeof(digits) - 1;
+
+  if (base < 2) {
+    base = 10;
+  }
+
+  digits[i] = '\0';
+  do {
+    int digit = value % base;
+    digits[--i] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value > 0);
+
+  return write(&digits[i]);
+}
+
+size_t Print::print(long value, int base) {
+  if (base == 10 && value < 0) {
+    return print('-') + print((unsigned long)-value, base);
+  }
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(double value, int digits) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  return write(text);
+}
+
+/*
+ * HardwareSerial
+ */
+
+HardwareSerial::HardwareSerial()
+  : bus(-1), baud(0), txHead(0), txCount(0), rxHead(0), rxCount(0), rxOverruns(0) {
+}
+
+HardwareSerial::HardwareSerial(int rxPin, int txPin)
+  : bus(-1), baud(0), txHead(0), txCount(0), rxHead(0), rxCount(0), rxOverruns(0) {
+  if (busCount < HOST_MAX_BUSES) {
+    bus = busCount++;
+    buses[bus].port = this;
+  }
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  this->baud = baud;
+}
+
+int HardwareSerial::available() {
+  hostAdvance(1);
+  return rxCount;
+}
+
+int HardwareSerial::peek() {
+  return rxCount > 0 ? rxBuffer[rxHead] : -1;
+}
+
+int HardwareSerial::read() {
+  if (rxCount == 0) {
+    return -1;
+  }
+
+  uint8_t value = rxBuffer[rxHead];
+  rxHead = (rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+  rxCount--;
+  return value;
+}
+
+int HardwareSerial::availableForWrite() {
+  return SERIAL_TX_BUFFER_SIZE - txCount;
+}
+
+void HardwareSerial::flush() {
+  while (txCount > 0 || (bus >= 0 ? buses[bus].wire.active : consoleWire.active)) {
+    hostAdvanceTo(nextEventTime());
+  }
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  uint64_t blockedSince = now;
+
+  // Like the real driver, block until there is room in the TX buffer
+  while (txCount == SERIAL_TX_BUFFER_SIZE) {
+    hostAdvanceTo(nextEventTime());
+  }
+
+  if (bus >= 0) {
+    hostStats.busWriteBlockedMicros += now - blockedSince;
+  } else {
+    hostStats.consoleWriteBlockedMicros += now - blockedSince;
+  }
+
+  txBuffer[(txHead + txCount) % SERIAL_TX_BUFFER_SIZE] = value;
+  txCount++;
+  startWires();
+  return 1;
+}
+
+uint8_t HardwareSerial::txPop() {
+  uint8_t value = txBuffer[txHead];
+  txHead = (txHead + 1) % SERIAL_TX_BUFFER_SIZE;
+  txCount--;
+  return value;
+}
+
+void HardwareSerial::rxPush(uint8_t value) {
+  if (rxCount == SERIAL_RX_BUFFER_SIZE) {
+    rxOverruns++;
+    return;
+  }
+
+  rxBuffer[(rxHead + rxCount) % SERIAL_RX_BUFFER_SIZE] = value;
+  rxCount++;
+}
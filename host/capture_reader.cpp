@@ -0,0 +1,69 @@
+#include "capture_reader.h"
+
+CaptureReader::CaptureReader(FILE* input)
+  : input(input), baudRate(0), formatVersion(0), micros(0), truncatedRecord(false) {
+}
+
+/*
+ * @brief Read and check the header. Returns false if this isn't a trace, or is from a newer format.
+ */
+bool CaptureReader::readHeader() {
+  uint8_t header[CAPTURE_HEADER_SIZE];
+
+  if (fread(header, 1, sizeof(header), input) != sizeof(header) ||
+      header[0] != 'G' || header[1] != 'E' || header[2] != 'A' || header[3] != 'C' || header[4] > CAPTURE_VERSION) {
+    return false;
+  }
+
+  formatVersion = header[4];
+  baudRate = header[5] | header[6] << 8 | header[7] << 16 | (uint32_t)header[8] << 24;
+  return true;
+}
+
+bool CaptureReader::readVarint(uint64_t* value) {
+  *value = 0;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    int next = fgetc(input);
+    if (next == EOF) {
+      return false;
+    }
+    *value |= (uint64_t)(next & 0x7F) << shift;
+    if ((next & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * @brief Read the next record. Returns false at the end of the trace.
+ */
+bool CaptureReader::next(CaptureRecord_t* record) {
+  uint64_t tag;
+  if (!readVarint(&tag)) {
+    return false;
+  }
+
+  record->kind = tag & 1;
+  micros += tag >> 1;
+  record->micros = micros;
+
+  if (record->kind == CAPTURE_BYTE) {
+    int value = fgetc(input);
+    if (value == EOF) {
+      truncatedRecord = true;
+      return false;
+    }
+    record->value = value;
+  } else {
+    uint64_t count;
+    if (!readVarint(&count)) {
+      truncatedRecord = true;
+      return false;
+    }
+    record->value = count;
+  }
+
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef __CAPTURE_READER_H__
+#define __CAPTURE_READER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "capture.h"
+
+/*
+ * One record from a bus trace, with its time counted from the start of the trace.
+ */
+typedef struct {
+  uint8_t kind;
+  uint64_t micros;
+  uint32_t value;
+} CaptureRecord_t;
+
+/*
+ * Reads the sniffer's trace format (capture.h) back, one record at a time.
+ */
+class CaptureReader {
+  public:
+    CaptureReader(FILE* input);
+
+    bool readHeader();
+    bool next(CaptureRecord_t* record);
+
+    uint32_t baud() const { return baudRate; }
+    uint8_t version() const { return formatVersion; }
+    // The trace ended partway through a record
+    bool truncated() const { return truncatedRecord; }
+
+  private:
+    bool readVarint(uint64_t* value);
+
+    FILE* input;
+    uint32_t baudRate;
+    uint8_t formatVersion;
+    uint64_t micros;
+    bool truncatedRecord;
+};
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Replays a bus trace from the sniffer (capture.h) through the firmware's GEA frame decoder, and
+ * reports what was on the bus and how fast the decoder got through it.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++17 -funsigned-char -Ihost -I. host/capture_replay.cpp host/capture_reader.cpp gea_core.cpp \
+ *     gea_link.cpp crc16.cpp utils.cpp log.cpp probe.cpp scheduler.cpp host/arduino_host.cpp host/host_transport.cpp \
+ *     -o host/capture_replay
+ *   host/capture_replay [--realtime] [--speed X] [--frames] [--pty] trace.bin
+ *
+ * Capture a trace with a SNIFFER_MODE build, e.g.
+ *   stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > trace.bin
+ * or from the simulator with cooktop_sim --capture trace.bin.
+ *
+ * By default the whole trace is loaded and fed to the decoder as fast as it will go, and the
+ * decoder's throughput is reported. --realtime feeds each byte at its recorded time instead (scaled
+ * by --speed), to watch a capture play out with --frames. --pty also plays the bytes out of a
+ * pseudo-terminal (GeaPtyTransport) in real time, so a serial tool opened on the printed path sees
+ * the bus as if it were plugged into it.
+ *
+ * Reported from the recorded timestamps:
+ *   - bus utilization, from the byte count and the baud rate
+ *   - frames by source, destination and command
+ *   - frame gap: EOF of a frame until the SOF of the next one, i.e. how long the bus sat idle or carried only ACKs
+ *   - response time: EOF of a frame until the EOF of a frame coming back the other way with the same command
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+#include "capture_reader.h"
+#include "gea_core.h"
+#include "host_transport.h"
+
+typedef struct {
+  uint64_t micros;
+  uint8_t value;
+} TraceByte_t;
+
+static void printSamples(const char* name, std::vector<uint64_t> samples) {
+  if (samples.empty()) {
+    printf("%-16s no samples\n", name);
+    return;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  uint64_t sum = 0;
+  for (uint64_t sample : samples) {
+    sum += sample;
+  }
+
+  printf("%-16s n=%-6zu min %8.2f  avg %8.2f  p50 %8.2f  p95 %8.2f  max %8.2f ms\n", name, samples.size(),
+         samples.front() / 1000.0, sum / 1000.0 / samples.size(), samples[samples.size() / 2] / 1000.0,
+         samples[samples.size() * 95 / 100] / 1000.0, samples.back() / 1000.0);
+}
+
+static void printFrame(const GeaFrame_t* frame, uint64_t micros) {
+  printf("%10.6f  0x%02X -> 0x%02X  cmd 0x%02X ", micros / 1e6, GeaFrameSource(frame), GeaFrameDestination(frame),
+         GeaFrameCommand(frame));
+  for (int i = 0; i < GeaFramePayloadLength(frame); i++) {
+    printf(" %02X", GeaFramePayload(frame)[i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  const char* path = NULL;
+  bool realtime = false;
+  bool showFrames = false;
+  bool pty = false;
+  double speed = 1.0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--realtime")) {
+      realtime = true;
+    } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+      speed = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--frames")) {
+      showFrames = true;
+    } else if (!strcmp(argv[i], "--pty")) {
+      pty = true;
+      realtime = true;
+    } else if (argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [--realtime] [--speed X] [--frames] [--pty] trace.bin\n", argv[0]);
+      return 1;
+    }
+  }
+
+  FILE* input = path != NULL ? fopen(path, "rb") : stdin;
+  if (input == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  CaptureReader reader(input);
+  if (!reader.readHeader()) {
+    fprintf(stderr, "Not a bus trace, or a newer format than this tool knows\n");
+    return 1;
+  }
+
+  std::vector<TraceByte_t> bytes;
+  uint32_t dropped = 0;
+  CaptureRecord_t record;
+  while (reader.next(&record)) {
+    if (record.kind == CAPTURE_BYTE) {
+      bytes.push_back(TraceByte_t{record.micros, (uint8_t)record.value});
+    } else {
+      dropped += record.value;
+    }
+  }
+  if (reader.truncated()) {
+    fprintf(stderr, "Trace ends partway through a record\n");
+  }
+
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  GeaPtyTransport output;
+  if (pty) {
+    if (!output.open()) {
+      perror("posix_openpt");
+      return 1;
+    }
+    printf("Replaying on %s, press Enter to start\n", output.path());
+    getchar();
+  }
+
+  GeaFrameDecoder decoder;
+  std::map<uint32_t, uint32_t> framesByRoute;
+  std::map<uint32_t, uint64_t> awaitingResponse;
+  std::vector<uint64_t> frameGaps;
+  std::vector<uint64_t> responseTimes;
+  uint64_t lastFrameEnd = 0;
+
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (const TraceByte_t& traced : bytes) {
+    if (realtime) {
+      std::this_thread::sleep_until(wallStart + std::chrono::microseconds((uint64_t)(traced.micros / speed)));
+    }
+
+    if (pty) {
+      output.write(&traced.value, 1);
+    }
+
+    if (traced.value == GEA_SOF && !decoder.receiving() && lastFrameEnd != 0) {
+      frameGaps.push_back(traced.micros - lastFrameEnd);
+    }
+
+    if (decoder.feed(traced.value)) {
+      const GeaFrame_t* frame = decoder.peek();
+      uint8_t source = GeaFrameSource(frame);
+      uint8_t destination = GeaFrameDestination(frame);
+      uint8_t command = GeaFrameCommand(frame);
+
+      framesByRoute[source << 16 | destination << 8 | command]++;
+
+      auto request = awaitingResponse.find(destination << 16 | source << 8 | command);
+      if (request != awaitingResponse.end()) {
+        responseTimes.push_back(traced.micros - request->second);
+        awaitingResponse.erase(request);
+      } else {
+        awaitingResponse[source << 16 | destination << 8 | command] = traced.micros;
+      }
+
+      if (showFrames) {
+        printFrame(frame, traced.micros);
+      }
+      lastFrameEnd = traced.micros;
+      decoder.pop();
+    }
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  if (pty) {
+    // Closing the master throws away whatever the other end hasn't read yet
+    printf("Replay done, press Enter to close %s\n", output.path());
+    getchar();
+  }
+  double traceSeconds = bytes.empty() ? 0 : bytes.back().micros / 1e6;
+  double byteSeconds = 10.0 / reader.baud();
+  const GeaDecoderStats_t& stats = decoder.stats();
+
+  printf("\n=== %s: %.3f s at %u baud, format %u\n", path != NULL ? path : "stdin", traceSeconds, reader.baud(), reader.version());
+  printf("Bytes:           %zu captured  %u dropped by the sniffer\n", bytes.size(), dropped);
+  if (traceSeconds > 0) {
+    printf("Bus utilization: %.1f%%\n", 100.0 * bytes.size() * byteSeconds / traceSeconds);
+  }
+  printf("Decoder:         frames %u  acks %u  CRC errors %u  framing errors %u  oversized %u\n",
+         stats.frames, stats.acks, stats.crcErrors, stats.framingErrors, stats.oversized);
+  if (!realtime && wallSeconds > 0) {
+    printf("Replay speed:    %.1f MB/s, %.0f ns/byte, %.0fx real time\n", bytes.size() / wallSeconds / 1e6,
+           wallSeconds * 1e9 / std::max<size_t>(bytes.size(), 1), traceSeconds / wallSeconds);
+  }
+
+  printf("Frames by route:\n");
+  for (const auto& route : framesByRoute) {
+    printf("  0x%02X -> 0x%02X  cmd 0x%02X  %u\n", route.first >> 16, (route.first >> 8) & 0xFF, route.first & 0xFF, route.second);
+  }
+  printSamples("Frame gap:", frameGaps);
+  printSamples("Response time:", responseTimes);
+
+  return 0;
+}
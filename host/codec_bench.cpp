@@ -0,0 +1,259 @@
+/*
+ * Microbenchmarks for the GEA codec functions that run on every frame.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++17 -funsigned-char -Ihost -I. host/codec_bench.cpp gea_core.cpp gea_link.cpp crc16.cpp utils.cpp log.cpp \
+ *     probe.cpp scheduler.cpp host/arduino_host.cpp host/host_transport.cpp -o host/codec_bench
+ *   host/codec_bench [--json] [--iterations N]
+ *
+ * Each benchmark runs over two payload mixes: "typical" (2-20 random bytes, like the commands the
+ * generator boards use) and "escapes" (2-20 bytes that all need escaping, the worst case).
+ * Heap allocations are counted by interposing malloc/calloc/realloc, so this only builds on glibc.
+ *
+ * For printHexByteArray the virtual console time is also reported: how long the MCU would be blocked
+ * writing the dump at 115200 baud.
+ */
+
+#include <chrono>
+#include <vector>
+#include "host_runtime.h"
+#include "gea_core.h"
+#include "gea_const_frame.h"
+#include "generator_board.h"
+#include "crc16.h"
+#include "utils.h"
+#include "host_transport.h"
+
+static GeaFrameDecoder decoder;
+static GeaLoopbackTransport loopback;
+
+static constexpr GeaFrameTemplate_t powerTemplate = geaFrameTemplate(0x88, CMD_SET_PWR_LEVELS, sizeof(SetPowerLevelsPayload_t));
+static constexpr auto statusRequest = geaEncodeFrame(0x88, CMD_GET_STATUS, GeaConstPayload<RESP_LENGTH_STATUS>{});
+
+/*
+ * Allocation counting
+ */
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static uint64_t allocations;
+
+extern "C" void* malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+  allocations++;
+  return __libc_realloc(ptr, size);
+}
+
+/*
+ * Test frames
+ */
+
+#define FRAME_SET_SIZE 1024
+
+typedef struct {
+  std::vector<uint8_t> payload;
+  std::vector<uint8_t> raw;       // Unescaped, SOF through EOF
+  std::vector<uint8_t> escaped;   // As sent on the wire
+} TestFrame_t;
+
+static std::vector<TestFrame_t> makeFrames(bool allEscapes) {
+  std::vector<TestFrame_t> frames(FRAME_SET_SIZE);
+  uint8_t buffer[GEA_MAX_ESCAPED_FRAME_SIZE];
+
+  for (TestFrame_t& frame : frames) {
+    size_t length = 2 + rand() % 19;
+    for (size_t i = 0; i < length; i++) {
+      frame.payload.push_back(allEscapes ? GEA_ESC + rand() % 4 : rand());
+    }
+
+    GeaFrameWriter writer(buffer, sizeof(buffer));
+    writer.begin(0x88, 0x28, length);
+    writer.write(frame.payload.data(), length);
+    frame.escaped.assign(buffer, buffer + writer.end());
+
+    frame.raw.push_back(GEA_SOF);
+    frame.raw.push_back(0x88);
+    frame.raw.push_back(length + GEA_OVERHEAD);
+    frame.raw.push_back(LOCAL_ADDR);
+    frame.raw.push_back(0x28);
+    frame.raw.insert(frame.raw.end(), frame.payload.begin(), frame.payload.end());
+    uint16_t crc = CalculateCrc16((const char*)frame.raw.data() + 1, frame.raw.size() - 1);
+    frame.raw.push_back(crc >> 8);
+    frame.raw.push_back(crc & 0xFF);
+    frame.raw.push_back(GEA_EOF);
+  }
+
+  return frames;
+}
+
+/*
+ * Harness
+ */
+
+static bool jsonOutput;
+static int iterations = 200;
+static volatile uint32_t sink;
+static uint32_t parseFailures;
+
+template <typename Body>
+static void runBenchmark(const char* name, const char* mix, const std::vector<TestFrame_t>& frames, Body body) {
+  uint64_t bytes = 0;
+  for (const TestFrame_t& frame : frames) {
+    bytes += frame.escaped.size();
+  }
+  bytes *= iterations;
+
+  uint64_t frameCount = (uint64_t)frames.size() * iterations;
+  uint64_t consoleStart = hostNowMicros();
+  uint64_t allocationsStart = allocations;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < iterations; i++) {
+    for (const TestFrame_t& frame : frames) {
+      body(frame);
+    }
+  }
+
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  double allocationsPerFrame = (double)(allocations - allocationsStart) / frameCount;
+  double consoleMicrosPerFrame = (double)(hostNowMicros() - consoleStart) / frameCount;
+  double nsPerFrame = ns / frameCount;
+  double bytesPerSecond = bytes / (ns / 1e9);
+
+  if (jsonOutput) {
+    printf("{\"benchmark\":\"%s\",\"mix\":\"%s\",\"frames\":%llu,\"ns_per_frame\":%.1f,\"bytes_per_sec\":%.0f,"
+           "\"allocs_per_frame\":%.2f,\"console_us_per_frame\":%.1f}\n",
+           name, mix, (unsigned long long)frameCount, nsPerFrame, bytesPerSecond, allocationsPerFrame, consoleMicrosPerFrame);
+  } else {
+    printf("%-36s %-8s %10.1f ns/frame %9.1f MB/s %6.2f allocs/frame", name, mix, nsPerFrame, bytesPerSecond / 1e6, allocationsPerFrame);
+    if (consoleMicrosPerFrame >= 1.0) {
+      printf(" %8.1f us console/frame", consoleMicrosPerFrame);
+    }
+    printf("\n");
+  }
+}
+
+static void runSuite(const char* mix, const std::vector<TestFrame_t>& frames) {
+  static char scratch[GEA_MAX_ESCAPED_FRAME_SIZE];
+  static uint8_t txBuffer[GEA_MAX_ESCAPED_FRAME_SIZE];
+
+  runBenchmark("escapeMessage", mix, frames, [](const TestFrame_t& frame) {
+    sink += escapeMessage((const char*)frame.raw.data(), frame.raw.size(), scratch);
+  });
+
+  runBenchmark("CalculateCrc16", mix, frames, [](const TestFrame_t& frame) {
+    sink += CalculateCrc16((const char*)frame.raw.data() + 1, frame.raw.size() - 4);
+  });
+
+  runBenchmark("GeaFrameWriter", mix, frames, [](const TestFrame_t& frame) {
+    GeaFrameWriter writer(txBuffer, sizeof(txBuffer));
+    writer.begin(0x88, 0x28, frame.payload.size());
+    writer.write(frame.payload.data(), frame.payload.size());
+    sink += writer.end();
+  });
+
+  // A power frame as a burst builds it, from scratch and from the board's precomputed header. The levels come from the payload.
+  runBenchmark("power frame: GeaFrameWriter", mix, frames, [](const TestFrame_t& frame) {
+    uint8_t payload[3] = {frame.payload[0], frame.payload[1], (uint8_t)frame.payload.size()};
+    GeaFrameWriter writer(txBuffer, sizeof(txBuffer));
+    writer.begin(0x88, CMD_SET_PWR_LEVELS, sizeof(payload));
+    writer.write(payload, sizeof(payload));
+    sink += writer.end();
+  });
+
+  runBenchmark("power frame: template", mix, frames, [](const TestFrame_t& frame) {
+    uint8_t payload[3] = {frame.payload[0], frame.payload[1], (uint8_t)frame.payload.size()};
+    GeaFrameWriter writer(txBuffer, sizeof(txBuffer));
+    writer.begin(powerTemplate);
+    writer.write(payload, sizeof(payload));
+    sink += writer.end();
+  });
+
+  // A status request built at run time, and copied from its compile-time encoding
+  runBenchmark("status request: GeaFrameWriter", mix, frames, [](const TestFrame_t& frame) {
+    static const uint8_t zeros[RESP_LENGTH_STATUS] = {0};
+    GeaFrameWriter writer(txBuffer, sizeof(txBuffer));
+    writer.begin(0x88, CMD_GET_STATUS, sizeof(zeros));
+    writer.write(zeros, sizeof(zeros));
+    sink += writer.end();
+  });
+
+  runBenchmark("status request: constant", mix, frames, [](const TestFrame_t& frame) {
+    memcpy(txBuffer, statusRequest.bytes, statusRequest.length);
+    sink += statusRequest.length;
+  });
+
+  runBenchmark("GeaFrameDecoder", mix, frames, [](const TestFrame_t& frame) {
+    for (uint8_t value : frame.escaped) {
+      if (decoder.feed(value)) {
+        sink += GeaFrameCommand(decoder.peek());
+        decoder.pop();
+      }
+    }
+  });
+
+  // The same through a transport, which the firmware reads each bus through: one virtual call per byte plus the queue
+  runBenchmark("GeaFrameDecoder::poll", mix, frames, [](const TestFrame_t& frame) {
+    loopback.write(frame.escaped.data(), frame.escaped.size());
+    if (decoder.poll(loopback) > 0) {
+      sink += GeaFrameCommand(decoder.peek());
+      decoder.pop();
+    }
+  });
+
+  // Decode every frame's first bytes as a status response, the biggest typed payload we parse
+  runBenchmark("GeaMessageView+StatusLayout", mix, frames, [](const TestFrame_t& frame) {
+    static GeaFrame_t status;
+    status.length = RESP_LENGTH_STATUS + GEA_OVERHEAD;
+    memcpy(status.data + 5, frame.payload.data(), frame.payload.size());
+
+    Status_t decoded;
+    if (!StatusLayout::decode(GeaMessageView(&status), &decoded)) {
+      parseFailures++;
+    }
+    sink += decoded.coil0_temp + decoded.acLineVoltage;
+  });
+
+  runBenchmark("printHexByteArray", mix, frames, [](const TestFrame_t& frame) {
+    printHexByteArray((char*)frame.escaped.data(), frame.escaped.size());
+  });
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--json")) {
+      jsonOutput = true;
+    } else if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    }
+  }
+
+  srand(1);
+  hostSetConsoleOutput(NULL);
+  Serial.begin(115200);
+
+  std::vector<TestFrame_t> typical = makeFrames(false);
+  std::vector<TestFrame_t> escapes = makeFrames(true);
+
+  runSuite("typical", typical);
+  runSuite("escapes", escapes);
+
+  const GeaDecoderStats_t& stats = decoder.stats();
+  if (stats.crcErrors > 0 || stats.framingErrors > 0 || parseFailures > 0) {
+    fprintf(stderr, "E: decoder rejected %u frames, parser rejected %u\n", stats.crcErrors + stats.framingErrors, parseFailures);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,584 @@
+/*
+ * Runs the real firmware (setup()/loop() and everything under it) against emulated generator
+ * boards in virtual time, and reports bus utilization, knob-to-frame latency and response
+ * turnaround.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++17 -funsigned-char -Ihost -I. -x c++ gea-induction-cooktop-ui.ino -x none \
+ *     *.cpp host/arduino_host.cpp host/generator_emulator.cpp host/log_decoder.cpp host/cooktop_sim.cpp -o host/cooktop_sim
+ *   host/cooktop_sim --seconds 120 --personality 5
+ *
+ * Options:
+ *   --seconds N        Virtual time to simulate (default 60)
+ *   --personality 4|5  Cooktop personality (default 4)
+ *   --knob-interval N  Milliseconds between simulated knob moves (default 1500)
+ *   --turnaround N     Board response delay in microseconds (default 2000)
+ *   --adc-noise N      Peak-to-peak noise on every ADC read, in counts (default 8)
+ *   --no-echo          Don't echo MCU bytes back into its RX, like a full-duplex adapter. Build
+ *                      without GEA_ECHO_CHECK to match.
+ *   --collision-rate P Corrupt each MCU byte on the wire with probability P, like another node talking over it
+ *   --console          Print the firmware's console log, decoded to text
+ *   --raw-console      Print the firmware's console bytes as they are
+ *   --seed N           Random seed for the knob script
+ *   --capture FILE     Write every byte on bus 0 to FILE in the sniffer's trace format (capture.h),
+ *                      for host/capture_replay
+ *   --histograms       Send 'h' on the console near the end, so the firmware dumps its latency histograms
+ *   --boot-ms N        Time from the relay closing until the first board answers (default 300). Each
+ *                      further board takes 40 ms longer.
+ *   --absent ADDR      Leave the board at ADDR (e.g. 0x89) off the bus, to see it reported missing
+ *   --present ADDR     Put the board at ADDR on the bus even if the personality doesn't have it, to see it
+ *                      reported as extra. By default the emulated boards match the personality.
+ *   --host-control     Play a supervising host on the console (host_control.h): subscribe to snapshots,
+ *                      override knob 0 every 100 ms, read the counters, then go quiet so the override
+ *                      times out. Needs a HOST_CONTROL build.
+ *   --calibrate CURVE  At 1 s, send every knob a calibration over host control with stops 2% in from
+ *                      each end, a 5% off zone and CURVE (linear or square), and store it. The last
+ *                      knob gets a narrow square calibration instead, with levels closer together than
+ *                      the hysteresis, and is moved through it in random steps of up to 40 counts each
+ *                      way, held 300 ms each, to check that its level never moves against the knob.
+ *                      Needs a HOST_CONTROL build.
+ *
+ * Every GEA bus the firmware is built with (GEA_BUS_COUNT in config.h) gets its own wire and its
+ * own set of emulated boards, and bus utilization is reported per bus.
+ *
+ * CPU time inside the firmware is not modeled beyond a fixed cost per loop() call and per clock or
+ * UART poll, so the numbers are dominated by wire time and blocking I/O, which is what we want.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "host_runtime.h"
+#include "generator_emulator.h"
+#include "log_decoder.h"
+#include "telemetry.h"
+#include "thermal.h"
+#include "gea_transaction.h"
+#include "gea_link.h"
+#include "probe.h"
+#include "capture.h"
+#include "discovery.h"
+#include "host_control.h"
+#include "input.h"
+#include "EEPROM.h"
+#include "config.h"
+
+void setup();
+void loop();
+
+extern PowerBurstTiming_t powerTiming;
+extern uint8_t potValuesMapped[numPots];
+extern GeaSerialTransport geaTransports[GEA_BUS_COUNT];
+
+static GeneratorEmulator emulators[GEA_BUS_COUNT];
+static LogDecoder* consoleDecoder;
+
+// A knob move that hasn't shown up as a level change on the bus yet
+static bool knobChangePending;
+static uint64_t knobChangeMicros;
+static uint8_t lastLevels[EMULATED_BOARDS][2];
+static std::vector<uint64_t> knobLatencySamples;
+static uint32_t framesByCommand[256];
+
+static FILE* captureFile;
+static uint64_t lastCaptureMicros;
+
+// The supervising host on the console (--host-control), and the frames it got back
+static GeaFrameDecoder hostFrames;
+static uint32_t hostFramesByCommand[256];
+static bool hostLevelPending;
+static uint8_t hostLevel;
+static uint64_t hostLevelMicros;
+static std::vector<uint64_t> hostLevelSamples;
+static uint64_t hostCommandMicros;
+static std::vector<uint64_t> hostReplySamples;
+static HostCounters_t hostCounters;
+static uint32_t hostCalibrationsStored;
+
+static void onFrame(const GeaFrame_t* frame, uint64_t nowMicros) {
+  framesByCommand[GeaFrameCommand(frame)]++;
+
+  if (GeaFrameCommand(frame) != CMD_SET_PWR_LEVELS || GeaFramePayloadLength(frame) < 2) {
+    return;
+  }
+
+  for (int i = 0; i < EMULATED_BOARDS; i++) {
+    if (emulators[0].boardAt(i)->address != GeaFrameDestination(frame)) {
+      continue;
+    }
+
+    const uint8_t* levels = GeaFramePayload(frame);
+    bool changed = levels[0] != lastLevels[i][0] || levels[1] != lastLevels[i][1];
+    lastLevels[i][0] = levels[0];
+    lastLevels[i][1] = levels[1];
+
+    // Knob 0 drives the first coil on GEN1 in both cooktops
+    if (hostLevelPending && GeaFrameDestination(frame) == GEN1_ADDR && levels[0] == hostLevel) {
+      hostLevelSamples.push_back(nowMicros - hostLevelMicros);
+      hostLevelPending = false;
+    } else if (changed && knobChangePending) {
+      knobLatencySamples.push_back(nowMicros - knobChangeMicros);
+      knobChangePending = false;
+    }
+  }
+}
+
+/*
+ * @brief Record a bus byte the way the sniffer would, but with the exact time it finished on the wire.
+ */
+static void onBusByte(uint8_t value, uint64_t nowMicros) {
+  uint8_t record[CAPTURE_MAX_RECORD_SIZE];
+  size_t length = captureEncodeRecord(record, nowMicros - lastCaptureMicros, CAPTURE_BYTE, value);
+
+  fwrite(record, 1, length, captureFile);
+  lastCaptureMicros = nowMicros;
+}
+
+static void onHostFrame(const GeaFrame_t* frame) {
+  uint8_t command = GeaFrameCommand(frame);
+  hostFramesByCommand[command]++;
+
+  if (hostCommandMicros != 0 && command != HOST_MSG_STATUS) {
+    hostReplySamples.push_back(hostNowMicros() - hostCommandMicros);
+    hostCommandMicros = 0;
+  }
+  if (command == HOST_CMD_COUNTERS) {
+    HostCountersLayout::decode(GeaMessageView(frame), &hostCounters);
+  }
+  HostCalibrate_t calibration;
+  if (command == HOST_CMD_CALIBRATE && HostCalibrateLayout::decode(GeaMessageView(frame), &calibration) &&
+      calibration.flags & HOST_CALIBRATE_SAVE) {
+    hostCalibrationsStored++;
+  }
+}
+
+/*
+ * @brief Split the console into log records and host control frames. Frames only start between records.
+ */
+static void onConsoleByte(uint8_t value) {
+  if (hostFrames.receiving() || (value == GEA_SOF && consoleDecoder->idle())) {
+    if (hostFrames.feed(value)) {
+      onHostFrame(hostFrames.peek());
+      hostFrames.pop();
+    }
+  } else {
+    consoleDecoder->feed(value);
+  }
+}
+
+static void hostSend(uint8_t command, const uint8_t* payload, uint8_t payloadLength) {
+  uint8_t buffer[GEA_ESCAPED_SIZE(HOST_MAX_PAYLOAD)];
+  GeaFrameWriter writer(buffer, sizeof(buffer));
+
+  writer.begin(LOCAL_ADDR, command, payloadLength, HOST_ADDR);
+  writer.write(payload, payloadLength);
+  size_t length = writer.end();
+  for (size_t i = 0; i < length; i++) {
+    Serial.rxPush(buffer[i]);
+  }
+  hostCommandMicros = hostNowMicros();
+}
+
+#ifdef LATENCY_PROBES
+/*
+ * @brief Print a firmware latency histogram, with the p95 taken as the upper edge of its bucket.
+ */
+static void printHistogram(const char* name, uint8_t key, const LatencyHistogram_t* histogram) {
+  if (histogram->count == 0) {
+    return;
+  }
+
+  uint32_t seen = 0;
+  int bucket = 0;
+  while (bucket < PROBE_BUCKETS - 1 && (seen += histogram->buckets[bucket]) < (histogram->count * 95 + 99) / 100) {
+    bucket++;
+  }
+
+  printf("  0x%02X %-24s n=%-6u avg %8.2f  p95 < %8.2f  max %8.2f ms\n", key, name, histogram->count,
+         histogram->totalMicros / 1000.0 / histogram->count, (PROBE_FIRST_BUCKET_US << bucket) / 1000.0,
+         histogram->maxMicros / 1000.0);
+}
+
+static void printProbes() {
+  static const char* spanNames[SPAN_BOARD_COUNT] = {
+    "knob -> change", "change -> enqueue", "enqueue -> first byte", "enqueue -> last byte", "knob -> last byte"
+  };
+
+  printf("Firmware latency probes:\n");
+  for (int i = 0; i < PROBE_MAX_BOARDS; i++) {
+    const ProbeBoard_t* board = probeBoard(i);
+    for (int span = 0; span < SPAN_BOARD_COUNT && board->address != 0; span++) {
+      printHistogram(spanNames[span], board->address, &board->spans[span]);
+    }
+  }
+  for (int i = 0; i < PROBE_MAX_COMMANDS; i++) {
+    const ProbeCommand_t* command = probeCommand(i);
+    if (command->used) {
+      printHistogram("request -> response", command->command, &command->roundTrip);
+    }
+  }
+}
+#endif
+
+static void printSamples(const char* name, std::vector<uint64_t> samples) {
+  if (samples.empty()) {
+    printf("%-28s no samples\n", name);
+    return;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  uint64_t sum = 0;
+  for (uint64_t sample : samples) {
+    sum += sample;
+  }
+
+  printf("%-28s n=%-6zu min %8.2f  avg %8.2f  p50 %8.2f  p95 %8.2f  max %8.2f ms\n", name, samples.size(),
+         samples.front() / 1000.0, sum / 1000.0 / samples.size(), samples[samples.size() / 2] / 1000.0,
+         samples[samples.size() * 95 / 100] / 1000.0, samples.back() / 1000.0);
+}
+
+int main(int argc, char** argv) {
+  double seconds = 60;
+  int personality = 4;
+  uint32_t knobIntervalMs = 1500;
+  bool console = false;
+  bool rawConsole = false;
+  bool histograms = false;
+  bool hostControl = false;
+  int calibrateCurve = -1;
+  unsigned seed = 1;
+  uint32_t knobMoves = 0;
+  int bootMs = -1;
+  std::vector<std::pair<uint8_t, bool>> presence;
+
+  hostAnalogNoise = 8;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--personality") && i + 1 < argc) {
+      personality = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--knob-interval") && i + 1 < argc) {
+      knobIntervalMs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--turnaround") && i + 1 < argc) {
+      uint64_t turnaround = atoi(argv[++i]);
+      for (GeneratorEmulator& emulator : emulators) {
+        emulator.turnaroundMicros = turnaround;
+      }
+    } else if (!strcmp(argv[i], "--adc-noise") && i + 1 < argc) {
+      hostAnalogNoise = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--collision-rate") && i + 1 < argc) {
+      hostBusCollisionRate = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--no-echo")) {
+      hostBusEcho = false;
+    } else if (!strcmp(argv[i], "--console")) {
+      console = true;
+    } else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+      captureFile = fopen(argv[++i], "wb");
+      if (captureFile == NULL) {
+        perror(argv[i]);
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "--histograms")) {
+      histograms = true;
+    } else if (!strcmp(argv[i], "--host-control")) {
+      hostControl = true;
+    } else if (!strcmp(argv[i], "--calibrate") && i + 1 < argc) {
+      i++;
+      calibrateCurve = !strcmp(argv[i], "square") ? KNOB_CURVE_SQUARE : KNOB_CURVE_LINEAR;
+    } else if (!strcmp(argv[i], "--raw-console")) {
+      rawConsole = true;
+    } else if (!strcmp(argv[i], "--boot-ms") && i + 1 < argc) {
+      bootMs = atoi(argv[++i]);
+    } else if ((!strcmp(argv[i], "--absent") || !strcmp(argv[i], "--present")) && i + 1 < argc) {
+      bool present = !strcmp(argv[i], "--present");
+      presence.push_back(std::make_pair((uint8_t)strtol(argv[++i], NULL, 0), present));
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  srand(seed);
+  LogDecoder decoder(console ? stdout : NULL);
+  consoleDecoder = &decoder;
+  hostSetConsoleOutput(rawConsole ? stdout : NULL);
+  hostSetConsoleObserver(onConsoleByte);
+  hostSetDigitalInput(personalitySelPin, personality == 5 ? 1 : 0);
+  // The 30 inch cooktop has no third board
+  presence.insert(presence.begin(), std::make_pair((uint8_t)GEN3_ADDR, personality == 5));
+  for (int bus = 0; bus < GEA_BUS_COUNT; bus++) {
+    hostAttachBusDevice(&emulators[bus], bus);
+    emulators[bus].frameObserver = onFrame;
+    for (int i = 0; i < EMULATED_BOARDS; i++) {
+      if (bootMs >= 0) {
+        emulators[bus].boardAt(i)->bootMicros = (uint64_t)(bootMs + 40 * i) * 1000;
+      }
+    }
+    for (const auto& board : presence) {
+      if (emulators[bus].board(board.first) != NULL) {
+        emulators[bus].board(board.first)->present = board.second;
+      }
+    }
+  }
+  if (captureFile != NULL) {
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    fwrite(header, 1, captureEncodeHeader(header, GEA_BAUD_RATE), captureFile);
+    hostSetBusObserver(onBusByte);
+  }
+
+  int activePots = personality == 5 ? 5 : 4;
+  uint64_t endMicros = (uint64_t)(seconds * 1e6);
+  uint64_t nextKnobMove = 3000000; // Leave time for init
+  uint64_t nextHostCommand = 3000000;
+  uint32_t hostCommands = 0;
+  uint64_t nextCalibration = 1000000;
+  int calibratedKnobs = 0;
+
+  // The knob swept through a narrow calibration, and what its level did
+  const int narrowKnob = activePots - 1;
+  const int narrowMin = MAX_ADC_RAWVALUE * 3 / 8;
+  const int narrowMax = narrowMin + MAX_ADC_RAWVALUE / 8;
+  // The square curve packs the high levels closest, so the knob stays in the top half
+  const int sweepLow = (narrowMin + narrowMax) / 2;
+  int sweepValue = narrowMax - 32;
+  int sweepStep = 0;
+  const uint64_t sweepStartMicros = 1500000; // Once every knob is calibrated, which needs every coil off
+  uint64_t nextSweepStep = sweepStartMicros;
+  uint8_t sweepLevel = 0;
+  uint8_t sweepMaxLevel = 0;
+  uint32_t sweepChanges = 0;
+  uint32_t sweepWrongWay = 0;
+  uint32_t loops = 0;
+  bool relayClosed = false;
+
+  auto wallStart = std::chrono::steady_clock::now();
+
+  setup();
+  while (hostNowMicros() < endMicros) {
+    if (hostNowMicros() >= nextKnobMove) {
+      // The host has knob 0, and the sweep has the last one
+      int firstPot = hostControl ? 1 : 0;
+      int lastPot = calibrateCurve >= 0 ? narrowKnob - 1 : activePots - 1;
+      int pot = firstPot + rand() % (lastPot - firstPot + 1);
+      hostSetAnalog(potPins[pot], rand() % (1 << ADC_RESOLUTION));
+      knobMoves++;
+      knobChangePending = true;
+      knobChangeMicros = hostNowMicros();
+      nextKnobMove += (uint64_t)knobIntervalMs * 1000;
+    }
+
+    // One knob at a time, while every coil is still off, so each one can be stored
+    if (calibrateCurve >= 0 && calibratedKnobs < numPots && hostNowMicros() >= nextCalibration) {
+      const int stop = MAX_ADC_RAWVALUE / 50;
+      HostCalibrate_t calibration = {(uint8_t)calibratedKnobs, HOST_CALIBRATE_APPLY | HOST_CALIBRATE_SAVE, stop,
+                                     MAX_ADC_RAWVALUE - stop, MAX_ADC_RAWVALUE / 20, (uint8_t)calibrateCurve};
+      if (calibratedKnobs == narrowKnob) {
+        calibration = {(uint8_t)narrowKnob, HOST_CALIBRATE_APPLY | HOST_CALIBRATE_SAVE, narrowMin, narrowMax,
+                       MAX_ADC_RAWVALUE / 200, KNOB_CURVE_SQUARE};
+      }
+      uint8_t payload[HostCalibrateLayout::size];
+      hostSend(HOST_CMD_CALIBRATE, payload, HostCalibrateLayout::encode(&calibration, payload));
+      calibratedKnobs++;
+      nextCalibration = hostNowMicros() + 20000;
+    }
+
+    // Step the narrow knob. Each step is held until the pot filter has settled, so its level may only move the way the
+    // knob did.
+    if (calibrateCurve >= 0 && hostNowMicros() >= nextSweepStep) {
+      if (nextSweepStep == sweepStartMicros) {
+        // The first step brings the knob up from off
+        sweepStep = sweepValue;
+      } else {
+        sweepStep = constrain(sweepValue + rand() % 81 - 40, sweepLow, narrowMax + 32) - sweepValue;
+        sweepValue += sweepStep;
+      }
+      hostSetAnalog(potPins[narrowKnob], sweepValue);
+      nextSweepStep += 300000;
+    }
+    if (calibrateCurve >= 0 && potValuesMapped[narrowKnob] != sweepLevel) {
+      uint8_t level = potValuesMapped[narrowKnob];
+      if ((sweepStep > 0 && level < sweepLevel) || (sweepStep < 0 && level > sweepLevel)) {
+        sweepWrongWay++;
+      }
+      sweepChanges++;
+      sweepMaxLevel = max(sweepMaxLevel, level);
+      sweepLevel = level;
+    }
+
+    // Subscribe, then override knob 0 with a new level every 100 ms until 5 s before the end, read the counters
+    // 2 s before the end, and leave the override to time out
+    if (hostControl && hostNowMicros() >= nextHostCommand) {
+      if (hostCommands == 0) {
+        HostSubscribe_t subscription = {HOST_STREAM_STATUS | HOST_STREAM_LEVELS, 100};
+        uint8_t payload[HostSubscribeLayout::size];
+        hostSend(HOST_CMD_SUBSCRIBE, payload, HostSubscribeLayout::encode(&subscription, payload));
+      } else if (hostNowMicros() < endMicros - 5000000) {
+        HostSetLevels_t levels = {0x01, {(uint8_t)(hostCommands % (MAX_POWER_LEVEL + 1))}};
+        uint8_t payload[HostSetLevelsLayout::size];
+        hostSend(HOST_CMD_SET_LEVELS, payload, HostSetLevelsLayout::encode(&levels, payload));
+        hostLevel = levels.levels[0];
+        hostLevelMicros = hostNowMicros();
+        hostLevelPending = true;
+      } else {
+        hostSend(HOST_CMD_COUNTERS, NULL, 0);
+        nextHostCommand = UINT64_MAX;
+      }
+      hostCommands++;
+      if (nextHostCommand != UINT64_MAX) {
+        nextHostCommand = hostNowMicros() < endMicros - 5000000 ? hostNowMicros() + 100000 : endMicros - 2000000;
+      }
+    }
+
+    if (histograms && hostNowMicros() >= endMicros - 2000000) {
+      Serial.rxPush('h');
+      histograms = false;
+    }
+
+    if (!relayClosed && hostDigitalOutput(dlbRelayCtrlPin)) {
+      for (GeneratorEmulator& emulator : emulators) {
+        emulator.powerOn(hostNowMicros());
+      }
+      relayClosed = true;
+    }
+
+    loop();
+    loops++;
+    hostAdvance(hostLoopCostMicros);
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double virtualMicros = (double)hostNowMicros();
+
+  printf("\n=== Simulated %.1f s in %.2f s wall time (%.0fx), %u loop() calls\n",
+         virtualMicros / 1e6, wallSeconds, virtualMicros / 1e6 / wallSeconds, loops);
+
+  for (int bus = 0; bus < hostBusCount(); bus++) {
+    const HostBusStats_t* wire = &hostBusStats[bus];
+    printf("Bus %d utilization:           MCU %5.1f%%  boards %5.1f%%  total %5.1f%%\n", bus,
+           100.0 * wire->mcuBusyMicros / virtualMicros,
+           100.0 * wire->deviceBusyMicros / virtualMicros,
+           100.0 * (wire->mcuBusyMicros + wire->deviceBusyMicros) / virtualMicros);
+  }
+  printf("Bus bytes:                   MCU %u  boards %u\n", hostStats.mcuBytes, hostStats.deviceBytes);
+  printf("Frames from MCU:             version %u  config %u  power %u  status %u\n",
+         framesByCommand[CMD_GET_SW_VERSION], framesByCommand[CMD_SET_BOARD_CONFIG],
+         framesByCommand[CMD_SET_PWR_LEVELS], framesByCommand[CMD_GET_STATUS]);
+  printf("Time blocked in writes:      bus %.1f ms  console %.1f ms (%u console bytes)\n",
+         hostStats.busWriteBlockedMicros / 1000.0, hostStats.consoleWriteBlockedMicros / 1000.0, hostStats.consoleBytes);
+
+  static const char* const boardStates[] = {"probing", "configuring", "ready", "missing", "extra"};
+  const BootTiming_t* boot = discoveryTiming();
+  printf("Boot to ready:               %u ms  first answer %u ms  all answered %u ms  %u of %u ready  %u missing  %u extra%s\n",
+         boot->readyMs, boot->firstAnswerMs, boot->allAnsweredMs, boot->ready, boot->expected, boot->missing, boot->extra,
+         discoveryDone() ? "" : " (still bringing up)");
+  for (int i = 0; i < DISCOVERY_MAX_BOARDS; i++) {
+    const DiscoveredBoard_t* board = discoveryBoard(i);
+    if (board->index < 0 && board->state != BOARD_EXTRA) {
+      continue;
+    }
+    printf("Bring-up 0x%02X:               %-11s answered %u ms  ready %u ms  probes %u  configs %u\n", board->address,
+           boardStates[board->state], board->answeredMs, board->readyMs, board->probes, board->configs);
+  }
+  printf("Console log:                 %u records  %u dropped in firmware\n", decoder.records(), logDropped());
+  printf("Knob moves:                  %u\n", knobMoves);
+  printSamples("Knob-to-frame latency:", knobLatencySamples);
+#ifdef HOST_CONTROL
+  if (hostControl) {
+    const HostControlStats_t* host = hostControlStats();
+    printf("Host control:                commands %u  errors %u  frames sent %u  deferred %u  override timeouts %u\n",
+           host->commands, host->errors, host->sent, host->deferred, host->overrideTimeouts);
+    printf("Host frames received:        subscribe %u  levels %u  status %u  counters %u  errors %u  console resyncs %u\n",
+           hostFramesByCommand[HOST_CMD_SUBSCRIBE], hostFramesByCommand[HOST_MSG_LEVELS], hostFramesByCommand[HOST_MSG_STATUS],
+           hostFramesByCommand[HOST_CMD_COUNTERS], hostFramesByCommand[HOST_MSG_ERROR], decoder.errors());
+    printf("Host counters:               uptime %u ms  power sent %u  skipped %u  timeouts %u  link failed %u  bus RX errors %u\n",
+           hostCounters.uptimeMs, hostCounters.powerFramesSent, hostCounters.powerFramesSkipped, hostCounters.requestTimeouts,
+           hostCounters.linkFailed, hostCounters.busRxErrors);
+    printSamples("Host command to reply:", hostReplySamples);
+    printSamples("Host level to frame:", hostLevelSamples);
+  }
+  if (calibrateCurve >= 0) {
+    printf("Knob calibrations:           %u stored  errors %u  EEPROM bytes written %u\n", hostCalibrationsStored,
+           hostFramesByCommand[HOST_MSG_ERROR], EEPROM.writes);
+    for (int i = 0; i < numPots; i++) {
+      const KnobCalibration_t* calibration = knobCalibration(i);
+      printf("Knob %d:                      stops %u..%u  off zone %u  curve %u\n", i, calibration->minRaw,
+             calibration->maxRaw, calibration->offZone, calibration->curve);
+    }
+    printf("Knob %d sweep:                %u level changes  up to level %u  %u against the knob\n", narrowKnob, sweepChanges,
+           sweepMaxLevel, sweepWrongWay);
+  }
+#endif
+  std::vector<uint64_t> turnarounds;
+  for (const GeneratorEmulator& emulator : emulators) {
+    turnarounds.insert(turnarounds.end(), emulator.turnaroundSamples.begin(), emulator.turnaroundSamples.end());
+  }
+  printSamples("Response turnaround:", turnarounds);
+  if (powerTiming.bursts > 0) {
+    printf("Knob sample to burst on wire: n=%-6u avg %8.2f  max %8.2f ms\n", powerTiming.bursts,
+           powerTiming.totalMicros / 1000.0 / powerTiming.bursts, powerTiming.maxMicros / 1000.0);
+  }
+
+  for (int bus = 0; bus < GEA_BUS_COUNT; bus++) {
+    const GeaDecoderStats_t& rx = geaBuses[bus].decoder.stats();
+    printf("Firmware RX bus %d:           frames %u  acks %u  CRC errors %u  framing errors %u  oversized %u  queue overruns %u  UART overruns %u\n",
+           bus, rx.frames, rx.acks, rx.crcErrors, rx.framingErrors, rx.oversized, rx.overruns, geaTransports[bus].uart().rxOverruns);
+  }
+
+#ifdef LATENCY_PROBES
+  printProbes();
+#endif
+
+  const GeaTransactionStats_t& txn = geaTransactionStats();
+  printf("Transactions:                requests %u  completed %u  timeouts %u  busy %u  unsolicited %u  unhandled %u  foreign %u\n",
+         txn.requests, txn.completed, txn.timeouts, txn.busy, txn.unsolicited, txn.unhandled, txn.foreign);
+
+  static const char* const txClasses[GEA_PRIORITY_COUNT] = {"control", "telemetry", "diagnostic"};
+  const GeaTxClassStats_t* burst = geaTxBurstStats();
+  printf("TX power bursts:             frames %u  max wait %.2f ms (%u byte-times, bound %u)\n", burst->sent,
+         burst->maxWaitMicros / 1000.0, (unsigned)((burst->maxWaitMicros + GEA_BYTE_MICROS - 1) / GEA_BYTE_MICROS), GEA_TX_POWER_MAX_WAIT_BYTES);
+  for (int i = 0; i < GEA_PRIORITY_COUNT; i++) {
+    const GeaTxClassStats_t* tx = geaTxStats((GeaPriority)i);
+    printf("TX queue %-11s         sent %u  coalesced %u  dropped %u  max wait %.2f ms\n", txClasses[i], tx->sent, tx->coalesced,
+           tx->dropped, tx->maxWaitMicros / 1000.0);
+  }
+
+  printf("Bus collisions:              %u bytes corrupted  %u frames sent untracked\n", hostStats.collisions, geaLinkUntracked());
+  for (int i = 0; i < geaLinkBoardCount(); i++) {
+    const GeaLinkStats_t* link = geaLinkBoard(i);
+    printf("Link 0x%02X:                   frames %u  acked %u  retries %u  collisions %u  ACK timeouts %u  failed %u  superseded %u\n",
+           link->address, link->frames, link->acked, link->retries, link->collisions, link->ackTimeouts, link->failed, link->superseded);
+  }
+
+  for (int i = 0; i < telemetryBoardCount(); i++) {
+    const BoardTelemetry_t* board = telemetryBoard(i);
+    const ThermalBoard_t* thermal = thermalBoard(i);
+    printf("Telemetry 0x%02X:              requests %u  responses %u  timeouts %u  age %u ms%s  coils %u/%u F  interval %u ms  slopes %d/%d F/min\n",
+           board->address, board->requests, board->responses, board->timeouts, (unsigned)(millis() - board->receivedMs),
+           board->stale ? " (stale)" : "", board->status.coil0_temp, board->status.coil1_temp, thermal->intervalMs,
+           thermal->coilSlope, thermal->bridgeSlope);
+  }
+  static const char* fanNames[] = {"off", "low", "high"};
+  printf("Fan:                         %s  %u changes  pins low %d high %d\n", fanNames[thermalFanSpeed()], thermalFanChanges(),
+         hostDigitalOutput(fanLowPin), hostDigitalOutput(fanHighPin));
+
+  for (int bus = 0; bus < GEA_BUS_COUNT; bus++) {
+    for (int i = 0; i < EMULATED_BOARDS; i++) {
+      EmulatedBoard_t* board = emulators[bus].boardAt(i);
+      if (board->framesReceived == 0) {
+        continue;
+      }
+      printf("Board 0x%02X on bus %d:         frames %u  ACKs %u  power %u  status %u  keepalive timeouts %u  coils %.0f/%.0f F\n",
+             board->address, bus, board->framesReceived, board->acksSent, board->powerFrames, board->statusRequests,
+             board->keepaliveTimeouts, board->coilTemp[0], board->coilTemp[1]);
+    }
+  }
+
+  if (captureFile != NULL) {
+    fclose(captureFile);
+  }
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Host microbenchmark for the CRC16 table strategies.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++17 -I. host/crc16_bench.cpp crc16.cpp -o host/crc16_bench && host/crc16_bench
+ *
+ * Cycles are read from the TSC on x86, so they are reference cycles rather than core cycles.
+ * On other hosts only ns/byte is reported.
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "crc16.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static inline uint64_t readCycles() { return __rdtsc(); }
+#else
+#define HAVE_CYCLE_COUNTER 0
+static inline uint64_t readCycles() { return 0; }
+#endif
+
+// Typical GEA frame sizes, plus one large buffer to show the steady-state rate
+static const size_t frameSizes[] = {7, 10, 28, 255, 4096};
+static const int iterations = 20000;
+
+static uint8_t buffer[4096];
+
+template <int Strategy>
+static void runBenchmark(const char* name) {
+  for (size_t s = 0; s < sizeof(frameSizes) / sizeof(frameSizes[0]); s++) {
+    size_t length = frameSizes[s];
+    volatile uint16_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startCycles = readCycles();
+
+    for (int i = 0; i < iterations; i++) {
+      sink = sink + Crc16Engine<Strategy>::update(Crc16Init(), buffer, length);
+    }
+
+    uint64_t cycles = readCycles() - startCycles;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double bytes = (double)length * iterations;
+
+    printf("%-7s %5zu bytes: %6.2f ns/byte", name, length, ns / bytes);
+    if (HAVE_CYCLE_COUNTER) {
+      printf(", %6.2f cycles/byte", cycles / bytes);
+    }
+    printf("\n");
+  }
+}
+
+int main() {
+  for (size_t i = 0; i < sizeof(buffer); i++) {
+    buffer[i] = rand();
+  }
+
+  uint16_t nibble = Crc16Engine<CRC16_TABLE_NIBBLE>::update(Crc16Init(), buffer, sizeof(buffer));
+  uint16_t byte = Crc16Engine<CRC16_TABLE_BYTE>::update(Crc16Init(), buffer, sizeof(buffer));
+  uint16_t slice4 = Crc16Engine<CRC16_TABLE_SLICE4>::update(Crc16Init(), buffer, sizeof(buffer));
+  if (nibble != byte || byte != slice4) {
+    printf("E: CRC strategies disagree: %04X %04X %04X\n", nibble, byte, slice4);
+    return 1;
+  }
+
+  runBenchmark<CRC16_TABLE_NIBBLE>("nibble");
+  runBenchmark<CRC16_TABLE_BYTE>("byte");
+  runBenchmark<CRC16_TABLE_SLICE4>("slice4");
+  return 0;
+}
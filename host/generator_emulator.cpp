@@ -0,0 +1,228 @@
+#include <math.h>
+#include "generator_emulator.h"
+#include "config.h"
+
+static const double ambientTemp = 77.0;
+// Steady-state temperature rise per power step, and the thermal time constant, in seconds
+static const double coilRisePerStep = 12.0;
+static const double halfBridgeRisePerStep = 5.0;
+static const double coilTimeConstant = 60.0;
+static const double halfBridgeTimeConstant = 20.0;
+// Each board takes a little longer to boot than the one before it
+static const uint64_t bootMicros = 300000;
+static const uint64_t bootStaggerMicros = 40000;
+
+GeneratorEmulator::GeneratorEmulator()
+  : frameObserver(NULL),
+    turnaroundMicros(2000),
+    keepaliveTimeoutMicros(2000000),
+    sendAcks(true),
+    acksOwed(0),
+    bytesLeftInResponse(0),
+    responseRequestEndMicros(0),
+    nextKeepaliveCheck(0) {
+  static const uint8_t addresses[EMULATED_BOARDS] = {GEN1_ADDR, GEN2_ADDR, GEN3_ADDR};
+
+  for (int i = 0; i < EMULATED_BOARDS; i++) {
+    EmulatedBoard_t* board = &boards[i];
+    memset(board, 0, sizeof(*board));
+    board->address = addresses[i];
+    board->present = true;
+    board->bootMicros = bootMicros + bootStaggerMicros * i;
+    board->coilTemp[0] = board->coilTemp[1] = ambientTemp;
+    board->halfBridgeTemp[0] = board->halfBridgeTemp[1] = ambientTemp;
+    board->acLineVoltage = 240;
+    board->version.crit_major = 1;
+    board->version.crit_minor = 2;
+    board->version.noncrit_major = 3;
+    board->version.noncrit_minor = i;
+  }
+}
+
+EmulatedBoard_t* GeneratorEmulator::board(uint8_t address) {
+  for (int i = 0; i < EMULATED_BOARDS; i++) {
+    if (boards[i].address == address) {
+      return &boards[i];
+    }
+  }
+  return NULL;
+}
+
+void GeneratorEmulator::powerOn(uint64_t nowMicros) {
+  for (int i = 0; i < EMULATED_BOARDS; i++) {
+    boards[i].powered = true;
+    boards[i].poweredAtMicros = nowMicros;
+  }
+}
+
+void GeneratorEmulator::onByte(uint8_t value, uint64_t nowMicros) {
+  if (decoder.feed(value)) {
+    const GeaFrame_t* frame = decoder.peek();
+    handleFrame(frame, nowMicros);
+    decoder.pop();
+  }
+}
+
+bool GeneratorEmulator::txPending() {
+  return !txBytes.empty();
+}
+
+uint8_t GeneratorEmulator::txPop() {
+  uint8_t value = txBytes.front();
+  txBytes.pop_front();
+
+  if (bytesLeftInResponse > 0 && --bytesLeftInResponse == 0) {
+    // txPop() is called as the byte starts, so the frame ends one byte-time from now
+    uint64_t end = hostNowMicros() + hostByteMicros(GEA_BAUD_RATE);
+    turnaroundSamples.push_back(end - responseRequestEndMicros);
+  }
+
+  return value;
+}
+
+uint64_t GeneratorEmulator::nextEventMicros() {
+  uint64_t next = nextKeepaliveCheck;
+
+  // ACKs go out ahead of any waiting response, but never in the middle of one
+  if (acksOwed > 0 && txBytes.empty()) {
+    return 0;
+  }
+
+  // Only one response goes out at a time; the next one waits until the last has left
+  if (!pending.empty() && txBytes.empty() && pending.front().readyAt < next) {
+    next = pending.front().readyAt;
+  }
+  return next;
+}
+
+void GeneratorEmulator::service(uint64_t nowMicros) {
+  if (acksOwed > 0 && txBytes.empty()) {
+    txBytes.push_back(GEA_ACK);
+    acksOwed--;
+  } else if (!pending.empty() && txBytes.empty() && pending.front().readyAt <= nowMicros) {
+    PendingResponse_t& response = pending.front();
+    txBytes.insert(txBytes.end(), response.bytes.begin(), response.bytes.end());
+    bytesLeftInResponse = response.bytes.size();
+    responseRequestEndMicros = response.requestEndMicros;
+    pending.pop_front();
+  }
+
+  if (nowMicros >= nextKeepaliveCheck) {
+    checkKeepalives(nowMicros);
+    nextKeepaliveCheck = nowMicros + 10000;
+  }
+}
+
+void GeneratorEmulator::handleFrame(const GeaFrame_t* frame, uint64_t nowMicros) {
+  if (frameObserver != NULL) {
+    frameObserver(frame, nowMicros);
+  }
+
+  EmulatedBoard_t* board = this->board(GeaFrameDestination(frame));
+  if (board == NULL || !board->present || !board->powered || nowMicros - board->poweredAtMicros < board->bootMicros) {
+    return;
+  }
+
+  board->framesReceived++;
+  if (sendAcks) {
+    board->acksSent++;
+    acksOwed++;
+  }
+  updateThermals(board, nowMicros);
+
+  const uint8_t* payload = GeaFramePayload(frame);
+  uint8_t payloadLength = GeaFramePayloadLength(frame);
+
+  switch (GeaFrameCommand(frame)) {
+    case CMD_GET_SW_VERSION: {
+      uint8_t response[RESP_LENGTH_SW_VERSION] = {
+        board->version.crit_major, board->version.crit_minor,
+        board->version.noncrit_major, board->version.noncrit_minor
+      };
+      respond(board, CMD_GET_SW_VERSION, response, sizeof(response), nowMicros);
+      break;
+    }
+    case CMD_SET_BOARD_CONFIG:
+      if (payloadLength >= sizeof(BoardConfigPayload_t)) {
+        board->coilProfile[0] = payload[0];
+        board->coilProfile[1] = payload[1];
+        board->configured = true;
+      }
+      respond(board, CMD_SET_BOARD_CONFIG, NULL, RESP_LENGTH_BOARD_CONFIG, nowMicros);
+      break;
+    case CMD_SET_PWR_LEVELS: {
+      if (payloadLength >= sizeof(SetPowerLevelsPayload_t)) {
+        board->coilLevel[0] = board->coilProfile[0] != COIL_TYPE_NONE ? payload[0] : 0;
+        board->coilLevel[1] = board->coilProfile[1] != COIL_TYPE_NONE ? payload[1] : 0;
+        board->heartbeat = payload[2];
+        board->lastPowerFrameMicros = nowMicros;
+        board->powerFrames++;
+      }
+      uint8_t response[RESP_LENGTH_PWR_LEVELS] = {board->coilLevel[0], board->coilLevel[1]};
+      respond(board, CMD_SET_PWR_LEVELS, response, sizeof(response), nowMicros);
+      break;
+    }
+    case CMD_GET_STATUS: {
+      uint16_t fields[RESP_LENGTH_STATUS / 2] = {
+        0, 0, 0, 0, 0,
+        (uint16_t)board->halfBridgeTemp[0], (uint16_t)board->coilTemp[0],
+        (uint16_t)board->halfBridgeTemp[1], (uint16_t)board->coilTemp[1],
+        board->acLineVoltage
+      };
+      uint8_t response[RESP_LENGTH_STATUS];
+      for (int i = 0; i < RESP_LENGTH_STATUS / 2; i++) {
+        response[2 * i] = fields[i] >> 8;
+        response[2 * i + 1] = fields[i] & 0xFF;
+      }
+      board->statusRequests++;
+      respond(board, CMD_GET_STATUS, response, sizeof(response), nowMicros);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void GeneratorEmulator::respond(EmulatedBoard_t* board, uint8_t command, const uint8_t* payload, uint8_t payloadLength, uint64_t nowMicros) {
+  uint8_t buffer[GEA_MAX_ESCAPED_FRAME_SIZE];
+  GeaFrameWriter writer(buffer, sizeof(buffer));
+
+  writer.begin(LOCAL_ADDR, command, payloadLength, board->address);
+  writer.write(payload, payloadLength);
+  size_t length = writer.end();
+
+  PendingResponse_t response;
+  response.readyAt = nowMicros + turnaroundMicros;
+  response.requestEndMicros = nowMicros;
+  response.bytes.insert(response.bytes.end(), buffer, buffer + length);
+  pending.push_back(response);
+}
+
+/*
+ * @brief First-order thermal model: each temperature approaches ambient plus a rise proportional to its coil level.
+ */
+void GeneratorEmulator::updateThermals(EmulatedBoard_t* board, uint64_t nowMicros) {
+  double dt = (nowMicros - board->lastThermalUpdateMicros) / 1e6;
+  board->lastThermalUpdateMicros = nowMicros;
+
+  for (int coil = 0; coil < 2; coil++) {
+    double coilTarget = ambientTemp + coilRisePerStep * board->coilLevel[coil];
+    double bridgeTarget = ambientTemp + halfBridgeRisePerStep * board->coilLevel[coil];
+    board->coilTemp[coil] += (coilTarget - board->coilTemp[coil]) * (1.0 - exp(-dt / coilTimeConstant));
+    board->halfBridgeTemp[coil] += (bridgeTarget - board->halfBridgeTemp[coil]) * (1.0 - exp(-dt / halfBridgeTimeConstant));
+  }
+}
+
+void GeneratorEmulator::checkKeepalives(uint64_t nowMicros) {
+  for (int i = 0; i < EMULATED_BOARDS; i++) {
+    EmulatedBoard_t* board = &boards[i];
+    bool heating = board->coilLevel[0] > 0 || board->coilLevel[1] > 0;
+
+    if (heating && nowMicros - board->lastPowerFrameMicros > keepaliveTimeoutMicros) {
+      updateThermals(board, nowMicros);
+      board->coilLevel[0] = 0;
+      board->coilLevel[1] = 0;
+      board->keepaliveTimeouts++;
+    }
+  }
+}
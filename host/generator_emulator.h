@@ -0,0 +1,94 @@
+#ifndef __GENERATOR_EMULATOR_H__
+#define __GENERATOR_EMULATOR_H__
+
+#include <deque>
+#include <vector>
+#include "host_runtime.h"
+#include "gea_core.h"
+#include "generator_board.h"
+
+#define EMULATED_BOARDS 3
+
+/*
+ * State of one emulated generator board.
+ */
+typedef struct {
+  uint8_t address;
+  bool present;
+  bool powered;
+  uint64_t poweredAtMicros;
+  uint64_t bootMicros; //    From power on until the board's firmware answers anything
+  bool configured;
+  uint8_t coilProfile[2];
+  uint8_t coilLevel[2];
+  uint8_t heartbeat;
+  uint64_t lastPowerFrameMicros;
+  uint64_t lastThermalUpdateMicros;
+  double coilTemp[2];
+  double halfBridgeTemp[2];
+  uint16_t acLineVoltage;
+  SoftwareVersion_t version;
+
+  uint32_t framesReceived;
+  uint32_t acksSent;
+  uint32_t powerFrames;
+  uint32_t statusRequests;
+  uint32_t keepaliveTimeouts;
+} EmulatedBoard_t;
+
+/*
+ * Emulates the generator boards at GEN1_ADDR..GEN3_ADDR on one GEA bus. With several buses, each
+ * gets its own emulator, and a board only hears and answers frames on the bus it's addressed on. Each board ACKs frames
+ * addressed to it as soon as the bus is free, and answers CMD_GET_SW_VERSION, CMD_SET_BOARD_CONFIG,
+ * CMD_SET_PWR_LEVELS and CMD_GET_STATUS after turnaroundMicros. Boards stay deaf, without even an ACK, until
+ * bootMicros after powerOn(), which the simulator calls when the firmware closes the relay. Boards drop their coils to 0 if no power frame arrives
+ * within keepaliveTimeoutMicros, like the real boards do when the control stops talking to them.
+ */
+class GeneratorEmulator : public HostBusDevice {
+  public:
+    GeneratorEmulator();
+
+    EmulatedBoard_t* board(uint8_t address);
+    EmulatedBoard_t* boardAt(int index) { return &boards[index]; }
+    void powerOn(uint64_t nowMicros);
+
+    void onByte(uint8_t value, uint64_t nowMicros) override;
+    bool txPending() override;
+    uint8_t txPop() override;
+    uint64_t nextEventMicros() override;
+    void service(uint64_t nowMicros) override;
+
+    // Called for every valid frame the MCU sends, once its EOF is on the wire
+    void (*frameObserver)(const GeaFrame_t* frame, uint64_t nowMicros);
+
+    uint64_t turnaroundMicros;
+    uint64_t keepaliveTimeoutMicros;
+    bool sendAcks;
+
+    // Request EOF to response EOF, one sample per response
+    std::vector<uint64_t> turnaroundSamples;
+    const GeaDecoderStats_t& decoderStats() const { return decoder.stats(); }
+
+  private:
+    typedef struct {
+      uint64_t readyAt;
+      uint64_t requestEndMicros;
+      std::vector<uint8_t> bytes;
+    } PendingResponse_t;
+
+    void handleFrame(const GeaFrame_t* frame, uint64_t nowMicros);
+    void respond(EmulatedBoard_t* board, uint8_t command, const uint8_t* payload, uint8_t payloadLength, uint64_t nowMicros);
+    void updateThermals(EmulatedBoard_t* board, uint64_t nowMicros);
+    void checkKeepalives(uint64_t nowMicros);
+
+    EmulatedBoard_t boards[EMULATED_BOARDS];
+    GeaFrameDecoder decoder;
+    std::deque<PendingResponse_t> pending;
+    std::deque<uint8_t> txBytes;
+    uint32_t acksOwed;
+    size_t bytesLeftInResponse;
+    uint64_t responseRequestEndMicros;
+    uint64_t nextKeepaliveCheck;
+};
+
+#endif
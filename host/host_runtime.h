@@ -0,0 +1,82 @@
+#ifndef __HOST_RUNTIME_H__
+#define __HOST_RUNTIME_H__
+
+#include "Arduino.h"
+
+/*
+ * Something attached to the GEA bus on the far side of the transceiver, e.g. the generator board
+ * emulator. The runtime hands it every byte the MCU puts on the wire, and pulls bytes from it
+ * whenever the wire is idle.
+ */
+class HostBusDevice {
+  public:
+    virtual ~HostBusDevice() {}
+    virtual void onByte(uint8_t value, uint64_t nowMicros) = 0;
+    virtual bool txPending() = 0;
+    virtual uint8_t txPop() = 0;
+    // Next time the device needs service(), or UINT64_MAX
+    virtual uint64_t nextEventMicros() = 0;
+    virtual void service(uint64_t nowMicros) = 0;
+};
+
+// UARTs made with pins (Serial1 and any others the sketch declares) are GEA buses, numbered in the order they're constructed
+#define HOST_MAX_BUSES 3
+
+/*
+ * Wire and CPU counters collected by the runtime, over all buses.
+ */
+typedef struct {
+  uint64_t mcuBusyMicros;
+  uint64_t deviceBusyMicros;
+  uint32_t mcuBytes;
+  uint32_t deviceBytes;
+  uint64_t busWriteBlockedMicros;
+  uint64_t consoleWriteBlockedMicros;
+  uint32_t consoleBytes;
+  uint32_t collisions;
+} HostStats_t;
+
+extern HostStats_t hostStats;
+
+/*
+ * Wire counters for one bus.
+ */
+typedef struct {
+  uint64_t mcuBusyMicros;
+  uint64_t deviceBusyMicros;
+  uint32_t mcuBytes;
+  uint32_t deviceBytes;
+} HostBusStats_t;
+
+extern HostBusStats_t hostBusStats[HOST_MAX_BUSES];
+
+// Echo every byte the MCU sends back into its own RX, like a half-duplex transceiver does
+extern bool hostBusEcho;
+// Chance that each byte the MCU sends is corrupted on the wire, as if another node talked over it
+extern double hostBusCollisionRate;
+// Virtual CPU time charged for each call to loop()
+extern uint32_t hostLoopCostMicros;
+// Peak-to-peak random noise added to every analogRead(), in counts
+extern int hostAnalogNoise;
+
+uint64_t hostNowMicros();
+void hostAdvance(uint64_t micros);
+void hostAdvanceTo(uint64_t micros);
+
+void hostAttachBusDevice(HostBusDevice* device, int bus = 0);
+int hostBusCount();
+void hostSetConsoleOutput(FILE* output);
+// Called for each console byte as it finishes on the wire
+void hostSetConsoleObserver(void (*observer)(uint8_t value));
+// Called for each MCU byte as it finishes on the bus's wire
+void hostSetBusTxObserver(void (*observer)(uint8_t value, uint64_t nowMicros), int bus = 0);
+// Called for every byte on the bus, from either side, as it finishes on the wire
+void hostSetBusObserver(void (*observer)(uint8_t value, uint64_t nowMicros), int bus = 0);
+
+void hostSetAnalog(int pin, int value);
+void hostSetDigitalInput(int pin, int value);
+int hostDigitalOutput(int pin);
+
+uint64_t hostByteMicros(unsigned long baud);
+
+#endif
@@ -0,0 +1,114 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "host_transport.h"
+
+void GeaLoopbackTransport::inject(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (count == sizeof(ring)) {
+      overruns++;
+      continue;
+    }
+    ring[(head + count++) % sizeof(ring)] = data[i];
+  }
+}
+
+int GeaLoopbackTransport::read() {
+  if (count == 0) {
+    return -1;
+  }
+
+  uint8_t value = ring[head];
+  head = (head + 1) % sizeof(ring);
+  count--;
+  return value;
+}
+
+size_t GeaLoopbackTransport::write(const uint8_t* data, size_t length) {
+  peer->inject(data, length);
+  if (echo && peer != this) {
+    inject(data, length);
+  }
+  return length;
+}
+
+GeaPtyTransport::~GeaPtyTransport() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+/*
+ * @brief Create the pseudo-terminal. Returns false, with errno set, if that failed.
+ */
+bool GeaPtyTransport::open() {
+  fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    return false;
+  }
+  if (grantpt(fd) != 0 || unlockpt(fd) != 0) {
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  // Settings made on the master apply to the slave's line discipline
+  struct termios settings;
+  if (tcgetattr(fd, &settings) == 0) {
+    cfmakeraw(&settings);
+    tcsetattr(fd, TCSANOW, &settings);
+  }
+  return true;
+}
+
+const char* GeaPtyTransport::path() const {
+  return fd >= 0 ? ptsname(fd) : NULL;
+}
+
+void GeaPtyTransport::fill() {
+  if (fd < 0 || rxPosition < rxLength) {
+    return;
+  }
+
+  // Fails with EAGAIN when there's nothing to read, and with EIO while no one has the slave open
+  ssize_t count = ::read(fd, rxBuffer, sizeof(rxBuffer));
+  rxLength = count > 0 ? count : 0;
+  rxPosition = 0;
+}
+
+int GeaPtyTransport::available() {
+  fill();
+  return rxLength - rxPosition;
+}
+
+int GeaPtyTransport::read() {
+  fill();
+  return rxPosition < rxLength ? rxBuffer[rxPosition++] : -1;
+}
+
+int GeaPtyTransport::availableForWrite() {
+  struct pollfd ready = {fd, POLLOUT, 0};
+  return fd >= 0 && poll(&ready, 1, 0) == 1 && (ready.revents & POLLOUT) ? SERIAL_TX_BUFFER_SIZE : 0;
+}
+
+size_t GeaPtyTransport::write(const uint8_t* data, size_t length) {
+  size_t written = 0;
+
+  while (fd >= 0 && written < length) {
+    ssize_t count = ::write(fd, data + written, length - written);
+    if (count > 0) {
+      written += count;
+    } else if (count < 0 && errno == EAGAIN) {
+      // Nobody is draining the other end; drop the rest rather than hang
+      struct pollfd ready = {fd, POLLOUT, 0};
+      if (poll(&ready, 1, 100) != 1) {
+        break;
+      }
+    } else {
+      break;
+    }
+  }
+  return written;
+}
@@ -0,0 +1,64 @@
+#ifndef __HOST_TRANSPORT_H__
+#define __HOST_TRANSPORT_H__
+
+#include "gea_transport.h"
+
+/*
+ * In-memory GEA transport. Bytes written to one end come out of the other end it's connected to,
+ * or out of the same end if it was never connected. With echo set, written bytes also come back
+ * out of the writing end, the way the half-duplex transceiver plays our own frames back. Each end
+ * receives into a fixed ring, so nothing is allocated per byte, and bytes that don't fit are
+ * dropped and counted like a UART overrun.
+ */
+class GeaLoopbackTransport : public GeaTransport {
+  public:
+    GeaLoopbackTransport() : echo(false), overruns(0), peer(this), head(0), count(0) {}
+
+    void connect(GeaLoopbackTransport& other) { peer = &other; other.peer = this; }
+    // Queue bytes to be read from this end, as if they had arrived on the bus
+    void inject(const uint8_t* data, size_t length);
+
+    int available() override { return count; }
+    int read() override;
+    int availableForWrite() override { return sizeof(ring) - peer->count; }
+    size_t write(const uint8_t* data, size_t length) override;
+
+    bool echo;
+    uint32_t overruns;
+
+  private:
+    GeaLoopbackTransport* peer;
+    uint8_t ring[4096];
+    size_t head;
+    size_t count;
+};
+
+/*
+ * GEA transport on the master side of a pseudo-terminal, so any program that can open a serial
+ * port (a terminal, a logic analyzer's serial decoder, a bus tool) can sit on the other end at
+ * path(). The slave is put in raw mode. Reads never block, and writes wait for the reader to
+ * make room, but give up on bytes nobody reads within 100 ms.
+ */
+class GeaPtyTransport : public GeaTransport {
+  public:
+    GeaPtyTransport() : fd(-1), rxLength(0), rxPosition(0) {}
+    ~GeaPtyTransport();
+
+    bool open();
+    const char* path() const;
+
+    int available() override;
+    int read() override;
+    int availableForWrite() override;
+    size_t write(const uint8_t* data, size_t length) override;
+
+  private:
+    void fill();
+
+    int fd;
+    uint8_t rxBuffer[256];
+    size_t rxLength;
+    size_t rxPosition;
+};
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Decodes a capture of the firmware's binary console log into text.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++17 -funsigned-char -Ihost -I. host/log_decode.cpp host/log_decoder.cpp -o host/log_decode
+ *   host/log_decode [capture.bin]
+ *
+ * Reads standard input when no file is given, so it also works on a live port, e.g.
+ *   stty -F /dev/ttyACM0 115200 raw && host/log_decode < /dev/ttyACM0
+ */
+
+#include "log_decoder.h"
+
+int main(int argc, char** argv) {
+  FILE* input = stdin;
+
+  if (argc > 1) {
+    input = fopen(argv[1], "rb");
+    if (input == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  LogDecoder decoder(stdout);
+  int value;
+  while ((value = fgetc(input)) != EOF) {
+    decoder.feed(value);
+  }
+
+  if (decoder.errors() > 0) {
+    fprintf(stderr, "%u records decoded, %u resyncs\n", decoder.records(), decoder.errors());
+  }
+
+  return 0;
+}
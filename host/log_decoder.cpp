@@ -0,0 +1,101 @@
+#include "log_decoder.h"
+
+#define LOG_EVENT_FORMAT(id, format) format,
+
+static const char* const eventFormats[] = {
+  LOG_EVENT_LIST(LOG_EVENT_FORMAT)
+};
+
+LogDecoder::LogDecoder(FILE* output)
+  : state(STATE_SYNC), output(output), valueIndex(0), valueShift(0), value(0), recordCount(0), errorCount(0), frameCount(0) {
+}
+
+void LogDecoder::feed(uint8_t byte) {
+  switch (state) {
+    case STATE_SYNC:
+      if (byte == LOG_SYNC) {
+        state = STATE_ID;
+      } else if (byte == GEA_SOF) {
+        state = STATE_FRAME;
+        frameCount++;
+      }
+      break;
+    case STATE_FRAME:
+      if (byte == GEA_EOF) {
+        state = STATE_SYNC;
+      }
+      break;
+    case STATE_ID:
+      if (byte >= LOG_EVENT_COUNT) {
+        errorCount++;
+        state = byte == LOG_SYNC ? STATE_ID : STATE_SYNC;
+        break;
+      }
+      record.id = byte;
+      state = STATE_HEADER;
+      break;
+    case STATE_HEADER:
+      record.level = byte >> 4;
+      record.argc = byte & 0x0F;
+      if (record.level >= LOG_LEVEL_NONE || record.argc > LOG_MAX_ARGS) {
+        errorCount++;
+        state = byte == LOG_SYNC ? STATE_ID : STATE_SYNC;
+        break;
+      }
+      valueIndex = 0;
+      valueShift = 0;
+      value = 0;
+      state = STATE_VALUES;
+      break;
+    case STATE_VALUES:
+      if (valueShift > 28) {
+        errorCount++;
+        state = STATE_SYNC;
+        break;
+      }
+      value |= (uint32_t)(byte & 0x7F) << valueShift;
+      valueShift += 7;
+      if ((byte & 0x80) == 0) {
+        finishValue();
+      }
+      break;
+  }
+}
+
+/*
+ * @brief Store a completed varint: the timestamp first, then the arguments.
+ */
+void LogDecoder::finishValue() {
+  if (valueIndex == 0) {
+    record.timestamp = value;
+  } else {
+    record.args[valueIndex - 1] = value;
+  }
+
+  valueIndex++;
+  valueShift = 0;
+  value = 0;
+
+  if (valueIndex > record.argc) {
+    print();
+    state = STATE_SYNC;
+  }
+}
+
+void LogDecoder::print() {
+  uint32_t args[LOG_MAX_ARGS] = {0};
+  for (uint8_t i = 0; i < record.argc; i++) {
+    args[i] = record.args[i];
+  }
+
+  recordCount++;
+  if (output == NULL) {
+    return;
+  }
+
+  fprintf(output, "[%10.3f] ", record.timestamp / 1000.0);
+  // Unused trailing arguments are ignored by fprintf
+  fprintf(output, eventFormats[record.id], (unsigned)args[0], (unsigned)args[1], (unsigned)args[2],
+          (unsigned)args[3], (unsigned)args[4], (unsigned)args[5]);
+  fputc('\n', output);
+}
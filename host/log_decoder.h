@@ -0,0 +1,46 @@
+#ifndef __LOG_DECODER_H__
+#define __LOG_DECODER_H__
+
+#include <stdio.h>
+#include "log.h"
+#include "gea_core.h"
+
+/*
+ * Turns the firmware's binary console records back into the text lines they stand for, using the
+ * formats in log_events.h. Bytes that don't parse as a record are skipped until the next LOG_SYNC.
+ * Host control frames (host_control.h) only ever start between records, so a GEA_SOF there is
+ * skipped through its GEA_EOF.
+ */
+class LogDecoder {
+  public:
+    LogDecoder(FILE* output);
+    void feed(uint8_t value);
+    uint32_t records() const { return recordCount; }
+    uint32_t errors() const { return errorCount; }
+    uint32_t frames() const { return frameCount; }
+    // Between records, so the next byte starts a record or a host control frame
+    bool idle() const { return state == STATE_SYNC; }
+
+  private:
+    enum {
+      STATE_SYNC,
+      STATE_ID,
+      STATE_HEADER,
+      STATE_VALUES,
+      STATE_FRAME
+    } state;
+
+    FILE* output;
+    LogRecord_t record;
+    uint8_t valueIndex;
+    uint8_t valueShift;
+    uint32_t value;
+    uint32_t recordCount;
+    uint32_t errorCount;
+    uint32_t frameCount;
+
+    void finishValue();
+    void print();
+};
+
+#endif
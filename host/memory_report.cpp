@@ -0,0 +1,344 @@
+/*
+ * Reports static RAM and worst-case stack use per subsystem, from a firmware build made with GCC's
+ * call graph output (-fcallgraph-info=su, GCC 10 or later).
+ *
+ * Build from the repository root:
+ *   g++ -O2 -std=gnu++17 host/memory_report.cpp -o host/memory_report
+ *
+ * Then build the firmware with the extra flag and point the report at the sketch's objects, e.g.
+ *   arduino-cli compile -b STMicroelectronics:stm32:Nucleo_64 --build-path build \
+ *     --build-property "compiler.cpp.extra_flags=-fcallgraph-info=su"
+ *   host/memory_report --nm arm-none-eabi-nm build/sketch
+ *
+ * Each object file (gea_core.cpp.o, ...) is one subsystem. Its static RAM is the size of its data
+ * and bss symbols. GCC writes a .ci call graph with every function's frame size next to each object.
+ * From that come the largest single frame in each subsystem and its deepest call chain: the frames
+ * added up along the worst path from any function it defines. Calls through function pointers
+ * (scheduler tasks, GEA handlers and response callbacks) are charged as the deepest chain of any
+ * function that is never called directly. Library functions without a call graph count as zero, and
+ * recursion is reported rather than followed. The peak for the whole firmware is the deeper of
+ * setup() and loop(), plus whatever interrupts add on top.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+typedef struct {
+  std::string name;
+  std::string subsystem;
+  uint32_t frame;
+  bool dynamic;
+  bool defined;
+  uint32_t callers;
+  std::set<std::string> callees;
+} Function_t;
+
+typedef struct {
+  uint32_t staticBytes;
+  std::string largestFunction;
+  uint32_t largestFrame;
+  std::string deepestFunction;
+  uint32_t deepestStack;
+} Subsystem_t;
+
+static const char* indirectCall = "__indirect_call";
+
+static std::map<std::string, Function_t> functions;
+static std::map<std::string, Subsystem_t> subsystems;
+static std::map<std::string, uint32_t> depths;
+static std::map<std::string, std::string> deepestCallee;
+// Functions on the current path, with how many function pointer calls were made above each
+static std::map<std::string, int> visiting;
+static int pointerCalls;
+static bool recursion;
+
+static bool endsWith(const std::string& text, const char* suffix) {
+  size_t length = strlen(suffix);
+  return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+/*
+ * @brief gea_core.cpp.o -> gea_core, and the sketch's .ino.cpp.o likewise.
+ */
+static std::string subsystemName(std::string file) {
+  for (const char* suffix : {".o", ".ci", ".cpp", ".ino", ".c"}) {
+    if (endsWith(file, suffix)) {
+      file.resize(file.size() - strlen(suffix));
+    }
+  }
+  return file;
+}
+
+/*
+ * @brief The quoted value after key in a VCG line, with \n escapes left as they are.
+ */
+static std::string field(const std::string& line, const char* key) {
+  size_t start = line.find(key);
+  if (start == std::string::npos) {
+    return "";
+  }
+  start = line.find('"', start);
+  size_t end = start;
+  while ((end = line.find('"', end + 1)) != std::string::npos && line[end - 1] == '\\') {
+  }
+  return start == std::string::npos || end == std::string::npos ? "" : line.substr(start + 1, end - start - 1);
+}
+
+static void readCallGraph(const std::string& path, const std::string& subsystem) {
+  FILE* input = fopen(path.c_str(), "r");
+  if (input == NULL) {
+    perror(path.c_str());
+    return;
+  }
+
+  char buffer[4096];
+  while (fgets(buffer, sizeof(buffer), input) != NULL) {
+    std::string line(buffer);
+
+    if (line.compare(0, 5, "node:") == 0) {
+      std::string title = field(line, "title:");
+      std::string label = field(line, "label:");
+      Function_t& function = functions[title];
+      if (function.name.empty()) {
+        function.name = label.substr(0, label.find("\\n"));
+      }
+
+      // Only the defining unit knows the frame size; declarations are drawn as ellipses
+      size_t bytes = label.find(" bytes (");
+      if (bytes == std::string::npos) {
+        continue;
+      }
+      size_t number = label.rfind("\\n", bytes);
+      uint32_t frame = strtoul(label.c_str() + (number == std::string::npos ? 0 : number + 2), NULL, 10);
+      if (!function.defined || frame > function.frame) {
+        function.frame = frame;
+        function.subsystem = subsystem;
+      }
+      function.defined = true;
+      function.dynamic |= label.find("dynamic", bytes) != std::string::npos;
+    } else if (line.compare(0, 5, "edge:") == 0) {
+      std::string source = field(line, "sourcename:");
+      std::string target = field(line, "targetname:");
+      if (functions[source].callees.insert(target).second) {
+        functions[target].callers++;
+      }
+    }
+  }
+
+  fclose(input);
+}
+
+static uint32_t readStaticBytes(const char* nm, const std::string& path) {
+  std::string command = std::string(nm) + " -S -t d --defined-only '" + path + "'";
+  FILE* input = popen(command.c_str(), "r");
+  if (input == NULL) {
+    perror(nm);
+    return 0;
+  }
+
+  uint32_t total = 0;
+  char buffer[1024];
+  while (fgets(buffer, sizeof(buffer), input) != NULL) {
+    char address[64], type[8], name[512];
+    unsigned long size;
+    // Only symbols with a size have four fields
+    if (sscanf(buffer, "%63s %lu %7s %511s", address, &size, type, name) == 4 && strchr("bBdDsSgGC", type[0]) != NULL) {
+      total += size;
+    }
+  }
+
+  pclose(input);
+  return total;
+}
+
+static bool entryPoint(const Function_t& function) {
+  return function.name == "void setup()" || function.name == "void loop()" || function.name == "int main()";
+}
+
+/*
+ * @brief True if a function pointer could lead to title: it's defined, never called directly, and not where the firmware starts.
+ */
+static bool indirectTarget(const std::string& title) {
+  const Function_t& function = functions[title];
+  return function.defined && function.callers == 0 && !entryPoint(function);
+}
+
+/*
+ * @brief True if nothing below title calls through a function pointer, so its depth is the same wherever it's called from.
+ */
+static bool direct(const std::string& title, std::set<std::string>& seen) {
+  if (title == indirectCall) {
+    return false;
+  }
+  if (!seen.insert(title).second) {
+    return true;
+  }
+  for (const std::string& callee : functions[title].callees) {
+    if (!direct(callee, seen)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * @brief Deepest stack from entering title, including its own frame. A function pointer call can land in any indirect
+ * target that isn't already running further up, since none of them re-enter themselves.
+ */
+static uint32_t depth(const std::string& title) {
+  auto memo = depths.find(title);
+  if (memo != depths.end()) {
+    return memo->second;
+  }
+  auto active = visiting.find(title);
+  if (active != visiting.end()) {
+    // Back to a running function through a function pointer isn't a path the firmware takes; a direct loop is recursion
+    if (active->second == pointerCalls) {
+      recursion = true;
+    }
+    return 0;
+  }
+
+  visiting[title] = pointerCalls;
+  deepestCallee.erase(title);
+  const Function_t& function = functions[title];
+  uint32_t deepest = 0;
+  for (const std::string& callee : function.callees) {
+    if (callee == indirectCall) {
+      for (const auto& target : functions) {
+        if (indirectTarget(target.first) && visiting.count(target.first) == 0) {
+          pointerCalls++;
+          uint32_t below = depth(target.first);
+          pointerCalls--;
+          if (below > deepest) {
+            deepest = below;
+            deepestCallee[title] = target.first;
+          }
+        }
+      }
+      continue;
+    }
+    uint32_t below = depth(callee);
+    if (below > deepest) {
+      deepest = below;
+      deepestCallee[title] = callee;
+    }
+  }
+  visiting.erase(title);
+
+  std::set<std::string> seen;
+  if (direct(title, seen)) {
+    depths[title] = function.frame + deepest;
+  }
+  return function.frame + deepest;
+}
+
+static void printChain(std::string title) {
+  while (!title.empty()) {
+    const Function_t& function = functions[title];
+    printf("    %6u  %-14s %s%s\n", function.frame, function.subsystem.c_str(), function.name.c_str(), function.dynamic ? " (dynamic)" : "");
+    auto next = deepestCallee.find(title);
+    if (next != deepestCallee.end() && function.callees.count(next->second) == 0) {
+      printf("            (through a function pointer)\n");
+    }
+    title = next != deepestCallee.end() ? next->second : "";
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* nm = "nm";
+  const char* directory = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--nm") && i + 1 < argc) {
+      nm = argv[++i];
+    } else if (argv[i][0] != '-' && directory == NULL) {
+      directory = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [--nm path/to/nm] build-directory\n", argv[0]);
+      return 1;
+    }
+  }
+  if (directory == NULL) {
+    fprintf(stderr, "Usage: %s [--nm path/to/nm] build-directory\n", argv[0]);
+    return 1;
+  }
+
+  DIR* dir = opendir(directory);
+  if (dir == NULL) {
+    perror(directory);
+    return 1;
+  }
+
+  std::vector<std::string> objects;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (endsWith(entry->d_name, ".o")) {
+      objects.push_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(objects.begin(), objects.end());
+
+  int graphs = 0;
+  for (const std::string& object : objects) {
+    std::string subsystem = subsystemName(object);
+    std::string path = std::string(directory) + "/" + object;
+    std::string graph = path.substr(0, path.size() - 2) + ".ci";
+
+    subsystems[subsystem].staticBytes = readStaticBytes(nm, path);
+    if (FILE* probe = fopen(graph.c_str(), "r")) {
+      fclose(probe);
+      readCallGraph(graph, subsystem);
+      graphs++;
+    }
+  }
+  if (graphs == 0) {
+    fprintf(stderr, "No .ci call graphs found; build with -fcallgraph-info=su to get stack figures\n");
+  }
+
+  for (const auto& function : functions) {
+    if (!function.second.defined) {
+      continue;
+    }
+    Subsystem_t& subsystem = subsystems[function.second.subsystem];
+    if (function.second.frame > subsystem.largestFrame) {
+      subsystem.largestFrame = function.second.frame;
+      subsystem.largestFunction = function.second.name;
+    }
+    uint32_t stack = depth(function.first);
+    if (stack > subsystem.deepestStack) {
+      subsystem.deepestStack = stack;
+      subsystem.deepestFunction = function.first;
+    }
+  }
+
+  uint32_t totalStatic = 0;
+  printf("%-28s %8s %8s %8s  %s\n", "Subsystem", "static", "frame", "stack", "deepest chain starts in");
+  for (const auto& subsystem : subsystems) {
+    totalStatic += subsystem.second.staticBytes;
+    printf("%-28s %8u %8u %8u  %s\n", subsystem.first.c_str(), subsystem.second.staticBytes, subsystem.second.largestFrame,
+           subsystem.second.deepestStack, functions[subsystem.second.deepestFunction].name.c_str());
+  }
+  printf("%-28s %8u\n", "Total", totalStatic);
+
+  for (const auto& function : functions) {
+    if (function.second.defined && entryPoint(function.second)) {
+      // Walked straight after its own depth(), so the chain is the one that was counted
+      printf("\nDeepest stack from %s: %u bytes\n", function.second.name.c_str(), depth(function.first));
+      printChain(function.first);
+    }
+  }
+  if (recursion) {
+    printf("\nWarning: the call graph has recursion, so these stack figures are lower bounds\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,358 @@
+#include "host_control.h"
+#include "gea_transaction.h"
+#include "gea_link.h"
+#include "telemetry.h"
+#include "log.h"
+#include "generator_board.h"
+#include "utils.h"
+
+static GeaFrameDecoder decoder;
+static const Cooktop_t* controlCooktop;
+static const PowerShadow_t* controlShadows;
+static const uint8_t* knobs;
+static void (*consoleCallback)(uint8_t value);
+static uint8_t hostAddress;
+
+static uint8_t overrideMask;
+static uint8_t overrideLevels[numPots];
+static uint32_t overrideMs;
+static uint8_t levels[numPots];
+
+static HostSubscribe_t subscription;
+static uint32_t streamDueMs;
+
+// Replies and stream frames still to go out, and the one frame waiting for room on the console
+static bool subscribePending;
+static bool countersPending;
+static bool levelsPending;
+static uint8_t statusPending; // Bit per telemetry board
+static bool errorPending;
+static HostError_t error;
+static bool calibratePending;
+static HostCalibrate_t calibrateReply;
+static uint8_t frame[GEA_ESCAPED_SIZE(HOST_MAX_PAYLOAD)];
+static size_t frameLength;
+
+static HostControlStats_t counters;
+
+static_assert(numPots <= 8, "overrideMask has a bit per knob");
+static_assert(MAX_TELEMETRY_BOARDS <= 8, "statusPending has a bit per board");
+static_assert(sizeof(decoder) + sizeof(frame) + sizeof(overrideLevels) + sizeof(levels) + sizeof(counters) + 64
+              <= RAM_BUDGET_HOST_CONTROL, "Host control state is over its RAM budget (config.h)");
+
+/*
+ * @brief Write the waiting frame out if the console has room for all of it. Returns true once nothing is waiting.
+ */
+static bool flush() {
+  if (frameLength == 0) {
+    return true;
+  }
+  if (!logConsoleWrite(frame, frameLength)) {
+    counters.deferred++;
+    return false;
+  }
+
+  frameLength = 0;
+  counters.sent++;
+  return true;
+}
+
+static bool send(uint8_t command, const uint8_t* payload, uint8_t payloadLength) {
+  GeaFrameWriter writer(frame, sizeof(frame));
+  writer.begin(hostAddress, command, payloadLength);
+  writer.write(payload, payloadLength);
+  frameLength = writer.end();
+  return flush();
+}
+
+static void reject(uint8_t command, uint8_t reason) {
+  error.command = command;
+  error.error = reason;
+  errorPending = true;
+  counters.errors++;
+}
+
+/*
+ * @brief The levels the power update uses: the pots, with the host's overrides on top.
+ */
+static void updateLevels() {
+  for (int i = 0; i < numPots; i++) {
+    levels[i] = overrideMask & (1 << i) ? overrideLevels[i] : knobs[i];
+  }
+}
+
+static void setLevels(const GeaMessageView& message) {
+  HostSetLevels_t request;
+
+  if (!HostSetLevelsLayout::decode(message, &request)) {
+    reject(message.command(), HOST_ERROR_BAD_LENGTH);
+    return;
+  }
+  for (int i = 0; i < numPots; i++) {
+    if (request.overrideMask & (1 << i) && !withinRange(request.levels[i], minPowerSteps, maxPowerSteps)) {
+      reject(message.command(), HOST_ERROR_BAD_VALUE);
+      return;
+    }
+  }
+
+  overrideMask = request.overrideMask & ((1 << numPots) - 1);
+  memcpy(overrideLevels, request.levels, sizeof(overrideLevels));
+  overrideMs = millis();
+  levelsPending = true;
+}
+
+static void subscribe(const GeaMessageView& message) {
+  if (!HostSubscribeLayout::decode(message, &subscription)) {
+    reject(message.command(), HOST_ERROR_BAD_LENGTH);
+    return;
+  }
+
+  subscription.streams &= HOST_STREAM_STATUS | HOST_STREAM_LEVELS;
+  subscription.periodMs = max(subscription.periodMs, (uint16_t)HOST_STREAM_MIN_PERIOD_MS);
+  streamDueMs = millis();
+  subscribePending = true;
+}
+
+static bool coilsOff() {
+  updateLevels();
+  for (int i = 0; i < numPots; i++) {
+    if (levels[i] != 0) {
+      return false;
+    }
+  }
+  for (int i = 0; i < controlCooktop->boardCount; i++) {
+    if (controlShadows[i].coil1Level != 0 || controlShadows[i].coil2Level != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * @brief Apply and store a knob calibration. Storing writes flash, which can stall the bus, so it only happens with every
+ * coil off.
+ */
+static void calibrate(const GeaMessageView& message) {
+  HostCalibrate_t request;
+
+  if (!HostCalibrateLayout::decode(message, &request)) {
+    reject(message.command(), HOST_ERROR_BAD_LENGTH);
+    return;
+  }
+  if (request.knob >= numPots) {
+    reject(message.command(), HOST_ERROR_BAD_VALUE);
+    return;
+  }
+
+  KnobCalibration_t calibration = {request.minRaw, request.maxRaw, request.offZone, request.curve};
+  if (request.flags & HOST_CALIBRATE_SAVE && !coilsOff()) {
+    reject(message.command(), HOST_ERROR_BUSY);
+    return;
+  }
+  if (request.flags & HOST_CALIBRATE_APPLY && !knobCalibrate(request.knob, &calibration)) {
+    reject(message.command(), HOST_ERROR_BAD_VALUE);
+    return;
+  }
+
+  bool saved = request.flags & HOST_CALIBRATE_SAVE && knobCalibrationSave();
+  const KnobCalibration_t* current = knobCalibration(request.knob);
+  calibrateReply = {request.knob, (uint8_t)((request.flags & HOST_CALIBRATE_APPLY) | (saved ? HOST_CALIBRATE_SAVE : 0)),
+                    current->minRaw, current->maxRaw, current->offZone, current->curve};
+  calibratePending = true;
+}
+
+static void handle(const GeaMessageView& message) {
+  if (message.destination() != LOCAL_ADDR && message.destination() != GEA_BROADCAST_ADDR) {
+    return;
+  }
+
+  hostAddress = message.source();
+  counters.commands++;
+
+  switch (message.command()) {
+    case HOST_CMD_SET_LEVELS:
+      setLevels(message);
+      break;
+    case HOST_CMD_SUBSCRIBE:
+      subscribe(message);
+      break;
+    case HOST_CMD_CALIBRATE:
+      calibrate(message);
+      break;
+    case HOST_CMD_COUNTERS:
+      if (message.payloadLength() == 0) {
+        countersPending = true;
+      } else {
+        reject(message.command(), HOST_ERROR_BAD_LENGTH);
+      }
+      break;
+    default:
+      reject(message.command(), HOST_ERROR_UNKNOWN_COMMAND);
+      break;
+  }
+}
+
+static bool sendCounters() {
+  HostCounters_t values = {(uint32_t)millis(), 0, 0, geaTransactionStats().timeouts, 0, 0};
+
+  for (int i = 0; i < controlCooktop->boardCount; i++) {
+    values.powerFramesSent += controlShadows[i].framesSent;
+    values.powerFramesSkipped += controlShadows[i].framesSkipped;
+  }
+  for (int i = 0; i < geaLinkBoardCount(); i++) {
+    values.linkFailed += geaLinkBoard(i)->failed;
+  }
+  for (int bus = 0; bus < GEA_BUS_COUNT; bus++) {
+    values.busRxErrors += geaBuses[bus].decoder.stats().crcErrors + geaBuses[bus].decoder.stats().framingErrors;
+  }
+
+  uint8_t payload[HostCountersLayout::size];
+  return send(HOST_CMD_COUNTERS, payload, HostCountersLayout::encode(&values, payload));
+}
+
+static bool sendLevels() {
+  updateLevels();
+  HostLevels_t snapshot;
+  snapshot.overrideMask = overrideMask;
+  memcpy(snapshot.knobs, knobs, sizeof(snapshot.knobs));
+  memcpy(snapshot.levels, levels, sizeof(snapshot.levels));
+  memset(snapshot.applied, 0, sizeof(snapshot.applied));
+  for (int i = 0; i < controlCooktop->boardCount; i++) {
+    snapshot.applied[2 * i] = controlShadows[i].coil1Level;
+    snapshot.applied[2 * i + 1] = controlShadows[i].coil2Level;
+  }
+
+  uint8_t payload[HostLevelsLayout::size];
+  return send(HOST_MSG_LEVELS, payload, HostLevelsLayout::encode(&snapshot, payload));
+}
+
+static bool sendStatus(int index) {
+  const BoardTelemetry_t* board = telemetryBoard(index);
+  uint32_t age = millis() - board->receivedMs;
+  HostStatusHeader_t header = {board->address, (uint8_t)(board->valid | board->stale << 1), (uint16_t)min(age, (uint32_t)0xFFFF)};
+
+  uint8_t payload[HostStatusHeaderLayout::size + StatusLayout::size];
+  HostStatusHeaderLayout::encode(&header, payload);
+  StatusLayout::encode(&board->status, payload + HostStatusHeaderLayout::size);
+  return send(HOST_MSG_STATUS, payload, sizeof(payload));
+}
+
+/*
+ * @brief Send whatever is owed, replies first, until the console's TX buffer is full.
+ */
+static void sendOwed() {
+  if (!flush()) {
+    return;
+  }
+
+  if (errorPending) {
+    uint8_t payload[HostErrorLayout::size];
+    errorPending = false;
+    if (!send(HOST_MSG_ERROR, payload, HostErrorLayout::encode(&error, payload))) {
+      return;
+    }
+  }
+  if (subscribePending) {
+    uint8_t payload[HostSubscribeLayout::size];
+    subscribePending = false;
+    if (!send(HOST_CMD_SUBSCRIBE, payload, HostSubscribeLayout::encode(&subscription, payload))) {
+      return;
+    }
+  }
+  if (calibratePending) {
+    uint8_t payload[HostCalibrateLayout::size];
+    calibratePending = false;
+    if (!send(HOST_CMD_CALIBRATE, payload, HostCalibrateLayout::encode(&calibrateReply, payload))) {
+      return;
+    }
+  }
+  if (countersPending) {
+    countersPending = false;
+    if (!sendCounters()) {
+      return;
+    }
+  }
+  if (levelsPending) {
+    levelsPending = false;
+    if (!sendLevels()) {
+      return;
+    }
+  }
+  for (int i = 0; i < telemetryBoardCount() && statusPending != 0; i++) {
+    if (statusPending & (1 << i)) {
+      statusPending &= ~(1 << i);
+      if (!sendStatus(i)) {
+        return;
+      }
+    }
+  }
+}
+
+/*
+ * @brief Start listening for the host. knobLevels are the pot levels the overrides replace; consoleCommand gets every
+ * console byte that isn't part of a frame.
+ */
+void hostControlBegin(const Cooktop_t* cooktop, const PowerShadow_t* shadows, const uint8_t* knobLevels,
+                      void (*consoleCommand)(uint8_t value)) {
+  controlCooktop = cooktop;
+  controlShadows = shadows;
+  knobs = knobLevels;
+  consoleCallback = consoleCommand;
+  hostAddress = HOST_ADDR;
+  decoder.reset();
+  memset(&counters, 0, sizeof(counters));
+}
+
+/*
+ * @brief Read host frames off the console, expire stale overrides, and send replies and due snapshots. Never blocks: a
+ * frame that doesn't fit in the console's TX buffer waits for the next run.
+ */
+void hostControlTask(void* context) {
+  while (Serial.available() > 0) {
+    uint8_t value = Serial.read();
+    if (!decoder.receiving() && value != GEA_SOF) {
+      consoleCallback(value);
+    } else if (decoder.feed(value)) {
+      handle(GeaMessageView(decoder.peek()));
+      decoder.pop();
+    }
+  }
+
+  uint32_t now = millis();
+  if (overrideMask != 0 && now - overrideMs >= HOST_OVERRIDE_TIMEOUT_MS) {
+    LOG_E(EVT_HOST_OVERRIDE_TIMEOUT, overrideMask, now - overrideMs);
+    overrideMask = 0;
+    counters.overrideTimeouts++;
+    levelsPending = true;
+  }
+
+  if (subscription.streams != 0 && (int32_t)(now - streamDueMs) >= 0) {
+    streamDueMs += subscription.periodMs;
+    if ((int32_t)(now - streamDueMs) >= 0) {
+      // Fell more than a period behind: skip ahead rather than send a run of old snapshots
+      streamDueMs = now + subscription.periodMs;
+    }
+    levelsPending |= (subscription.streams & HOST_STREAM_LEVELS) != 0;
+    if (subscription.streams & HOST_STREAM_STATUS) {
+      statusPending = (1 << telemetryBoardCount()) - 1;
+    }
+  }
+
+  sendOwed();
+}
+
+/*
+ * @brief Knob levels with the host's overrides applied, for the power update.
+ */
+const uint8_t* hostControlLevels() {
+  updateLevels();
+  return levels;
+}
+
+const HostControlStats_t* hostControlStats() {
+  return &counters;
+}
+
+const GeaDecoderStats_t& hostControlDecoderStats() {
+  return decoder.stats();
+}
@@ -0,0 +1,191 @@
+#ifndef __HOST_CONTROL_H__
+#define __HOST_CONTROL_H__
+
+#include <Arduino.h>
+#include "config.h"
+#include "gea_payload.h"
+#include "topology.h"
+#include "input.h"
+
+/*
+ * Binary control channel for a supervising host or test fixture, on the console UART next to the
+ * log. It uses the same GEA framing and CRC as the generator bus. The host sends frames to
+ * LOCAL_ADDR from its own address (HOST_ADDR by convention), and every reply and stream frame goes
+ * back to the address the last command came from. Frames only ever go out between two log records,
+ * so a host can split the console stream by looking at the first byte: GEA_SOF starts a frame and
+ * LOG_SYNC a log record. Console bytes outside a frame still work as single-character commands.
+ *
+ * Every payload has a fixed layout, with multi-byte fields big-endian like the boards use:
+ *
+ *   HOST_CMD_SET_LEVELS  host -> us, HostSetLevels_t. Each bit set in overrideMask takes that
+ *                        knob's level from levels[] instead of the pot, until the host clears the
+ *                        bit or stops sending for HOST_OVERRIDE_TIMEOUT_MS. Answered with HOST_MSG_LEVELS.
+ *   HOST_CMD_SUBSCRIBE   host -> us, HostSubscribe_t. Stream the HOST_STREAM_* snapshots in streams
+ *                        every periodMs (at least HOST_STREAM_MIN_PERIOD_MS). Echoed back as applied.
+ *   HOST_CMD_COUNTERS    host -> us, no payload. Answered with HostCounters_t.
+ *   HOST_CMD_CALIBRATE   host -> us, HostCalibrate_t. With HOST_CALIBRATE_APPLY, the knob's lookup
+ *                        table is rebuilt from the new calibration. With HOST_CALIBRATE_SAVE, every
+ *                        knob's calibration is stored for the next boot, which is refused unless
+ *                        every coil is off. Answered with the knob's calibration as it now is, and
+ *                        HOST_CALIBRATE_SAVE set if it was stored.
+ *   HOST_MSG_STATUS      us -> host, HostStatus_t, one frame per board
+ *   HOST_MSG_LEVELS      us -> host, HostLevels_t
+ *   HOST_MSG_ERROR       us -> host, HostError_t, for a command we couldn't carry out
+ */
+
+#define HOST_ADDR 0xC0
+// Longest payload either way. Escaped, a frame this long still fits in the console's TX buffer in one go.
+#define HOST_MAX_PAYLOAD 24
+
+typedef enum {
+  HOST_CMD_SET_LEVELS=0x40,
+  HOST_CMD_SUBSCRIBE=0x41,
+  HOST_CMD_COUNTERS=0x42,
+  HOST_CMD_CALIBRATE=0x43,
+  HOST_MSG_STATUS=0x50,
+  HOST_MSG_LEVELS=0x51,
+  HOST_MSG_ERROR=0x5f
+} HostCommandList;
+
+typedef enum {
+  HOST_STREAM_STATUS=0x01,
+  HOST_STREAM_LEVELS=0x02
+} HostStreamList;
+
+typedef enum {
+  HOST_ERROR_UNKNOWN_COMMAND=0x01,
+  HOST_ERROR_BAD_LENGTH=0x02,
+  HOST_ERROR_BAD_VALUE=0x03,
+  HOST_ERROR_BUSY=0x04 //       Not while a coil is on
+} HostErrorList;
+
+typedef enum {
+  HOST_CALIBRATE_APPLY=0x01,
+  HOST_CALIBRATE_SAVE=0x02
+} HostCalibrateFlagList;
+
+typedef struct {
+  uint8_t overrideMask; // Bit per knob, knob 0 in bit 0
+  uint8_t levels[numPots];
+} HostSetLevels_t;
+
+typedef struct {
+  uint8_t streams; //    HOST_STREAM_* bits, 0 to stop
+  uint16_t periodMs;
+} HostSubscribe_t;
+
+typedef struct {
+  uint32_t uptimeMs;
+  uint32_t powerFramesSent;
+  uint32_t powerFramesSkipped; // Left out because nothing changed
+  uint32_t requestTimeouts;
+  uint32_t linkFailed; //        Given up on after every retry
+  uint32_t busRxErrors; //       CRC and framing errors on every GEA bus
+} HostCounters_t;
+
+/*
+ * The board's Status_t follows this header, in the board's own wire layout.
+ */
+typedef struct {
+  uint8_t address;
+  uint8_t flags; //      Bit 0: a status has been received, bit 1: it's stale
+  uint16_t ageMs; //     Since it was received, saturated
+} HostStatusHeader_t;
+
+typedef struct {
+  uint8_t overrideMask;
+  uint8_t knobs[numPots]; //     From the pots
+  uint8_t levels[numPots]; //    What the power update uses
+  uint8_t applied[2 * MAX_GENERATORS]; // Coil levels last sent to each board, by board index
+} HostLevels_t;
+
+typedef struct {
+  uint8_t command;
+  uint8_t error; //      HOST_ERROR_*
+} HostError_t;
+
+/*
+ * A knob's calibration (KnobCalibration_t), flat so it has a layout.
+ */
+typedef struct {
+  uint8_t knob;
+  uint8_t flags; //      HOST_CALIBRATE_* bits, 0 to read the calibration back
+  uint16_t minRaw;
+  uint16_t maxRaw;
+  uint16_t offZone;
+  uint8_t curve; //      KnobCurveList
+} HostCalibrate_t;
+
+typedef GeaPayloadLayout<HostSetLevels_t,
+  GeaU8<HostSetLevels_t, &HostSetLevels_t::overrideMask>,
+  GeaBytes<HostSetLevels_t, numPots, &HostSetLevels_t::levels>
+> HostSetLevelsLayout;
+
+typedef GeaPayloadLayout<HostSubscribe_t,
+  GeaU8<HostSubscribe_t, &HostSubscribe_t::streams>,
+  GeaU16BE<HostSubscribe_t, &HostSubscribe_t::periodMs>
+> HostSubscribeLayout;
+
+typedef GeaPayloadLayout<HostCounters_t,
+  GeaU32BE<HostCounters_t, &HostCounters_t::uptimeMs>,
+  GeaU32BE<HostCounters_t, &HostCounters_t::powerFramesSent>,
+  GeaU32BE<HostCounters_t, &HostCounters_t::powerFramesSkipped>,
+  GeaU32BE<HostCounters_t, &HostCounters_t::requestTimeouts>,
+  GeaU32BE<HostCounters_t, &HostCounters_t::linkFailed>,
+  GeaU32BE<HostCounters_t, &HostCounters_t::busRxErrors>
+> HostCountersLayout;
+
+typedef GeaPayloadLayout<HostCalibrate_t,
+  GeaU8<HostCalibrate_t, &HostCalibrate_t::knob>,
+  GeaU8<HostCalibrate_t, &HostCalibrate_t::flags>,
+  GeaU16BE<HostCalibrate_t, &HostCalibrate_t::minRaw>,
+  GeaU16BE<HostCalibrate_t, &HostCalibrate_t::maxRaw>,
+  GeaU16BE<HostCalibrate_t, &HostCalibrate_t::offZone>,
+  GeaU8<HostCalibrate_t, &HostCalibrate_t::curve>
+> HostCalibrateLayout;
+
+typedef GeaPayloadLayout<HostStatusHeader_t,
+  GeaU8<HostStatusHeader_t, &HostStatusHeader_t::address>,
+  GeaU8<HostStatusHeader_t, &HostStatusHeader_t::flags>,
+  GeaU16BE<HostStatusHeader_t, &HostStatusHeader_t::ageMs>
+> HostStatusHeaderLayout;
+
+typedef GeaPayloadLayout<HostLevels_t,
+  GeaU8<HostLevels_t, &HostLevels_t::overrideMask>,
+  GeaBytes<HostLevels_t, numPots, &HostLevels_t::knobs>,
+  GeaBytes<HostLevels_t, numPots, &HostLevels_t::levels>,
+  GeaBytes<HostLevels_t, 2 * MAX_GENERATORS, &HostLevels_t::applied>
+> HostLevelsLayout;
+
+typedef GeaPayloadLayout<HostError_t,
+  GeaU8<HostError_t, &HostError_t::command>,
+  GeaU8<HostError_t, &HostError_t::error>
+> HostErrorLayout;
+
+static_assert(HostCountersLayout::size <= HOST_MAX_PAYLOAD && HostLevelsLayout::size <= HOST_MAX_PAYLOAD &&
+              HostCalibrateLayout::size <= HOST_MAX_PAYLOAD &&
+              HostStatusHeaderLayout::size + StatusLayout::size <= HOST_MAX_PAYLOAD, "A host control payload is over HOST_MAX_PAYLOAD");
+static_assert(HOST_MAX_PAYLOAD <= GEA_MAX_RX_PAYLOAD_SIZE, "Host commands have to fit the frame decoder");
+#ifdef SERIAL_TX_BUFFER_SIZE
+static_assert(GEA_ESCAPED_SIZE(HOST_MAX_PAYLOAD) <= SERIAL_TX_BUFFER_SIZE, "A host control frame has to fit in the console's TX buffer");
+#endif
+
+/*
+ * Counters for the channel itself.
+ */
+typedef struct {
+  uint32_t commands; //   Frames from the host we acted on
+  uint32_t errors; //     Answered with HOST_MSG_ERROR
+  uint32_t sent; //       Frames to the host
+  uint32_t deferred; //   Times a frame had to wait for the console
+  uint32_t overrideTimeouts;
+} HostControlStats_t;
+
+void hostControlBegin(const Cooktop_t* cooktop, const PowerShadow_t* shadows, const uint8_t* knobLevels,
+                      void (*consoleCommand)(uint8_t value));
+void hostControlTask(void* context);
+const uint8_t* hostControlLevels();
+const HostControlStats_t* hostControlStats();
+const GeaDecoderStats_t& hostControlDecoderStats();
+
+#endif
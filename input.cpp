@@ -1,36 +1,284 @@
 #include "input.h"
 #include "config.h"
+#include "generator_board.h"
+#include "crc16.h"
 #include "utils.h"
+#include "log.h"
+#ifdef KNOB_CALIBRATION_EEPROM
+#include <EEPROM.h>
+#ifndef ARDUINO_HOST
+#include <stm32_eeprom.h> // Buffered writes, one page erase per save
+#endif
 
-#define MIN_ADC_RAWVALUE 0
-#define MAX_ADC_RAWVALUE (2 ^ ADC_RESOLUTION) - 1
+#define KNOB_CALIBRATION_VERSION 1
 
 /*
- * @brief Uses a running average algorithm to read and filter ADC values. An array to pass filtered data should be provided as an argument.
+ * The calibrations as they are kept in EEPROM. The CRC covers everything before it.
  */
-void readPotsAverage(uint16_t potValuesFiltered[]) {
-  static uint16_t samples[numPots][numSamples];
-  static uint8_t currentSample = 0;
+typedef struct {
+  uint8_t version;
+  KnobCalibration_t knobs[numPots];
+  uint16_t crc;
+} KnobCalibrationStore_t;
 
-  for (uint8_t i = 0; i < numPots; i++) {
-    uint16_t rawAdcValue = analogRead(potPins[i]);
-    
-    samples[i][currentSample] = rawAdcValue;
-    
-    uint32_t sum = 0;
-
-    for (uint8_t j = 0; j < numSamples; j++) {
-      sum += samples[i][j];
-    }
+static uint16_t storeCrc(const KnobCalibrationStore_t* store) {
+  return Crc16Finalize(Crc16Update(Crc16Init(), (const uint8_t*)store, offsetof(KnobCalibrationStore_t, crc)));
+}
+#endif
+
+static PotFilter filters[numPots];
+static KnobCalibration_t calibrations[numPots];
+static uint8_t knobLuts[numPots][KNOB_LUT_SIZE];
+static uint8_t levels[numPots];
+
+static_assert(sizeof(filters) + sizeof(calibrations) + sizeof(knobLuts) + sizeof(levels) <= RAM_BUDGET_INPUT,
+              "Pot state is over its RAM budget (config.h)");
+
+#if defined(POT_SCAN_DMA) && defined(STM32F4xx)
+/*
+ * Continuous scan of all pot channels on ADC1, written by DMA2 stream 0 into potScanBuffer.
+ * Reading the pots is then just a copy of the latest scan. STM32F4 only.
+ */
+static ADC_HandleTypeDef potAdc;
+static DMA_HandleTypeDef potDma;
+static volatile uint16_t potScanBuffer[numPots];
+
+static_assert(ADC_RESOLUTION == 12 || ADC_RESOLUTION == 10 || ADC_RESOLUTION == 8 || ADC_RESOLUTION == 6,
+              "The STM32F4 ADC only converts at 12, 10, 8 or 6 bits");
+
+static void potScanBegin() {
+  __HAL_RCC_ADC1_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  for (int i = 0; i < numPots; i++) {
+    pinMode(potPins[i], INPUT_ANALOG);
+  }
+
+  potAdc.Instance = ADC1;
+  potAdc.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+  potAdc.Init.Resolution = ADC_RESOLUTION == 12 ? ADC_RESOLUTION_12B : ADC_RESOLUTION == 10 ? ADC_RESOLUTION_10B :
+                           ADC_RESOLUTION == 8 ? ADC_RESOLUTION_8B : ADC_RESOLUTION_6B;
+  potAdc.Init.ScanConvMode = ENABLE;
+  potAdc.Init.ContinuousConvMode = ENABLE;
+  potAdc.Init.DiscontinuousConvMode = DISABLE;
+  potAdc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
+  potAdc.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+  potAdc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+  potAdc.Init.NbrOfConversion = numPots;
+  potAdc.Init.DMAContinuousRequests = ENABLE;
+  potAdc.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+  HAL_ADC_Init(&potAdc);
+
+  for (int i = 0; i < numPots; i++) {
+    ADC_ChannelConfTypeDef channel = {};
+    PinName pin = digitalPinToPinName(potPins[i]);
+    channel.Channel = STM_PIN_CHANNEL(pinmap_function(pin, PinMap_ADC));
+    channel.Rank = i + 1;
+    channel.SamplingTime = ADC_SAMPLETIME_480CYCLES;
+    HAL_ADC_ConfigChannel(&potAdc, &channel);
+  }
+
+  potDma.Instance = DMA2_Stream0;
+  potDma.Init.Channel = DMA_CHANNEL_0;
+  potDma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  potDma.Init.PeriphInc = DMA_PINC_DISABLE;
+  potDma.Init.MemInc = DMA_MINC_ENABLE;
+  potDma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  potDma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  potDma.Init.Mode = DMA_CIRCULAR;
+  potDma.Init.Priority = DMA_PRIORITY_LOW;
+  potDma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&potDma);
+  __HAL_LINKDMA(&potAdc, DMA_Handle, potDma);
+
+  HAL_ADC_Start_DMA(&potAdc, (uint32_t*)potScanBuffer, numPots);
+}
+#endif
+
+/*
+ * @brief The level for one ADC reading. Only used to build the lookup tables, so it can afford the divisions.
+ */
+static uint8_t knobLevel(const KnobCalibration_t* calibration, uint32_t value) {
+  uint32_t start = calibration->minRaw + calibration->offZone;
+  if (value <= start) {
+    return minPowerSteps;
+  }
+  if (value >= calibration->maxRaw) {
+    return maxPowerSteps;
+  }
+
+  // Travel past the dead zone, 0 to just under 1 in 16 bit fixed point
+  uint32_t travel = ((value - start) << 16) / (calibration->maxRaw - start);
+  if (calibration->curve == KNOB_CURVE_SQUARE) {
+    travel = (travel * travel) >> 16;
+  }
+
+  // Every level above off gets an equal share of the curve
+  uint32_t steps = maxPowerSteps - minPowerSteps;
+  return minPowerSteps + 1 + min((travel * steps) >> 16, steps - 1);
+}
+
+/*
+ * @brief Fill a knob's lookup table. Each entry holds the level for the middle of the ADC codes it covers.
+ */
+static void buildLut(int knob) {
+  for (uint32_t i = 0; i < KNOB_LUT_SIZE; i++) {
+    uint32_t value = (i << KNOB_LUT_SHIFT) + ((1 << KNOB_LUT_SHIFT) >> 1);
+    knobLuts[knob][i] = knobLevel(&calibrations[knob], value);
+  }
+}
 
-    potValuesFiltered[i] = sum / numSamples;
+static bool calibrationValid(const KnobCalibration_t* calibration) {
+  return calibration->maxRaw <= MAX_ADC_RAWVALUE && calibration->minRaw + calibration->offZone < calibration->maxRaw &&
+         calibration->curve < KNOB_CURVE_COUNT;
+}
+
+/*
+ * @brief Use the stored calibrations if there are any and they all check out, and the defaults otherwise.
+ */
+static void loadCalibrations() {
+  for (int i = 0; i < numPots; i++) {
+    calibrations[i] = {MIN_ADC_RAWVALUE, MAX_ADC_RAWVALUE, KNOB_OFF_ZONE, KNOB_CURVE_LINEAR};
   }
+
+#ifdef KNOB_CALIBRATION_EEPROM
+  KnobCalibrationStore_t store;
+  EEPROM.get(KNOB_CALIBRATION_ADDRESS, store);
+
+  bool valid = store.version == KNOB_CALIBRATION_VERSION && store.crc == storeCrc(&store);
+  for (int i = 0; i < numPots && valid; i++) {
+    valid = calibrationValid(&store.knobs[i]);
+  }
+  if (valid) {
+    memcpy(calibrations, store.knobs, sizeof(calibrations));
+    LOG_I(EVT_KNOB_CALIBRATION_LOADED, numPots);
+  } else {
+    LOG_I(EVT_KNOB_CALIBRATION_DEFAULT, store.version);
+  }
+#endif
 }
 
-void readPotsMapped(uint8_t potValuesMapped[], int min, int max) {
+/*
+ * @brief Set up the ADC for the pots and build their lookup tables. Call once from setup().
+ */
+void potsBegin() {
+#if defined(POT_SCAN_DMA) && defined(STM32F4xx)
+  potScanBegin();
+#else
+  analogReadResolution(ADC_RESOLUTION);
+#endif
+
+  loadCalibrations();
+  for (int i = 0; i < numPots; i++) {
+    buildLut(i);
+  }
+}
+
+/*
+ * @brief Replace a knob's calibration and rebuild its lookup table. The next sample uses it. Returns false, and changes
+ * nothing, if the calibration doesn't make sense.
+ */
+bool knobCalibrate(int knob, const KnobCalibration_t* calibration) {
+  if (knob < 0 || knob >= numPots || !calibrationValid(calibration)) {
+    return false;
+  }
+
+  calibrations[knob] = *calibration;
+  buildLut(knob);
+  LOG_I(EVT_KNOB_CALIBRATED, knob, calibration->minRaw, calibration->maxRaw, calibration->offZone, calibration->curve);
+  return true;
+}
+
+const KnobCalibration_t* knobCalibration(int knob) {
+  return &calibrations[knob];
+}
+
+/*
+ * @brief Store every knob's calibration so it's used from the next boot on. Writing the emulated EEPROM erases flash,
+ * which can stall everything else for a long time, so only do it with every coil off. The whole store goes into the
+ * core's page buffer first and is flushed once, for a single page erase, where EEPROM.put() would erase the page again
+ * for every byte that changed. Returns false without KNOB_CALIBRATION_EEPROM.
+ */
+bool knobCalibrationSave() {
+#ifdef KNOB_CALIBRATION_EEPROM
+  KnobCalibrationStore_t store;
+  memset(&store, 0, sizeof(store));
+  store.version = KNOB_CALIBRATION_VERSION;
+  memcpy(store.knobs, calibrations, sizeof(store.knobs));
+  store.crc = storeCrc(&store);
+
+#ifdef ARDUINO_HOST
+  EEPROM.put(KNOB_CALIBRATION_ADDRESS, store);
+#else
+  eeprom_buffer_fill();
+  for (size_t i = 0; i < sizeof(store); i++) {
+    eeprom_buffered_write_byte(KNOB_CALIBRATION_ADDRESS + i, ((const uint8_t*)&store)[i]);
+  }
+  eeprom_buffer_flush();
+#endif
+  LOG_I(EVT_KNOB_CALIBRATION_SAVED, numPots);
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*
+ * @brief Read the latest unfiltered value of every pot.
+ */
+void readPotsRaw(uint16_t potValuesRaw[]) {
+#if defined(POT_SCAN_DMA) && defined(STM32F4xx)
+  for (uint8_t i = 0; i < numPots; i++) {
+    potValuesRaw[i] = potScanBuffer[i];
+  }
+#else
+  for (uint8_t i = 0; i < numPots; i++) {
+    potValuesRaw[i] = analogRead(potPins[i]);
+  }
+#endif
+}
+
+/*
+ * @brief Reads and filters ADC values with PotFilter. An array to pass filtered data should be provided as an argument.
+ */
+void readPotsAverage(uint16_t potValuesFiltered[]) {
   uint16_t potValuesRaw[numPots];
-  readPotsAverage(potValuesRaw);
+
+  readPotsRaw(potValuesRaw);
+
+  for (uint8_t i = 0; i < numPots; i++) {
+    potValuesFiltered[i] = filters[i].update(potValuesRaw[i]);
+  }
+}
+
+/*
+ * @brief Reads the pots and maps them to levels through each knob's lookup table. A pot only moves to a new level once
+ * it is potHysteresis counts past the edge of its current level, so ADC jitter at an edge doesn't flip it back and forth.
+ */
+void readPotsMapped(uint8_t potValuesMapped[]) {
+  uint16_t potValuesFiltered[numPots];
+
+  readPotsAverage(potValuesFiltered);
+
   for (int i=0; i<numPots; i++) {
-    potValuesMapped[i] = map(potValuesRaw[i], 0, 1023, min, max);
+    const uint8_t* lut = knobLuts[i];
+    uint16_t value = potValuesFiltered[i];
+    uint8_t level = lut[value >> KNOB_LUT_SHIFT];
+
+    // Where levels are closer together than potHysteresis, the lookup back from value can land past the current level,
+    // so it's clamped to never move the level against the knob
+    if (level > levels[i]) {
+      level = max(lut[(value > potHysteresis ? value - potHysteresis : MIN_ADC_RAWVALUE) >> KNOB_LUT_SHIFT], levels[i]);
+    } else if (level < levels[i]) {
+      level = min(lut[min(value + potHysteresis, MAX_ADC_RAWVALUE) >> KNOB_LUT_SHIFT], levels[i]);
+    }
+
+    // At the ends of the range there is nothing to bounce against
+    if (value == MIN_ADC_RAWVALUE || value == MAX_ADC_RAWVALUE) {
+      level = lut[value >> KNOB_LUT_SHIFT];
+    }
+
+    levels[i] = level;
+    potValuesMapped[i] = level;
   }
 }
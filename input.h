@@ -2,8 +2,134 @@
 #define __INPUT_H__
 
 #include <Arduino.h>
+#include "config.h"
 
+#define MIN_ADC_RAWVALUE 0
+#define MAX_ADC_RAWVALUE ((1 << ADC_RESOLUTION) - 1)
+
+// Each knob's lookup table has an entry per ADC code, or per 2^KNOB_LUT_SHIFT codes past KNOB_LUT_BITS of resolution
+#define KNOB_LUT_SHIFT (ADC_RESOLUTION > KNOB_LUT_BITS ? ADC_RESOLUTION - KNOB_LUT_BITS : 0)
+#define KNOB_LUT_SIZE (1 << (ADC_RESOLUTION - KNOB_LUT_SHIFT))
+
+typedef enum {
+  KNOB_CURVE_LINEAR, // Every level gets the same travel
+  KNOB_CURVE_SQUARE, // More travel for the low levels, for simmering
+  KNOB_CURVE_COUNT
+} KnobCurveList;
+
+/*
+ * One knob's calibration, in ADC counts. Readings up to minRaw + offZone are off, which gives the
+ * off end a detent that ADC noise and a worn pot can't leave. The levels above off are spread over
+ * the rest of the travel up to maxRaw along the curve, and readings from maxRaw up are full power.
+ */
+typedef struct {
+  uint16_t minRaw; //   Reading at the off stop
+  uint16_t maxRaw; //   Reading at the full stop
+  uint16_t offZone; //  Dead zone above minRaw
+  uint8_t curve; //     KnobCurveList
+} KnobCalibration_t;
+
+/*
+ * Moving average over the last N samples. The sum is kept up to date as samples go in and out of
+ * the window, so each update is O(1).
+ */
+template <int N>
+class RunningMeanFilter {
+  public:
+    RunningMeanFilter() : sum(0), index(0), count(0) {}
+
+    uint16_t update(uint16_t sample) {
+      if (count < N) {
+        count++;
+      } else {
+        sum -= samples[index];
+      }
+
+      samples[index] = sample;
+      sum += sample;
+      index = (index + 1) % N;
+
+      return sum / count;
+    }
+
+  private:
+    uint16_t samples[N];
+    uint32_t sum;
+    uint8_t index;
+    uint8_t count;
+};
+
+/*
+ * Exponential moving average with a weight of 1/2^Shift for each new sample. Uses no sample history.
+ */
+template <int Shift>
+class EmaFilter {
+  public:
+    EmaFilter() : state(0), primed(false) {}
+
+    uint16_t update(uint16_t sample) {
+      if (!primed) {
+        state = (uint32_t)sample << Shift;
+        primed = true;
+      } else {
+        state += sample - (state >> Shift);
+      }
+
+      return state >> Shift;
+    }
+
+  private:
+    uint32_t state;
+    bool primed;
+};
+
+/*
+ * Median of the last N samples. Rejects single-sample spikes completely; best with a small odd N.
+ */
+template <int N>
+class MedianFilter {
+  public:
+    MedianFilter() : index(0), count(0) {}
+
+    uint16_t update(uint16_t sample) {
+      samples[index] = sample;
+      index = (index + 1) % N;
+      if (count < N) {
+        count++;
+      }
+
+      // Insertion sort of a copy of the window
+      uint16_t sorted[N];
+      for (int i = 0; i < count; i++) {
+        uint16_t value = samples[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > value) {
+          sorted[j] = sorted[j - 1];
+          j--;
+        }
+        sorted[j] = value;
+      }
+
+      return sorted[count / 2];
+    }
+
+  private:
+    uint16_t samples[N];
+    uint8_t index;
+    uint8_t count;
+};
+
+/*
+ * Filter applied to every pot. Swap in EmaFilter<3> or MedianFilter<5> here.
+ */
+typedef RunningMeanFilter<numSamples> PotFilter;
+
+void potsBegin();
+void readPotsRaw(uint16_t potValuesRaw[]);
 void readPotsAverage(uint16_t potValuesFiltered[]);
-void readPotsMapped(uint8_t potValuesMapped[], int min, int max);
+void readPotsMapped(uint8_t potValuesMapped[]);
+bool knobCalibrate(int knob, const KnobCalibration_t* calibration);
+const KnobCalibration_t* knobCalibration(int knob);
+bool knobCalibrationSave();
 
 #endif
@@ -0,0 +1,146 @@
+#include "log.h"
+
+/*
+ * Single-producer, single-consumer ring. logWrite() only moves head and logDrain() only moves
+ * tail, so no locking is needed as long as each side runs in one context.
+ */
+static LogRecord_t records[LOG_BUFFER_SIZE];
+static volatile uint8_t head;
+static volatile uint8_t tail;
+static volatile uint32_t dropped;
+static uint32_t droppedReported;
+
+// Encoded record currently being written to the console
+static uint8_t pending[LOG_MAX_RECORD_SIZE > 160 ? LOG_MAX_RECORD_SIZE : 160];
+static size_t pendingLength;
+static size_t pendingPosition;
+
+static_assert(sizeof(records) + sizeof(pending) <= RAM_BUDGET_LOG, "Log buffers are over their RAM budget (config.h)");
+
+#ifdef LOG_TEXT_OUTPUT
+#define LOG_EVENT_FORMAT(id, format) format,
+
+static const char* const eventFormats[] = {
+  LOG_EVENT_LIST(LOG_EVENT_FORMAT)
+};
+#endif
+
+/*
+ * @brief Append an event to the ring buffer. Never blocks; if the buffer is full the event is dropped and counted.
+ */
+void logWrite(uint8_t level, uint8_t id, const uint32_t* args, uint8_t argc) {
+  uint8_t next = (head + 1) & (LOG_BUFFER_SIZE - 1);
+
+  if (next == tail) {
+    dropped++;
+    return;
+  }
+
+  LogRecord_t* record = &records[head];
+  record->timestamp = millis();
+  record->id = id;
+  record->level = level;
+  record->argc = argc;
+  for (uint8_t i = 0; i < argc; i++) {
+    record->args[i] = args[i];
+  }
+
+  head = next;
+}
+
+uint32_t logDropped() {
+  return dropped;
+}
+
+static size_t putVarint(uint8_t* buffer, uint32_t value) {
+  size_t length = 0;
+
+  while (value >= 0x80) {
+    buffer[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[length++] = value;
+
+  return length;
+}
+
+/*
+ * @brief Encode a record in the binary console format. buffer must hold LOG_MAX_RECORD_SIZE bytes.
+ */
+size_t logEncodeRecord(const LogRecord_t* record, uint8_t* buffer) {
+  size_t length = 0;
+
+  buffer[length++] = LOG_SYNC;
+  buffer[length++] = record->id;
+  buffer[length++] = (record->level << 4) | record->argc;
+  length += putVarint(buffer + length, record->timestamp);
+  for (uint8_t i = 0; i < record->argc; i++) {
+    length += putVarint(buffer + length, record->args[i]);
+  }
+
+  return length;
+}
+
+static size_t encode(const LogRecord_t* record, uint8_t* buffer) {
+#ifdef LOG_TEXT_OUTPUT
+  const uint32_t* a = record->args;
+  int length = 0;
+
+  if (record->id < LOG_EVENT_COUNT) {
+    // Unused trailing arguments are ignored by snprintf
+    length = snprintf((char*)buffer, sizeof(pending) - 2, eventFormats[record->id],
+                      (unsigned)a[0], (unsigned)a[1], (unsigned)a[2], (unsigned)a[3], (unsigned)a[4], (unsigned)a[5]);
+    length = min(length, (int)sizeof(pending) - 3);
+  }
+  buffer[length++] = '\r';
+  buffer[length++] = '\n';
+  return length;
+#else
+  return logEncodeRecord(record, buffer);
+#endif
+}
+
+/*
+ * @brief Write queued events to the console, but only as much as fits in its TX buffer without blocking.
+ * Call this when the scheduler is idle.
+ */
+void logDrain() {
+  for (;;) {
+    if (pendingPosition == pendingLength) {
+      if (dropped != droppedReported) {
+        LogRecord_t overflow = {(uint32_t)millis(), EVT_LOG_OVERFLOW, LOG_LEVEL_ERROR, 1, {dropped - droppedReported}};
+        droppedReported = dropped;
+        pendingLength = encode(&overflow, pending);
+      } else if (tail != head) {
+        pendingLength = encode(&records[tail], pending);
+        tail = (tail + 1) & (LOG_BUFFER_SIZE - 1);
+      } else {
+        return;
+      }
+      pendingPosition = 0;
+    }
+
+    size_t room = Serial.availableForWrite();
+    if (room == 0) {
+      return;
+    }
+
+    size_t chunk = min(room, pendingLength - pendingPosition);
+    Serial.write(pending + pendingPosition, chunk);
+    pendingPosition += chunk;
+  }
+}
+
+/*
+ * @brief Write a block of bytes (a host control frame) to the console between two log records, so neither ends up split
+ * by the other. Only writes if no record is partway out and the whole block fits in the UART's TX buffer; otherwise
+ * writes nothing and returns false, and the caller tries again later.
+ */
+bool logConsoleWrite(const uint8_t* data, size_t length) {
+  if (pendingPosition != pendingLength || (size_t)Serial.availableForWrite() < length) {
+    return false;
+  }
+
+  Serial.write(data, length);
+  return true;
+}
@@ -0,0 +1,64 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <Arduino.h>
+#include "config.h"
+#include "log_events.h"
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_NONE 3
+
+#ifndef LOG_LEVEL
+#ifdef __DEBUG__
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+// Entries in the ring buffer. Must be a power of two.
+#define LOG_BUFFER_SIZE 32
+#define LOG_MAX_ARGS 6
+
+/*
+ * Binary record format on the console, one per event:
+ *   LOG_SYNC, event ID, (level << 4) | argument count, timestamp in ms, arguments.
+ * The timestamp and arguments are unsigned LEB128 varints, so small values take one byte.
+ */
+#define LOG_SYNC 0xA5
+#define LOG_MAX_RECORD_SIZE (3 + 5 * (LOG_MAX_ARGS + 1))
+
+typedef struct {
+  uint32_t timestamp;
+  uint8_t id;
+  uint8_t level;
+  uint8_t argc;
+  uint32_t args[LOG_MAX_ARGS];
+} LogRecord_t;
+
+void logWrite(uint8_t level, uint8_t id, const uint32_t* args, uint8_t argc);
+void logDrain();
+uint32_t logDropped();
+size_t logEncodeRecord(const LogRecord_t* record, uint8_t* buffer);
+bool logConsoleWrite(const uint8_t* data, size_t length);
+
+/*
+ * @brief Record an event with up to LOG_MAX_ARGS integer arguments.
+ */
+template <typename... Args>
+inline void logEvent(uint8_t level, uint8_t id, Args... args) {
+  static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many log arguments");
+  const uint32_t argv[sizeof...(Args) + 1] = {(uint32_t)args...};
+  logWrite(level, id, argv, sizeof...(Args));
+}
+
+/*
+ * Levels below LOG_LEVEL compile to nothing.
+ */
+#define LOG_D(id, ...) do { if (LOG_LEVEL_DEBUG >= LOG_LEVEL) logEvent(LOG_LEVEL_DEBUG, id, ##__VA_ARGS__); } while (0)
+#define LOG_I(id, ...) do { if (LOG_LEVEL_INFO >= LOG_LEVEL) logEvent(LOG_LEVEL_INFO, id, ##__VA_ARGS__); } while (0)
+#define LOG_E(id, ...) do { if (LOG_LEVEL_ERROR >= LOG_LEVEL) logEvent(LOG_LEVEL_ERROR, id, ##__VA_ARGS__); } while (0)
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __LOG_EVENTS_H__
+#define __LOG_EVENTS_H__
+
+/*
+ * Every log event the firmware can emit, with the console text it stands for. Arguments are
+ * unsigned 32-bit integers, substituted into the format in order.
+ *
+ * Only append to this list: the host-side decoder identifies events by their position.
+ */
+#define LOG_EVENT_LIST(LOG_EVENT) \
+  LOG_EVENT(EVT_LOG_OVERFLOW, "E: Log buffer overflowed, %u events dropped") \
+  LOG_EVENT(EVT_BOOT, "I: Initializing potentiometers...") \
+  LOG_EVENT(EVT_BOOT_ADC_RESOLUTION, "I: Using an ADC resolution of %u bits") \
+  LOG_EVENT(EVT_BOOT_COOKTOP_SIZE, "I: Initializing generator boards for a %u inch cooktop...") \
+  LOG_EVENT(EVT_MAIN_LOOP_START, "I: Starting main loop...") \
+  LOG_EVENT(EVT_SCHEDULER_FULL, "E: Scheduler task table is full") \
+  LOG_EVENT(EVT_POT_VALUES, "I: Pot values: %u %u %u %u %u") \
+  LOG_EVENT(EVT_POWER_LEVELS, "I: Addr: 0x%02X Coil1: %u Coil2: %u") \
+  LOG_EVENT(EVT_POWER_OUT_OF_RANGE, "E: Zone values out of range for address 0x%02X") \
+  LOG_EVENT(EVT_POWER_TX_FAILED, "E: Failed to transmit zone control message to address 0x%02X") \
+  LOG_EVENT(EVT_CONFIG_TX_FAILED, "E: Failed to transmit config message to address 0x%02X") \
+  LOG_EVENT(EVT_BUS_REPORT, "I: Power frames sent: %u, skipped: %u, bus time saved: %u ms") \
+  LOG_EVENT(EVT_SW_VERSION, "I: Gen%u Software Version: %u.%u.%u.%u") \
+  LOG_EVENT(EVT_SW_VERSION_BAD_LENGTH, "E: Bad payload length: %u in software version message. Should be %u.") \
+  LOG_EVENT(EVT_STATUS, "I: Status for 0x%02X: Coil 0 Temp: %u*F, Coil 1 Temp: %u*F, H-Bridge 0 Temp: %u*F, H-Bridge 1 Temp: %u*F, AC Line Voltage: %uV") \
+  LOG_EVENT(EVT_STATUS_BAD_LENGTH, "E: Bad payload length: %u in status message. Should be %u.") \
+  LOG_EVENT(EVT_GEA_TX, "D: GEA TX: dst 0x%02X cmd 0x%02X, %u bytes, CRC 0x%04X") \
+  LOG_EVENT(EVT_GEA_TX_TOO_LARGE, "E: GEA TX payload too large") \
+  LOG_EVENT(EVT_GEA_NO_MEMORY, "E: Failed to allocate memory for a GEA message buffer") \
+  LOG_EVENT(EVT_GEA_BAD_ESCAPE, "E: Invalid escape sequence in GEA message") \
+  LOG_EVENT(EVT_GEA_TOO_SHORT, "E: Invalid GEA message: Too short") \
+  LOG_EVENT(EVT_GEA_BAD_SOF, "E: Invalid GEA message: Invalid STX received") \
+  LOG_EVENT(EVT_GEA_BAD_LENGTH, "E: Invalid GEA message: Length mismatch.") \
+  LOG_EVENT(EVT_GEA_BAD_CRC, "E: Invalid GEA message: Checksum mismatch.") \
+  LOG_EVENT(EVT_GEA_BAD_EOF, "E: Invalid GEA message: ETX not found or unexpected EOF.") \
+  LOG_EVENT(EVT_TELEMETRY_STALE, "E: No status from 0x%02X for %u ms") \
+  LOG_EVENT(EVT_TELEMETRY_REPORT, "I: Telemetry for 0x%02X: %u requests, %u responses, %u timeouts") \
+  LOG_EVENT(EVT_GEA_RX_TIMEOUT, "E: No response from 0x%02X to command 0x%02X") \
+  LOG_EVENT(EVT_POWER_CYCLE_TIMING, "I: Knob sample to last power byte: last %u us, avg %u us, max %u us over %u bursts") \
+  LOG_EVENT(EVT_PROBE_HISTOGRAM, "I: Latency 0x%02X span %u: n=%u avg %u us max %u us") \
+  LOG_EVENT(EVT_PROBE_BUCKETS, "I:   buckets %u-%u: %u %u %u %u") \
+  LOG_EVENT(EVT_GEA_LINK_RETRY, "D: Resending to 0x%02X cmd 0x%02X, retry %u") \
+  LOG_EVENT(EVT_GEA_LINK_FAILED, "E: Gave up on 0x%02X cmd 0x%02X after %u attempts") \
+  LOG_EVENT(EVT_GEA_LINK_REPORT, "I: Link 0x%02X: %u/%u frames ACKed, %u collisions, %u ACK timeouts, %u failed") \
+  LOG_EVENT(EVT_FAN_SPEED, "I: Fan speed %u (0 off, 1 low, 2 high), hottest coil %u*F, half-bridge %u*F") \
+  LOG_EVENT(EVT_THERMAL_REPORT, "I: Thermal 0x%02X: coil %u*F %d*F/min, half-bridge %u*F %d*F/min, status every %u ms") \
+  LOG_EVENT(EVT_GEA_TX_QUEUE_FULL, "E: GEA TX queue full, dropped frame to 0x%02X cmd 0x%02X") \
+  LOG_EVENT(EVT_GEA_TX_LATE, "E: Frame to 0x%02X cmd 0x%02X waited %u us for the wire, over the %u us bound") \
+  LOG_EVENT(EVT_GEA_TX_REPORT, "I: TX class %u: %u sent, %u coalesced, %u dropped, max wait %u byte-times") \
+  LOG_EVENT(EVT_GEA_TX_BURST_REPORT, "I: Power bursts: %u frames, max wait %u byte-times, bound %u") \
+  LOG_EVENT(EVT_BOARD_ANSWERED, "I: Board 0x%02X answered %u ms after power on, probe %u") \
+  LOG_EVENT(EVT_BOARD_READY, "I: Board 0x%02X ready %u ms after power on, config %u") \
+  LOG_EVENT(EVT_BOARD_MISSING, "E: Board 0x%02X of the %u inch cooktop isn't ready in time, still trying: %u probes, %u configs sent") \
+  LOG_EVENT(EVT_BOARD_EXTRA, "E: Board 0x%02X answered but isn't part of the %u inch cooktop, leaving it unconfigured") \
+  LOG_EVENT(EVT_BOOT_TIMING, "I: Boards ready %u ms after power on: first answer %u ms, all answered %u ms, %u of %u ready, %u extra") \
+  LOG_EVENT(EVT_HOST_OVERRIDE_TIMEOUT, "E: Host stopped refreshing knob overrides 0x%02X for %u ms, back to the pots") \
+  LOG_EVENT(EVT_KNOB_CALIBRATION_LOADED, "I: Loaded the stored calibrations of %u knobs") \
+  LOG_EVENT(EVT_KNOB_CALIBRATION_DEFAULT, "I: No knob calibration stored (version %u), using the defaults") \
+  LOG_EVENT(EVT_KNOB_CALIBRATED, "I: Knob %u calibrated: stops at %u and %u, off zone %u, curve %u") \
+  LOG_EVENT(EVT_KNOB_CALIBRATION_SAVED, "I: Stored the calibrations of %u knobs")
+
+#define LOG_EVENT_ENUM(id, format) id,
+
+typedef enum {
+  LOG_EVENT_LIST(LOG_EVENT_ENUM)
+  LOG_EVENT_COUNT
+} LogEventId;
+
+#endif
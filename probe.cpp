@@ -0,0 +1,266 @@
+#include "probe.h"
+
+#ifdef LATENCY_PROBES
+
+#include "scheduler.h"
+#include "log.h"
+
+#if defined(ARDUINO_HOST) && defined(PROBE_HOST_WALL_CLOCK)
+#include <chrono>
+#define PROBE_TICKS_PER_US 1000
+#elif defined(ARDUINO_HOST)
+#include "host_runtime.h"
+#define PROBE_TICKS_PER_US 1
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define PROBE_USE_DWT
+#define PROBE_TICKS_PER_US (SystemCoreClock / 1000000)
+#else
+#define PROBE_TICKS_PER_US 1
+#endif
+
+// Gap between dump records, so a dump doesn't overflow the log ring
+#define PROBE_DUMP_STEP_MS 20
+
+static ProbeBoard_t boards[PROBE_MAX_BOARDS];
+static ProbeCommand_t commands[PROBE_MAX_COMMANDS];
+static ProbeTime lastKnobSample;
+static int dumpIndex;
+
+static_assert(sizeof(boards) + sizeof(commands) <= RAM_BUDGET_PROBE, "Latency histograms are over their RAM budget (config.h)");
+
+void probeBegin() {
+#ifdef PROBE_USE_DWT
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+  memset(boards, 0, sizeof(boards));
+  memset(commands, 0, sizeof(commands));
+}
+
+ProbeTime probeNow() {
+#if defined(ARDUINO_HOST) && defined(PROBE_HOST_WALL_CLOCK)
+  return (ProbeTime)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#elif defined(ARDUINO_HOST)
+  // The simulated bus runs in virtual time, so wall time would only measure the simulator
+  return (ProbeTime)hostNowMicros();
+#elif defined(PROBE_USE_DWT)
+  return DWT->CYCCNT;
+#else
+  return micros();
+#endif
+}
+
+/*
+ * @brief Microseconds between two timestamps. Unsigned subtraction handles one counter wrap
+ * (about 25 s for the DWT counter at 168 MHz).
+ */
+uint32_t probeMicros(ProbeTime start, ProbeTime end) {
+  return (end - start) / PROBE_TICKS_PER_US;
+}
+
+void probeHistogramAdd(LatencyHistogram_t* histogram, uint32_t micros) {
+  int bucket = 0;
+  while (bucket < PROBE_BUCKETS - 1 && micros >= ((uint32_t)PROBE_FIRST_BUCKET_US << bucket)) {
+    bucket++;
+  }
+
+  histogram->buckets[bucket]++;
+  histogram->count++;
+  histogram->totalMicros += micros;
+  if (micros > histogram->maxMicros) {
+    histogram->maxMicros = micros;
+  }
+}
+
+/*
+ * @brief Find a board's probe record, claiming a free one the first time it's seen. Returns NULL if the table is full.
+ */
+static ProbeBoard_t* board(uint8_t address) {
+  for (int i = 0; i < PROBE_MAX_BOARDS; i++) {
+    if (boards[i].address == address) {
+      return &boards[i];
+    }
+    if (boards[i].address == 0) {
+      boards[i].address = address;
+      return &boards[i];
+    }
+  }
+  return NULL;
+}
+
+static ProbeCommand_t* command(uint8_t code) {
+  for (int i = 0; i < PROBE_MAX_COMMANDS; i++) {
+    if (commands[i].used && commands[i].command == code) {
+      return &commands[i];
+    }
+    if (!commands[i].used) {
+      commands[i].used = true;
+      commands[i].command = code;
+      return &commands[i];
+    }
+  }
+  return NULL;
+}
+
+static void span(ProbeBoard_t* record, ProbeBoardSpan span, ProbeTime start, ProbeTime end) {
+  probeHistogramAdd(&record->spans[span], probeMicros(start, end));
+}
+
+void probeKnobSample() {
+  lastKnobSample = probeNow();
+}
+
+void probeLevelChange(uint8_t address) {
+  ProbeBoard_t* record = board(address);
+  if (record == NULL) {
+    return;
+  }
+
+  record->change = probeNow();
+  record->knob = lastKnobSample;
+  record->changePending = true;
+  span(record, SPAN_KNOB_TO_CHANGE, record->knob, record->change);
+}
+
+/*
+ * @brief A board's power frame went into the burst being built for bus.
+ */
+void probeEnqueue(uint8_t address, uint8_t bus) {
+  ProbeBoard_t* record = board(address);
+  if (record == NULL) {
+    return;
+  }
+
+  record->enqueue = probeNow();
+  record->bus = bus;
+  record->txPending = true;
+  record->firstByteSeen = false;
+  if (record->changePending) {
+    span(record, SPAN_CHANGE_TO_ENQUEUE, record->change, record->enqueue);
+  }
+}
+
+/*
+ * @brief The first byte of a bus's burst went to the UART. Applies to every frame put in that burst.
+ */
+void probeTxFirstByte(uint8_t bus) {
+  ProbeTime now = probeNow();
+
+  for (int i = 0; i < PROBE_MAX_BOARDS; i++) {
+    ProbeBoard_t* record = &boards[i];
+    if (record->txPending && record->bus == bus && !record->firstByteSeen) {
+      record->firstByteSeen = true;
+      span(record, SPAN_ENQUEUE_TO_FIRST_BYTE, record->enqueue, now);
+    }
+  }
+}
+
+/*
+ * @brief The last byte of a bus's burst went to the UART's TX buffer.
+ */
+void probeTxLastByte(uint8_t bus) {
+  ProbeTime now = probeNow();
+
+  for (int i = 0; i < PROBE_MAX_BOARDS; i++) {
+    ProbeBoard_t* record = &boards[i];
+    if (!record->txPending || record->bus != bus) {
+      continue;
+    }
+
+    span(record, SPAN_ENQUEUE_TO_LAST_BYTE, record->enqueue, now);
+    if (record->changePending) {
+      span(record, SPAN_KNOB_TO_LAST_BYTE, record->knob, now);
+    }
+    record->txPending = false;
+    record->changePending = false;
+  }
+}
+
+/*
+ * @brief A request went out to a board. It replaces one that never got its response, e.g. because it timed out.
+ */
+void probeRequest(uint8_t address, uint8_t code) {
+  ProbeBoard_t* record = board(address);
+  if (record != NULL) {
+    record->request = probeNow();
+    record->requestCommand = code;
+    record->requestPending = true;
+  }
+}
+
+/*
+ * @brief A board answered. Only a response to the request it has pending counts as a round trip, so an unsolicited frame
+ * neither adds a bogus span nor takes up a command slot.
+ */
+void probeResponse(uint8_t address, uint8_t code) {
+  ProbeBoard_t* record = board(address);
+  if (record == NULL || !record->requestPending || record->requestCommand != code) {
+    return;
+  }
+
+  record->requestPending = false;
+  ProbeCommand_t* entry = command(code);
+  if (entry != NULL) {
+    probeHistogramAdd(&entry->roundTrip, probeMicros(record->request, probeNow()));
+  }
+}
+
+const ProbeBoard_t* probeBoard(int index) {
+  return index < PROBE_MAX_BOARDS ? &boards[index] : NULL;
+}
+
+const ProbeCommand_t* probeCommand(int index) {
+  return index < PROBE_MAX_COMMANDS ? &commands[index] : NULL;
+}
+
+/*
+ * @brief Log one histogram: a summary record, then the bucket counts four at a time.
+ */
+static void dumpHistogram(uint8_t key, uint8_t span, const LatencyHistogram_t* histogram) {
+  const uint32_t* b = histogram->buckets;
+
+  LOG_I(EVT_PROBE_HISTOGRAM, key, span, histogram->count,
+        histogram->count > 0 ? (uint32_t)(histogram->totalMicros / histogram->count) : 0, histogram->maxMicros);
+  for (int i = 0; i < PROBE_BUCKETS; i += 4) {
+    LOG_I(EVT_PROBE_BUCKETS, i, i + 3, b[i], b[i + 1], b[i + 2], b[i + 3]);
+  }
+}
+
+/*
+ * @brief Dump one histogram per step, then schedule the next, so the log ring never fills up.
+ * Board spans come first, then the per-command round trips (reported as span 0xFF).
+ */
+static void dumpStep(void* context) {
+  const int boardEntries = PROBE_MAX_BOARDS * SPAN_BOARD_COUNT;
+
+  while (dumpIndex < boardEntries + PROBE_MAX_COMMANDS) {
+    int index = dumpIndex++;
+
+    if (index < boardEntries) {
+      const ProbeBoard_t* record = &boards[index / SPAN_BOARD_COUNT];
+      const LatencyHistogram_t* histogram = &record->spans[index % SPAN_BOARD_COUNT];
+      if (record->address != 0 && histogram->count > 0) {
+        dumpHistogram(record->address, index % SPAN_BOARD_COUNT, histogram);
+        break;
+      }
+    } else {
+      const ProbeCommand_t* entry = &commands[index - boardEntries];
+      if (entry->used && entry->roundTrip.count > 0) {
+        dumpHistogram(entry->command, 0xFF, &entry->roundTrip);
+        break;
+      }
+    }
+  }
+
+  if (dumpIndex < boardEntries + PROBE_MAX_COMMANDS) {
+    schedulerAddOneShot(dumpStep, NULL, PROBE_DUMP_STEP_MS);
+  }
+}
+
+void probeDumpStart() {
+  dumpIndex = 0;
+  schedulerAddOneShot(dumpStep, NULL, 0);
+}
+
+#endif
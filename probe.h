@@ -0,0 +1,109 @@
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+#include <Arduino.h>
+#include "config.h"
+
+/*
+ * Latency probes. Each probe point stamps the current time; spans between probe points are
+ * collected into fixed-bucket histograms, per generator board for the power path and per command
+ * for request/response round trips. Dump them with probeDumpStart() (or 'h' on the console).
+ *
+ * Timestamps come from the DWT cycle counter on Cortex-M3/M4/M7, from the virtual clock on the
+ * host simulator (or steady_clock with PROBE_HOST_WALL_CLOCK), and from micros() elsewhere.
+ *
+ * Without LATENCY_PROBES every PROBE_* macro compiles to nothing.
+ */
+
+// Bucket i counts spans below PROBE_FIRST_BUCKET_US << i; the last bucket takes everything longer
+#define PROBE_BUCKETS 16
+#define PROBE_FIRST_BUCKET_US 128
+#define PROBE_MAX_BOARDS 4
+#define PROBE_MAX_COMMANDS 8
+
+typedef uint32_t ProbeTime;
+
+/*
+ * Spans kept for every board.
+ */
+typedef enum {
+  SPAN_KNOB_TO_CHANGE, //        Knob sample that moved a level until the power path noticed it
+  SPAN_CHANGE_TO_ENQUEUE, //     Level change until its frame was queued for TX
+  SPAN_ENQUEUE_TO_FIRST_BYTE, // Frame queued until the first byte of its burst was written to the UART
+  SPAN_ENQUEUE_TO_LAST_BYTE, //  Frame queued until the last byte of its burst was written to the UART
+  SPAN_KNOB_TO_LAST_BYTE, //     Knob sample until the last byte was written to the UART
+  SPAN_BOARD_COUNT
+} ProbeBoardSpan;
+
+typedef struct {
+  uint32_t count;
+  uint32_t maxMicros;
+  uint64_t totalMicros;
+  uint32_t buckets[PROBE_BUCKETS];
+} LatencyHistogram_t;
+
+typedef struct {
+  uint8_t address;
+  bool changePending; // The queued frame carries a level change, not just a keepalive
+  bool txPending; //     A frame is queued and its burst hasn't been fully written yet
+  bool firstByteSeen;
+  uint8_t bus; //        Bus the queued frame's burst goes out on
+  bool requestPending; // A request is waiting for its response. Boards have one in flight at a time (gea_transaction.h).
+  uint8_t requestCommand;
+  ProbeTime knob;
+  ProbeTime change;
+  ProbeTime enqueue;
+  ProbeTime request; //  When the pending request was sent
+  LatencyHistogram_t spans[SPAN_BOARD_COUNT];
+} ProbeBoard_t;
+
+typedef struct {
+  uint8_t command;
+  bool used;
+  LatencyHistogram_t roundTrip;
+} ProbeCommand_t;
+
+#ifdef LATENCY_PROBES
+
+void probeBegin();
+ProbeTime probeNow();
+uint32_t probeMicros(ProbeTime start, ProbeTime end);
+void probeHistogramAdd(LatencyHistogram_t* histogram, uint32_t micros);
+
+void probeKnobSample();
+void probeLevelChange(uint8_t address);
+void probeEnqueue(uint8_t address, uint8_t bus);
+void probeTxFirstByte(uint8_t bus);
+void probeTxLastByte(uint8_t bus);
+void probeRequest(uint8_t address, uint8_t command);
+void probeResponse(uint8_t address, uint8_t command);
+
+const ProbeBoard_t* probeBoard(int index);
+const ProbeCommand_t* probeCommand(int index);
+void probeDumpStart();
+
+#define PROBE_BEGIN() probeBegin()
+#define PROBE_KNOB_SAMPLE() probeKnobSample()
+#define PROBE_LEVEL_CHANGE(address) probeLevelChange(address)
+#define PROBE_ENQUEUE(address, bus) probeEnqueue(address, bus)
+#define PROBE_TX_FIRST_BYTE(bus) probeTxFirstByte(bus)
+#define PROBE_TX_LAST_BYTE(bus) probeTxLastByte(bus)
+#define PROBE_REQUEST(address, command) probeRequest(address, command)
+#define PROBE_RESPONSE(address, command) probeResponse(address, command)
+#define PROBE_DUMP() probeDumpStart()
+
+#else
+
+#define PROBE_BEGIN() do {} while (0)
+#define PROBE_KNOB_SAMPLE() do {} while (0)
+#define PROBE_LEVEL_CHANGE(address) do {} while (0)
+#define PROBE_ENQUEUE(address, bus) do {} while (0)
+#define PROBE_TX_FIRST_BYTE(bus) do {} while (0)
+#define PROBE_TX_LAST_BYTE(bus) do {} while (0)
+#define PROBE_REQUEST(address, command) do {} while (0)
+#define PROBE_RESPONSE(address, command) do {} while (0)
+#define PROBE_DUMP() do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+#include "scheduler.h"
+#include "log.h"
+#include "config.h"
+
+static Task_t tasks[MAX_TASKS];
+
+static_assert(sizeof(tasks) <= RAM_BUDGET_SCHEDULER, "Task table is over its RAM budget (config.h)");
+
+/*
+ * @brief Returns true if the millis() timestamp has been reached, handling wraparound.
+ */
+static bool timeReached(uint32_t now, uint32_t deadline) {
+  return (int32_t)(now - deadline) >= 0;
+}
+
+static int schedulerAdd(TaskCallback callback, void* context, uint32_t periodMs, uint32_t delayMs) {
+  for (int i = 0; i < MAX_TASKS; i++) {
+    if (!tasks[i].active) {
+      tasks[i].callback = callback;
+      tasks[i].context = context;
+      tasks[i].periodMs = periodMs;
+      tasks[i].nextRunMs = millis() + delayMs;
+      tasks[i].active = true;
+      return i;
+    }
+  }
+
+  LOG_E(EVT_SCHEDULER_FULL);
+  return -1;
+}
+
+/*
+ * @brief Register a task that runs every periodMs, starting initialDelayMs from now. Returns a task ID or -1.
+ */
+int schedulerAddPeriodic(TaskCallback callback, void* context, uint32_t periodMs, uint32_t initialDelayMs) {
+  return schedulerAdd(callback, context, periodMs, initialDelayMs);
+}
+
+/*
+ * @brief Register a task that runs once, delayMs from now. Returns a task ID or -1.
+ */
+int schedulerAddOneShot(TaskCallback callback, void* context, uint32_t delayMs) {
+  return schedulerAdd(callback, context, 0, delayMs);
+}
+
+/*
+ * @brief Change the period of a periodic task. Takes effect after its next run.
+ */
+void schedulerSetPeriod(int taskId, uint32_t periodMs) {
+  if (taskId >= 0 && taskId < MAX_TASKS) {
+    tasks[taskId].periodMs = periodMs;
+  }
+}
+
+void schedulerCancel(int taskId) {
+  if (taskId >= 0 && taskId < MAX_TASKS) {
+    tasks[taskId].active = false;
+  }
+}
+
+/*
+ * @brief Run every task that is due. Call this from loop() as often as possible; it never blocks.
+ * Returns false if nothing was due, i.e. the rest of this pass is idle time.
+ */
+bool schedulerRun() {
+  bool ran = false;
+
+  for (int i = 0; i < MAX_TASKS; i++) {
+    Task_t* task = &tasks[i];
+
+    if (!task->active || !timeReached(millis(), task->nextRunMs)) {
+      continue;
+    }
+
+    if (task->periodMs == 0) {
+      // Deactivate first so the callback can reuse the slot to reschedule itself
+      task->active = false;
+    } else {
+      task->nextRunMs += task->periodMs;
+
+      // Skip missed periods instead of running the task back-to-back to catch up
+      if (timeReached(millis(), task->nextRunMs)) {
+        task->nextRunMs = millis() + task->periodMs;
+      }
+    }
+
+    task->callback(task->context);
+    ran = true;
+  }
+
+  return ran;
+}
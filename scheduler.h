@@ -0,0 +1,27 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <Arduino.h>
+
+#define MAX_TASKS 16
+
+typedef void (*TaskCallback)(void* context);
+
+/*
+ * A periodic or one-shot task. One-shot tasks have a period of 0.
+ */
+typedef struct {
+  TaskCallback callback;
+  void* context;
+  uint32_t periodMs;
+  uint32_t nextRunMs;
+  bool active;
+} Task_t;
+
+int schedulerAddPeriodic(TaskCallback callback, void* context, uint32_t periodMs, uint32_t initialDelayMs);
+int schedulerAddOneShot(TaskCallback callback, void* context, uint32_t delayMs);
+void schedulerSetPeriod(int taskId, uint32_t periodMs);
+void schedulerCancel(int taskId);
+bool schedulerRun();
+
+#endif
@@ -0,0 +1,122 @@
+#include "telemetry.h"
+#include "config.h"
+#include "log.h"
+#include "gea_transaction.h"
+
+static BoardTelemetry_t boards[MAX_TELEMETRY_BOARDS];
+static int boardCount;
+
+static void lateStatusHandler(const GeaMessageView& message, void* context);
+
+void telemetryInit() {
+  memset(boards, 0, sizeof(boards));
+  boardCount = 0;
+  geaRegisterHandler(CMD_GET_STATUS, lateStatusHandler, NULL);
+}
+
+/*
+ * @brief Add a board to the poll rotation, with the status request to send it. Returns its index, or -1 if the table is full.
+ */
+int telemetryAddBoard(const GeaEncodedFrame_t* statusRequest) {
+  if (boardCount == MAX_TELEMETRY_BOARDS) {
+    return -1;
+  }
+
+  BoardTelemetry_t* board = &boards[boardCount];
+  memset(board, 0, sizeof(BoardTelemetry_t));
+  board->address = statusRequest->destination;
+  board->statusRequest = statusRequest;
+  board->intervalMs = TELEMETRY_DEFAULT_INTERVAL_MS;
+  return boardCount++;
+}
+
+int telemetryBoardCount() {
+  return boardCount;
+}
+
+const BoardTelemetry_t* telemetryBoard(int index) {
+  return &boards[index];
+}
+
+void telemetrySetInterval(int index, uint32_t intervalMs) {
+  boards[index].intervalMs = intervalMs;
+}
+
+/*
+ * @brief Update a board's cache from a status response.
+ */
+static void storeStatus(BoardTelemetry_t* board, const GeaMessageView& message) {
+  if (!StatusLayout::decode(message, &board->status)) {
+    LOG_E(EVT_STATUS_BAD_LENGTH, message.payloadLength(), RESP_LENGTH_STATUS);
+    return;
+  }
+
+  board->valid = true;
+  board->stale = false;
+  board->receivedMs = millis();
+  board->responses++;
+}
+
+static void statusResponse(GeaResult result, const GeaMessageView& message, void* context) {
+  BoardTelemetry_t* board = (BoardTelemetry_t*)context;
+
+  board->awaiting = false;
+  if (result == GEA_RESULT_OK) {
+    storeStatus(board, message);
+  } else {
+    board->timeouts++;
+  }
+}
+
+/*
+ * @brief A status response that arrived after its request timed out is still the newest reading, so keep it.
+ */
+static void lateStatusHandler(const GeaMessageView& message, void* context) {
+  for (int i=0; i<boardCount; i++) {
+    if (boards[i].address == message.source()) {
+      storeStatus(&boards[i], message);
+      return;
+    }
+  }
+}
+
+/*
+ * @brief Send a status request to the board most overdue for one, without waiting for the answer. At most one request
+ * goes out per run, so boards that fall due together are spread out instead of queueing on the bus.
+ */
+void telemetryPollTask(void* context) {
+  uint32_t now = millis();
+  BoardTelemetry_t* due = NULL;
+  uint32_t dueBy = 0;
+
+  for (int i=0; i<boardCount; i++) {
+    BoardTelemetry_t* board = &boards[i];
+
+    bool stale = !board->valid || now - board->receivedMs > TELEMETRY_STALE_MS;
+    if (stale && !board->stale && board->valid) {
+      LOG_E(EVT_TELEMETRY_STALE, board->address, now - board->receivedMs);
+    }
+    board->stale = stale;
+
+    uint32_t waited = now - board->requestedMs;
+    if (board->awaiting || (board->requests > 0 && waited < board->intervalMs)) {
+      continue;
+    }
+    // Never-polled boards go first
+    uint32_t overdue = board->requests > 0 ? waited - board->intervalMs : UINT32_MAX;
+    if (due == NULL || overdue > dueBy) {
+      due = board;
+      dueBy = overdue;
+    }
+  }
+
+  if (due == NULL) {
+    return;
+  }
+
+  if (geaRequest(due->statusRequest, GEA_PRIORITY_TELEMETRY, TELEMETRY_RESPONSE_TIMEOUT_MS, statusResponse, due) == 0) {
+    due->awaiting = true;
+    due->requestedMs = now;
+    due->requests++;
+  }
+}
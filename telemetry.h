@@ -0,0 +1,59 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <Arduino.h>
+#include "gea_core.h"
+#include "generator_board.h"
+
+#define MAX_TELEMETRY_BOARDS 3
+
+/*
+ * Latest status reading from one generator board, kept up to date in the background by
+ * telemetryPollTask() at the board's own interval. Nothing here ever waits on the bus.
+ */
+typedef struct {
+  uint8_t address;
+  const GeaEncodedFrame_t* statusRequest; // Encoded at compile time, from the cooktop table
+  bool valid; //      At least one status response has been received
+  bool stale; //      No response for longer than TELEMETRY_STALE_MS
+  bool awaiting; //   A request is in flight
+  Status_t status;
+  uint32_t receivedMs;
+  uint32_t requestedMs;
+  uint32_t intervalMs; // How often to request status, set by the thermal controller
+  uint32_t requests;
+  uint32_t responses;
+  uint32_t timeouts;
+} BoardTelemetry_t;
+
+void telemetryInit();
+int telemetryAddBoard(const GeaEncodedFrame_t* statusRequest);
+void telemetryPollTask(void* context);
+void telemetrySetInterval(int index, uint32_t intervalMs);
+
+int telemetryBoardCount();
+const BoardTelemetry_t* telemetryBoard(int index);
+
+/*
+ * @brief Cached readings by board index. They return 0 until the first response arrives; check telemetryIsFresh() where it matters.
+ */
+inline bool telemetryIsFresh(int index) {
+  const BoardTelemetry_t* board = telemetryBoard(index);
+  return board->valid && !board->stale;
+}
+
+inline uint16_t telemetryCoilTemp(int index, int coil) {
+  const Status_t* status = &telemetryBoard(index)->status;
+  return coil == 0 ? status->coil0_temp : status->coil1_temp;
+}
+
+inline uint16_t telemetryHalfBridgeTemp(int index, int bridge) {
+  const Status_t* status = &telemetryBoard(index)->status;
+  return bridge == 0 ? status->halfBridge0_temp : status->halfBridge1_temp;
+}
+
+inline uint16_t telemetryAcLineVoltage(int index) {
+  return telemetryBoard(index)->status.acLineVoltage;
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "thermal.h"
+#include "config.h"
+#include "log.h"
+
+static ThermalBoard_t boards[MAX_TELEMETRY_BOARDS];
+static FanSpeed fanSpeed;
+static uint32_t fanChanges;
+
+// Shared with telemetry.cpp, whose table is the same length
+static_assert(sizeof(boards) + MAX_TELEMETRY_BOARDS * sizeof(BoardTelemetry_t) <= RAM_BUDGET_TELEMETRY,
+              "Telemetry and thermal state are over their RAM budget (config.h)");
+
+static void driveFan(FanSpeed speed) {
+  // Separate outputs for the two windings, so only one is ever on
+  digitalWrite(fanLowPin, speed == FAN_LOW ? HIGH : LOW);
+  digitalWrite(fanHighPin, speed == FAN_HIGH ? HIGH : LOW);
+}
+
+void thermalInit() {
+  memset(boards, 0, sizeof(boards));
+  for (int i=0; i<MAX_TELEMETRY_BOARDS; i++) {
+    boards[i].intervalMs = TELEMETRY_DEFAULT_INTERVAL_MS;
+  }
+  fanSpeed = FAN_OFF;
+  fanChanges = 0;
+  driveFan(FAN_OFF);
+}
+
+static uint16_t hotter(uint16_t a, uint16_t b) {
+  return a > b ? a : b;
+}
+
+/*
+ * @brief Fold a new status reading into a board's trends. Slopes are taken over at least THERMAL_SLOPE_WINDOW_MS and
+ * averaged with the previous one, so a single 1 degree step doesn't read as a steep climb.
+ */
+static void takeSample(ThermalBoard_t* thermal, const BoardTelemetry_t* board) {
+  const Status_t* status = &board->status;
+
+  thermal->coilTemp = hotter(status->coil0_temp, status->coil1_temp);
+  thermal->bridgeTemp = hotter(status->halfBridge0_temp, status->halfBridge1_temp);
+
+  if (thermal->refMs == 0) {
+    thermal->refCoilTemp = thermal->coilTemp;
+    thermal->refBridgeTemp = thermal->bridgeTemp;
+    thermal->refMs = board->receivedMs;
+    return;
+  }
+
+  int32_t elapsed = board->receivedMs - thermal->refMs;
+  if (elapsed < THERMAL_SLOPE_WINDOW_MS) {
+    return;
+  }
+
+  int32_t coilSlope = ((int32_t)thermal->coilTemp - thermal->refCoilTemp) * 60000L / elapsed;
+  int32_t bridgeSlope = ((int32_t)thermal->bridgeTemp - thermal->refBridgeTemp) * 60000L / elapsed;
+  thermal->coilSlope = (thermal->coilSlope + coilSlope) / 2;
+  thermal->bridgeSlope = (thermal->bridgeSlope + bridgeSlope) / 2;
+  thermal->refCoilTemp = thermal->coilTemp;
+  thermal->refBridgeTemp = thermal->bridgeTemp;
+  thermal->refMs = board->receivedMs;
+}
+
+/*
+ * @brief Fan speed one reading asks for, given the current speed: it steps up at an ON threshold and only steps down
+ * once it's below the matching OFF threshold.
+ */
+static FanSpeed demand(uint16_t temp, uint16_t lowOn, uint16_t lowOff, uint16_t highOn, uint16_t highOff) {
+  if (temp >= highOn || (fanSpeed == FAN_HIGH && temp > highOff)) {
+    return FAN_HIGH;
+  }
+  if (temp >= lowOn || (fanSpeed >= FAN_LOW && temp > lowOff)) {
+    return FAN_LOW;
+  }
+  return FAN_OFF;
+}
+
+static uint32_t pollInterval(const ThermalBoard_t* thermal, const BoardTelemetry_t* board) {
+  if (!board->valid) {
+    return THERMAL_POLL_SLOW_MS;
+  }
+
+  bool hot = thermal->coilTemp >= FAN_LOW_ON_COIL_F || thermal->bridgeTemp >= FAN_LOW_ON_BRIDGE_F;
+  bool rising = thermal->coilSlope > THERMAL_RISING_F_PER_MIN || thermal->bridgeSlope > THERMAL_RISING_F_PER_MIN;
+  bool falling = thermal->coilSlope < -THERMAL_RISING_F_PER_MIN || thermal->bridgeSlope < -THERMAL_RISING_F_PER_MIN;
+
+  if (hot || rising) {
+    return THERMAL_POLL_FAST_MS;
+  }
+  if (thermal->power > 0) {
+    return THERMAL_POLL_SLOW_MS - (uint32_t)(THERMAL_POLL_SLOW_MS - THERMAL_POLL_FAST_MS) * thermal->power / maxPowerSteps;
+  }
+  return falling ? THERMAL_POLL_SLOW_MS : THERMAL_POLL_IDLE_MS;
+}
+
+/*
+ * @brief Take in new status readings, pick the fan speed and set each board's status poll interval.
+ */
+void thermalTask(void* context) {
+  const PowerShadow_t* shadows = (const PowerShadow_t*)context;
+  FanSpeed speed = FAN_OFF;
+  uint16_t coilTemp = 0;
+  uint16_t bridgeTemp = 0;
+
+  for (int i=0; i<telemetryBoardCount(); i++) {
+    ThermalBoard_t* thermal = &boards[i];
+    const BoardTelemetry_t* board = telemetryBoard(i);
+
+    if (board->responses != thermal->responses) {
+      thermal->responses = board->responses;
+      takeSample(thermal, board);
+    }
+    thermal->power = shadows[i].coil1Level > shadows[i].coil2Level ? shadows[i].coil1Level : shadows[i].coil2Level;
+
+    FanSpeed wanted = FAN_OFF;
+    if (board->valid) {
+      wanted = demand(thermal->coilTemp, FAN_LOW_ON_COIL_F, FAN_LOW_OFF_COIL_F, FAN_HIGH_ON_COIL_F, FAN_HIGH_OFF_COIL_F);
+      FanSpeed bridge = demand(thermal->bridgeTemp, FAN_LOW_ON_BRIDGE_F, FAN_LOW_OFF_BRIDGE_F, FAN_HIGH_ON_BRIDGE_F, FAN_HIGH_OFF_BRIDGE_F);
+      wanted = bridge > wanted ? bridge : wanted;
+      coilTemp = hotter(coilTemp, thermal->coilTemp);
+      bridgeTemp = hotter(bridgeTemp, thermal->bridgeTemp);
+    }
+    if (thermal->power > 0) {
+      // No point waiting for the sensors to catch up with a coil that's on, and no reading at all is the worst case
+      wanted = board->stale ? FAN_HIGH : (wanted > FAN_LOW ? wanted : FAN_LOW);
+    }
+    speed = wanted > speed ? wanted : speed;
+
+    uint32_t interval = pollInterval(thermal, board);
+    if (interval != thermal->intervalMs) {
+      thermal->intervalMs = interval;
+      telemetrySetInterval(i, interval);
+    }
+  }
+
+  if (speed != fanSpeed) {
+    fanSpeed = speed;
+    fanChanges++;
+    driveFan(speed);
+    LOG_I(EVT_FAN_SPEED, speed, coilTemp, bridgeTemp);
+  }
+}
+
+FanSpeed thermalFanSpeed() {
+  return fanSpeed;
+}
+
+uint32_t thermalFanChanges() {
+  return fanChanges;
+}
+
+const ThermalBoard_t* thermalBoard(int index) {
+  return &boards[index];
+}
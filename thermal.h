@@ -0,0 +1,43 @@
+#ifndef __THERMAL_H__
+#define __THERMAL_H__
+
+#include <Arduino.h>
+#include "generator_board.h"
+#include "telemetry.h"
+
+/*
+ * Thermal controller. Follows each board's coil and half-bridge temperatures from its status
+ * responses, runs the cooling fan off, low or high with hysteresis, and tells telemetry how often
+ * to poll each board: fast while it's hot or heating up, slow while it's idle, so the bus only
+ * carries status traffic when the thermal state is actually changing.
+ *
+ * thermalTask() takes the power shadows as its context, indexed like the telemetry boards.
+ */
+
+typedef enum {
+  FAN_OFF,
+  FAN_LOW,
+  FAN_HIGH
+} FanSpeed;
+
+typedef struct {
+  uint32_t responses; //    telemetry responses already taken in
+  uint16_t coilTemp; //     Hottest coil, degrees F
+  uint16_t bridgeTemp; //   Hottest half-bridge, degrees F
+  int16_t coilSlope; //     Filtered trends, degrees F per minute
+  int16_t bridgeSlope;
+  uint16_t refCoilTemp; //  Readings the next slope is measured from
+  uint16_t refBridgeTemp;
+  uint32_t refMs;
+  uint8_t power; //         Highest commanded coil level
+  uint32_t intervalMs; //   Status poll interval handed to telemetry
+} ThermalBoard_t;
+
+void thermalInit();
+void thermalTask(void* context);
+
+FanSpeed thermalFanSpeed();
+uint32_t thermalFanChanges();
+const ThermalBoard_t* thermalBoard(int index);
+
+#endif
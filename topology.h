@@ -0,0 +1,208 @@
+#ifndef __TOPOLOGY_H__
+#define __TOPOLOGY_H__
+
+#include <Arduino.h>
+#include <utility>
+#include "config.h"
+#include "generator_board.h"
+#include "telemetry.h"
+#include "gea_transaction.h"
+#include "gea_link.h"
+#include "gea_const_frame.h"
+
+#define POT_NONE -1
+#define MAX_GENERATORS 3
+#define GEA_BUS(n) ((n) % GEA_BUS_COUNT)
+
+/*
+ * A cooktop's wiring, described once at compile time: which generator boards it has, what coils
+ * hang off each board, and which pot (an index into potPins) drives each coil.
+ *
+ *   struct MyCooktop {
+ *     static constexpr uint8_t sizeInches = 30;
+ *     static constexpr BoardSpec_t boards[] = {
+ *       {GEN1_ADDR, GEA_BUS(0), {COIL_TYPE_2500_WATT, 0}, {COIL_TYPE_NONE, POT_NONE}, GENERATOR_KEEPALIVE_MS},
+ *     };
+ *   };
+ *
+ * Each board also names the GEA bus (UART) it's wired to. GEA_BUS(n) folds bus n onto the
+ * GEA_BUS_COUNT buses that are actually wired up, so the same table works with one shared bus.
+ *
+ * makeCooktop<MyCooktop>() checks the table with static_asserts and turns it into a Cooktop_t whose
+ * functions are instantiated for that table, so each board's update compiles to straight-line code
+ * with the addresses and pot indexes as constants. Every frame to a board that never changes is
+ * encoded from the table at compile time too (BoardFrames_t).
+ */
+
+typedef struct {
+  uint8_t profile;
+  int8_t pot;
+} CoilSpec_t;
+
+typedef struct {
+  uint8_t address;
+  uint8_t bus;
+  CoilSpec_t coil1;
+  CoilSpec_t coil2;
+  uint32_t keepaliveMs;
+} BoardSpec_t;
+
+/*
+ * One board's fixed frames, and the template its power frames are built from, all in flash.
+ */
+typedef struct {
+  const GeaEncodedFrame_t* config;
+  const GeaEncodedFrame_t* zeroPower; //  Both coils off, heartbeat 0
+  const GeaEncodedFrame_t* versionRequest;
+  const GeaEncodedFrame_t* statusRequest;
+  const GeaFrameTemplate_t* power;
+} BoardFrames_t;
+
+typedef struct {
+  uint8_t sizeInches;
+  uint8_t boardCount;
+  uint8_t coilCount;
+  const BoardSpec_t* boards;
+  const BoardFrames_t* frames; // By board index, like boards
+  // Reset the power shadows, route every board to its bus and add it to the telemetry rotation
+  void (*begin)(PowerShadow_t* shadows);
+  // Queue changed or due power levels for every board into its bus's batch. Boards whose batch is NULL are left for next time.
+  void (*updatePower)(PowerShadow_t* shadows, const uint8_t* potLevels, uint8_t heartbeat, GeaTxBatch* const* batches);
+} Cooktop_t;
+
+template <typename Topology>
+struct CooktopImpl {
+  static constexpr size_t boardCount = sizeof(Topology::boards) / sizeof(Topology::boards[0]);
+
+  static constexpr bool coilValid(const CoilSpec_t& coil) {
+    // A coil is either absent and undriven, or present and driven by a real pot
+    return coil.profile == COIL_TYPE_NONE ? coil.pot == POT_NONE : coil.pot >= 0 && coil.pot < numPots;
+  }
+
+  static constexpr bool potUsedOnce(int8_t pot) {
+    int uses = 0;
+    for (size_t i = 0; i < boardCount; i++) {
+      uses += (Topology::boards[i].coil1.pot == pot) + (Topology::boards[i].coil2.pot == pot);
+    }
+    return uses <= 1;
+  }
+
+  static constexpr bool tableValid() {
+    for (size_t i = 0; i < boardCount; i++) {
+      const BoardSpec_t& board = Topology::boards[i];
+      if (!coilValid(board.coil1) || !coilValid(board.coil2) || board.bus >= GEA_BUS_COUNT) {
+        return false;
+      }
+      for (size_t j = 0; j < i; j++) {
+        if (Topology::boards[j].address == board.address) {
+          return false;
+        }
+      }
+    }
+    for (int8_t pot = 0; pot < numPots; pot++) {
+      if (!potUsedOnce(pot)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static constexpr uint8_t coilCount() {
+    uint8_t count = 0;
+    for (size_t i = 0; i < boardCount; i++) {
+      count += (Topology::boards[i].coil1.profile != COIL_TYPE_NONE) + (Topology::boards[i].coil2.profile != COIL_TYPE_NONE);
+    }
+    return count;
+  }
+
+  static_assert(boardCount > 0 && boardCount <= MAX_GENERATORS, "A cooktop needs 1 to MAX_GENERATORS boards");
+  static_assert(tableValid(), "Bad cooktop table: check coil profiles against pots, pot indexes, buses and duplicate addresses");
+  // Per-board tables elsewhere are sized statically, so check they hold this cooktop
+  static_assert(boardCount * (GEA_ESCAPED_SIZE(sizeof(SetPowerLevelsPayload_t)) + 1) <= GEA_TX_BATCH_SIZE,
+                "GEA_TX_BATCH_SIZE can't hold a power frame for every board");
+  static_assert(boardCount <= GEA_RX_QUEUE_DEPTH && boardCount <= GEA_MAX_PENDING, "Every board needs a receive slot and a request slot");
+  static_assert(boardCount <= MAX_TELEMETRY_BOARDS && boardCount <= GEA_LINK_MAX_BOARDS, "Every board needs a telemetry and a link entry");
+  static_assert(boardCount <= GEA_MAX_ROUTES, "Every board needs a bus route");
+
+  template <size_t I>
+  struct Frames {
+    static constexpr BoardSpec_t board = Topology::boards[I];
+    static constexpr auto configBytes = geaEncodeFrame(board.address, CMD_SET_BOARD_CONFIG,
+                                                       GeaConstPayload<sizeof(BoardConfigPayload_t)>{{board.coil1.profile, board.coil2.profile}});
+    static constexpr auto zeroPowerBytes = geaEncodeFrame(board.address, CMD_SET_PWR_LEVELS, GeaConstPayload<sizeof(SetPowerLevelsPayload_t)>{});
+    static constexpr auto versionBytes = geaEncodeFrame(board.address, CMD_GET_SW_VERSION, GeaConstPayload<0>{});
+    // The boards expect a zeroed payload the same size as the response
+    static constexpr auto statusBytes = geaEncodeFrame(board.address, CMD_GET_STATUS, GeaConstPayload<RESP_LENGTH_STATUS>{});
+
+    static constexpr GeaEncodedFrame_t config = geaEncoded(configBytes);
+    static constexpr GeaEncodedFrame_t zeroPower = geaEncoded(zeroPowerBytes);
+    static constexpr GeaEncodedFrame_t versionRequest = geaEncoded(versionBytes);
+    static constexpr GeaEncodedFrame_t statusRequest = geaEncoded(statusBytes);
+    static constexpr GeaFrameTemplate_t power = geaFrameTemplate(board.address, CMD_SET_PWR_LEVELS, sizeof(SetPowerLevelsPayload_t));
+
+    static constexpr BoardFrames_t pointers = {&config, &zeroPower, &versionRequest, &statusRequest, &power};
+  };
+
+  template <size_t... I>
+  struct FrameTable {
+    static constexpr BoardFrames_t entries[sizeof...(I)] = {Frames<I>::pointers...};
+  };
+
+  template <size_t... I>
+  static constexpr const BoardFrames_t* frameTable(std::index_sequence<I...>) {
+    return FrameTable<I...>::entries;
+  }
+
+  template <int8_t Pot>
+  static uint8_t level(const uint8_t* potLevels) {
+    if constexpr (Pot == POT_NONE) {
+      return 0;
+    } else {
+      return potLevels[Pot];
+    }
+  }
+
+  template <size_t I>
+  static void beginBoard(PowerShadow_t* shadows) {
+    constexpr BoardSpec_t board = Topology::boards[I];
+    powerShadowInit(&shadows[I], &Frames<I>::power, board.keepaliveMs);
+    geaRoute(board.address, board.bus);
+    telemetryAddBoard(&Frames<I>::statusRequest);
+  }
+
+  template <size_t I>
+  static void updateBoard(PowerShadow_t* shadows, const uint8_t* potLevels, uint8_t heartbeat, GeaTxBatch* const* batches) {
+    constexpr BoardSpec_t board = Topology::boards[I];
+    // A board that hasn't taken its config yet must not get power levels
+    if (batches[board.bus] != NULL && shadows[I].ready) {
+      updatePowerLevels(&shadows[I], level<board.coil1.pot>(potLevels), level<board.coil2.pot>(potLevels), heartbeat, batches[board.bus]);
+    }
+  }
+
+  template <size_t... I>
+  static void beginAll(PowerShadow_t* shadows, std::index_sequence<I...>) {
+    (beginBoard<I>(shadows), ...);
+  }
+
+  template <size_t... I>
+  static void updateAll(PowerShadow_t* shadows, const uint8_t* potLevels, uint8_t heartbeat, GeaTxBatch* const* batches, std::index_sequence<I...>) {
+    (updateBoard<I>(shadows, potLevels, heartbeat, batches), ...);
+  }
+
+  static void begin(PowerShadow_t* shadows) {
+    beginAll(shadows, std::make_index_sequence<boardCount>());
+  }
+
+  static void updatePower(PowerShadow_t* shadows, const uint8_t* potLevels, uint8_t heartbeat, GeaTxBatch* const* batches) {
+    updateAll(shadows, potLevels, heartbeat, batches, std::make_index_sequence<boardCount>());
+  }
+};
+
+template <typename Topology>
+constexpr Cooktop_t makeCooktop() {
+  typedef CooktopImpl<Topology> Impl;
+  return {Topology::sizeInches, Impl::boardCount, Impl::coilCount(), Topology::boards,
+          Impl::frameTable(std::make_index_sequence<Impl::boardCount>()), Impl::begin, Impl::updatePower};
+}
+
+#endif